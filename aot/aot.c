@@ -0,0 +1,779 @@
+#include <limits.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "interpreter/interpreter.h"
+#include "interpreter/reader.h"
+
+/* The ahead of time compiler: my_own_lisp_aot output.c program.mlisp...
+ * Translates the programs to C source that is linked with the runtime(the library my_own_lisp_runtime).
+ * Every top level expression becomes a function that builds the expression with the constructors of the runtime,
+ * the generated main evaluates the expressions in order, like the interpreter loads the programs, so the compiled
+ * program does not read source.
+ * A top level (load "file") with a literal file name is replaced by the expressions of the file, the file name is
+ * resolved from the directory the compiler runs in.
+ * The functions defined at the top level with (fun {name arguments...} {body}) or (def {name} (\ {arguments...} {body}))
+ * whose bodies the JIT could compile(integer literals, the arguments, + - * / %, comparisons, if and calls of the
+ * function itself, see jit.h) are also translated to C functions. The generated main sets them as the native code of
+ * the functions when they are defined(see lisp_jit_set_native_function), they are called under the guards of the JIT
+ * and fall back to the interpreter when a guard fails or the C code can not continue.
+ */
+
+static char* BUILTIN_LOAD = "load";
+static char* BUILTIN_DEF = "def";
+static char* BUILTIN_DEF_FUN = "fun";
+static char* BUILTIN_LAMBDA = "\\";
+static char* VARARGS_SYMBOL = "&";
+static constexpr int MAX_LOAD_DEPTH = 64;
+// the number of arguments the native code of a function can have(see lisp_jit_set_native_function)
+static constexpr long MAX_NATIVE_ARGUMENTS = 8;
+
+typedef enum {
+    AOT_TYPE_NONE,
+    AOT_TYPE_NUMBER,
+    AOT_TYPE_BOOLEAN
+} aot_type_t;
+
+typedef enum {
+    AOT_OP_ADD,
+    AOT_OP_SUBTRACT,
+    AOT_OP_MULTIPLY,
+    AOT_OP_DIVIDE,
+    AOT_OP_MOD,
+    AOT_OP_EQ,
+    AOT_OP_NE,
+    AOT_OP_GT,
+    AOT_OP_GE,
+    AOT_OP_LT,
+    AOT_OP_LE,
+    AOT_OP_IF
+} aot_operation_t;
+
+// the builtins of the bodies that are translated to C, the C operator or the overflow checking builtin of each
+static const struct {
+    char* name;
+    aot_operation_t operation;
+    char* c_operation;
+} AOT_OPERATIONS[] = {
+    {"+", AOT_OP_ADD, "__builtin_add_overflow"},
+    {"-", AOT_OP_SUBTRACT, "__builtin_sub_overflow"},
+    {"*", AOT_OP_MULTIPLY, "__builtin_mul_overflow"},
+    {"/", AOT_OP_DIVIDE, "/"},
+    {"%", AOT_OP_MOD, "%"},
+    {"==", AOT_OP_EQ, "=="},
+    {"!=", AOT_OP_NE, "!="},
+    {">", AOT_OP_GT, ">"},
+    {">=", AOT_OP_GE, ">="},
+    {"<", AOT_OP_LT, "<"},
+    {"<=", AOT_OP_LE, "<="},
+    {"if", AOT_OP_IF, NULL},
+};
+
+static char* GENERATED_PROLOGUE =
+    "/* Generated by my_own_lisp_aot, do not edit */\n"
+    "#include <stdarg.h>\n"
+    "#include <stdint.h>\n"
+    "#include <stdio.h>\n"
+    "#include <stdlib.h>\n"
+    "\n"
+    "#include \"interpreter/interpreter.h\"\n"
+    "#include \"interpreter/heap.h\"\n"
+    "#include \"interpreter/jit.h\"\n"
+    "\n"
+    "typedef lisp_value_t* (*form_t)();\n"
+    "\n"
+    "/* A function translated to C, the native code of the function defined by the form with the index form */\n"
+    "typedef struct native_function_t {\n"
+    "    size_t form;\n"
+    "    char* name;\n"
+    "    form_t formal_arguments;\n"
+    "    form_t body;\n"
+    "    bool is_result_boolean;\n"
+    "    lisp_jit_native_function_t function;\n"
+    "    char** guard_names;\n"
+    "} native_function_t;\n"
+    "\n"
+    "/* Appends the children to parent, if one of the values is null all of them are deleted */\n"
+    "static lisp_value_t* children(lisp_value_t* parent, long count, ...) {\n"
+    "    va_list arguments;\n"
+    "    va_start(arguments, count);\n"
+    "    bool ok = !is_lisp_value_null(parent);\n"
+    "    for (long i = 0; i < count; i++) {\n"
+    "        lisp_value_t* child = va_arg(arguments, lisp_value_t*);\n"
+    "        if (!ok || is_lisp_value_null(child) || !append_lisp_value(parent, child)) {\n"
+    "            ok = false;\n"
+    "            lisp_value_delete(child);\n"
+    "        }\n"
+    "    }\n"
+    "    va_end(arguments);\n"
+    "    if (!ok) {\n"
+    "        lisp_value_delete(parent);\n"
+    "        return get_null_lisp_value();\n"
+    "    }\n"
+    "    return parent;\n"
+    "}\n"
+    "\n";
+
+static char* GENERATED_MAIN =
+    "int main(int argc, char **argv) {\n"
+    "    lisp_heap_configure_from_environment_variables();\n"
+    "    lisp_environment_t* env = lisp_environment_new_root();\n"
+    "    if (!lisp_environment_setup_builtin_functions(env)) {\n"
+    "        puts(\"Failed to initialize lisp evaluation environment. Probably out of memory.\");\n"
+    "        exit(1);\n"
+    "    }\n"
+    "\n"
+    "    native_function_t* native_function = NATIVE_FUNCTIONS;\n"
+    "    for (size_t i = 0; FORMS[i] != NULL; i++) {\n"
+    "        lisp_value_t* value = FORMS[i]();\n"
+    "        if (is_lisp_value_null(value)) {\n"
+    "            printf(\"Error encountered during loading file %s: null lisp value\", FORM_FILES[i]);\n"
+    "            break;\n"
+    "        }\n"
+    "        evaluate_loaded_lisp_value(env, value);\n"
+    "        // the function defined by the form is interpreted if it is not the function that was translated\n"
+    "        if (native_function->function != NULL && native_function->form == i) {\n"
+    "            lisp_jit_set_native_function(env, native_function->name, native_function->formal_arguments(),\n"
+    "                native_function->body(), native_function->is_result_boolean, native_function->function,\n"
+    "                native_function->guard_names);\n"
+    "            native_function++;\n"
+    "        }\n"
+    "    }\n"
+    "\n"
+    "    lisp_environment_delete(env);\n"
+    "    return 0;\n"
+    "}\n";
+
+typedef struct aot_native_function_t {
+    long form;
+    char* name;
+    bool is_result_boolean;
+} aot_native_function_t;
+
+typedef struct aot_compiler_t {
+    FILE* output;
+    // the file of every translated expression
+    char** form_files;
+    long forms_count;
+    long forms_capacity;
+    // the functions translated to C, in the order of their forms
+    aot_native_function_t* native_functions;
+    long native_functions_count;
+    long native_functions_capacity;
+} aot_compiler_t;
+
+static void emit_c_string_contents(FILE* output, const char* string) {
+    for (const unsigned char* c = (const unsigned char*) string; *c != '\0'; c++) {
+        if (*c == '"' || *c == '\\') {
+            fprintf(output, "\\%c", *c);
+        } else if (*c < 0x20 || *c >= 0x7F) {
+            fprintf(output, "\\%03o", *c);
+        } else {
+            fputc(*c, output);
+        }
+    }
+}
+
+static void emit_c_string(FILE* output, const char* string) {
+    fputc('"', output);
+    emit_c_string_contents(output, string);
+    fputc('"', output);
+}
+
+static void emit_indent(FILE* output, int depth) {
+    for (int i = 0; i < depth; i++) {
+        fputs("    ", output);
+    }
+}
+
+/* Emits the C expression that builds value, the value is one that lisp_read returns */
+static bool emit_value(FILE* output, lisp_value_t* value, int depth) {
+    switch (value->value_type) {
+        case VAL_NUMBER:
+            if (value->value_number == LONG_MIN) {
+                fprintf(output, "lisp_value_number_new(%ldL - 1)", LONG_MIN + 1);
+            } else {
+                fprintf(output, "lisp_value_number_new(%ldL)", value->value_number);
+            }
+            return true;
+        case VAL_DECIMAL:
+            // hexadecimal floating constants are exact
+            fprintf(output, "lisp_value_decimal_new(%a)", value->value_decimal);
+            return true;
+        case VAL_BOOLEAN:
+            fprintf(output, "lisp_value_boolean_new(%ld)", value->value_number);
+            return true;
+        case VAL_SYMBOL:
+            fputs("lisp_value_symbol_new(", output);
+            emit_c_string(output, value->value_symbol);
+            fputc(')', output);
+            return true;
+        case VAL_STRING: {
+            // lisp_value_string_new expects the literal as it is written in the source
+            char* escaped_string = lisp_string_escape(value->value_string);
+            if (escaped_string == NULL) {
+                return false;
+            }
+            fputs("lisp_value_string_new(\"\\\"", output);
+            emit_c_string_contents(output, escaped_string);
+            fputs("\\\"\")", output);
+            free(escaped_string);
+            return true;
+        }
+        case VAL_ERR:
+            // the reader makes errors only from numbers that are out of range
+            fputs("get_lisp_value_error_bad_numeric_value()", output);
+            return true;
+        case VAL_SEXPR:
+        case VAL_QEXPR:
+            fprintf(output, "children(%s, %d", value->value_type == VAL_SEXPR ? "lisp_value_sexpr_new()" : "lisp_value_qexpr_new()", value->count);
+            for (long i = 0; i < value->count; i++) {
+                fputs(",\n", output);
+                emit_indent(output, depth + 1);
+                if (!emit_value(output, value->values[i], depth + 1)) {
+                    return false;
+                }
+            }
+            fputc(')', output);
+            return true;
+        case VAL_ROOT:
+        case VAL_BUILTIN_FUN:
+        case VAL_USERDEFINED_FUN:
+            return false;
+    }
+    return false;
+}
+
+/* The C source of a function, the source is discarded when the body can not be translated */
+typedef struct aot_code_t {
+    char* chars;
+    size_t count;
+    size_t capacity;
+    bool ok;
+} aot_code_t;
+
+static void append_code(aot_code_t* code, int depth, const char* format, ...) {
+    va_list arguments;
+    va_start(arguments, format);
+    int length = vsnprintf(NULL, 0, format, arguments);
+    va_end(arguments);
+    size_t required = code->count + (size_t) depth * 4 + (size_t) length + 1;
+    if (!code->ok || length < 0) {
+        code->ok = false;
+        return;
+    }
+    if (required > code->capacity) {
+        size_t capacity = code->capacity == 0 ? 1024 : code->capacity * 2;
+        while (capacity < required) {
+            capacity *= 2;
+        }
+        char* chars = realloc(code->chars, capacity);
+        if (chars == NULL) {
+            code->ok = false;
+            return;
+        }
+        code->chars = chars;
+        code->capacity = capacity;
+    }
+    for (int i = 0; i < depth; i++) {
+        memcpy(code->chars + code->count, "    ", 4);
+        code->count += 4;
+    }
+    va_start(arguments, format);
+    vsnprintf(code->chars + code->count, (size_t) length + 1, format, arguments);
+    va_end(arguments);
+    code->count += (size_t) length;
+}
+
+typedef struct aot_function_compiler_t {
+    aot_code_t code;
+    char* name;
+    // the formal arguments start at index first_formal_argument
+    lisp_value_t* formal_arguments;
+    long first_formal_argument;
+    long arguments_count;
+    // the type of the result of the recursive calls is assumed, the assumption must match the type of the body
+    aot_type_t result_type;
+    long index;
+    long temporaries_count;
+    // the names of the symbols the body uses, borrowed from the body
+    char** guard_names;
+    long guards_count;
+    long guards_capacity;
+} aot_function_compiler_t;
+
+static void add_guard_name(aot_function_compiler_t* compiler, char* name) {
+    for (long i = 0; i < compiler->guards_count; i++) {
+        if (strcmp(compiler->guard_names[i], name) == 0) {
+            return;
+        }
+    }
+    if (compiler->guards_count == compiler->guards_capacity) {
+        long capacity = compiler->guards_capacity == 0 ? 8 : compiler->guards_capacity * 2;
+        char** guard_names = realloc(compiler->guard_names, sizeof(char*) * capacity);
+        if (guard_names == NULL) {
+            compiler->code.ok = false;
+            return;
+        }
+        compiler->guard_names = guard_names;
+        compiler->guards_capacity = capacity;
+    }
+    compiler->guard_names[compiler->guards_count++] = name;
+}
+
+static long get_formal_argument_index(aot_function_compiler_t* compiler, char* symbol) {
+    for (long i = 0; i < compiler->arguments_count; i++) {
+        if (strcmp(compiler->formal_arguments->values[compiler->first_formal_argument + i]->value_symbol, symbol) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/* Declares a new temporary variable t<index> at depth */
+static long new_temporary(aot_function_compiler_t* compiler, int depth) {
+    long temporary = compiler->temporaries_count++;
+    append_code(&compiler->code, depth, "long t%ld;\n", temporary);
+    return temporary;
+}
+
+static aot_type_t compile_function_expression(aot_function_compiler_t* compiler, lisp_value_t* expression,
+                                              bool is_tail, long target, int depth);
+
+/* Compiles value to statements that store its result in the temporary target */
+static aot_type_t compile_function_value(aot_function_compiler_t* compiler, lisp_value_t* value, bool is_tail,
+                                         long target, int depth) {
+    if (value->value_type == VAL_NUMBER) {
+        if (value->value_number == LONG_MIN) {
+            append_code(&compiler->code, depth, "t%ld = %ldL - 1;\n", target, LONG_MIN + 1);
+        } else {
+            append_code(&compiler->code, depth, "t%ld = %ldL;\n", target, value->value_number);
+        }
+        return AOT_TYPE_NUMBER;
+    }
+    if (value->value_type == VAL_SYMBOL) {
+        long index = get_formal_argument_index(compiler, value->value_symbol);
+        if (index < 0) {
+            return AOT_TYPE_NONE;
+        }
+        append_code(&compiler->code, depth, "t%ld = a[%ld];\n", target, index);
+        return AOT_TYPE_NUMBER;
+    }
+    if (value->value_type == VAL_SEXPR) {
+        return compile_function_expression(compiler, value, is_tail, target, depth);
+    }
+    return AOT_TYPE_NONE;
+}
+
+static aot_type_t compile_self_call(aot_function_compiler_t* compiler, lisp_value_t* expression, bool is_tail,
+                                    long target, int depth) {
+    long arguments_count = expression->count - 1;
+    if (arguments_count != compiler->arguments_count) {
+        return AOT_TYPE_NONE;
+    }
+    long first_argument = compiler->temporaries_count;
+    for (long i = 0; i < arguments_count; i++) {
+        new_temporary(compiler, depth);
+    }
+    for (long i = 0; i < arguments_count; i++) {
+        if (compile_function_value(compiler, expression->values[i + 1], false, first_argument + i, depth) != AOT_TYPE_NUMBER) {
+            return AOT_TYPE_NONE;
+        }
+    }
+    if (is_tail) {
+        // the arguments replace the arguments of the current call and the body starts again
+        for (long i = 0; i < arguments_count; i++) {
+            append_code(&compiler->code, depth, "a[%ld] = t%ld;\n", i, first_argument + i);
+        }
+        append_code(&compiler->code, depth, "goto body;\n");
+        return compiler->result_type;
+    }
+    append_code(&compiler->code, depth, "{\n");
+    append_code(&compiler->code, depth + 1, "const long call_arguments[] = {");
+    for (long i = 0; i < arguments_count; i++) {
+        append_code(&compiler->code, 0, i == 0 ? "t%ld" : ", t%ld", first_argument + i);
+    }
+    append_code(&compiler->code, 0, "};\n");
+    append_code(&compiler->code, depth + 1, "if (!native_function_%ld(call_arguments, &t%ld, stack_end)) {\n",
+                compiler->index, target);
+    append_code(&compiler->code, depth + 2, "return 0;\n");
+    append_code(&compiler->code, depth + 1, "}\n");
+    append_code(&compiler->code, depth, "}\n");
+    return compiler->result_type;
+}
+
+static aot_type_t compile_arithmetic(aot_function_compiler_t* compiler, aot_operation_t operation,
+                                     char* c_operation, lisp_value_t* expression, long target, int depth) {
+    if (compile_function_value(compiler, expression->values[1], false, target, depth) != AOT_TYPE_NUMBER) {
+        return AOT_TYPE_NONE;
+    }
+    if (expression->count == 2 && operation == AOT_OP_SUBTRACT) {
+        append_code(&compiler->code, depth, "if (__builtin_sub_overflow(0L, t%ld, &t%ld)) {\n", target, target);
+        append_code(&compiler->code, depth + 1, "return 0;\n");
+        append_code(&compiler->code, depth, "}\n");
+    }
+    for (long i = 2; i < expression->count; i++) {
+        long operand = new_temporary(compiler, depth);
+        if (compile_function_value(compiler, expression->values[i], false, operand, depth) != AOT_TYPE_NUMBER) {
+            return AOT_TYPE_NONE;
+        }
+        if (operation == AOT_OP_DIVIDE || operation == AOT_OP_MOD) {
+            // division by zero is an error and division by -1 can overflow, the interpreter handles both
+            append_code(&compiler->code, depth, "if (t%ld == 0 || t%ld == -1) {\n", operand, operand);
+            append_code(&compiler->code, depth + 1, "return 0;\n");
+            append_code(&compiler->code, depth, "}\n");
+            append_code(&compiler->code, depth, "t%ld = t%ld %s t%ld;\n", target, target, c_operation, operand);
+        } else {
+            append_code(&compiler->code, depth, "if (%s(t%ld, t%ld, &t%ld)) {\n", c_operation, target, operand, target);
+            append_code(&compiler->code, depth + 1, "return 0;\n");
+            append_code(&compiler->code, depth, "}\n");
+        }
+    }
+    return AOT_TYPE_NUMBER;
+}
+
+static aot_type_t compile_comparison(aot_function_compiler_t* compiler, aot_operation_t operation,
+                                     char* c_operation, lisp_value_t* expression, long target, int depth) {
+    if (expression->count != 3
+        || compile_function_value(compiler, expression->values[1], false, target, depth) != AOT_TYPE_NUMBER) {
+        return AOT_TYPE_NONE;
+    }
+    long operand = new_temporary(compiler, depth);
+    if (compile_function_value(compiler, expression->values[2], false, operand, depth) != AOT_TYPE_NUMBER) {
+        return AOT_TYPE_NONE;
+    }
+    append_code(&compiler->code, depth, "t%ld = t%ld %s t%ld;\n", target, target, c_operation, operand);
+    // == and != evaluate to booleans, the orderings evaluate to numbers
+    return operation == AOT_OP_EQ || operation == AOT_OP_NE ? AOT_TYPE_BOOLEAN : AOT_TYPE_NUMBER;
+}
+
+static aot_type_t compile_if(aot_function_compiler_t* compiler, lisp_value_t* expression, bool is_tail, long target,
+                             int depth) {
+    if (expression->count != 4
+        || expression->values[2]->value_type != VAL_QEXPR
+        || expression->values[3]->value_type != VAL_QEXPR) {
+        return AOT_TYPE_NONE;
+    }
+    long condition = new_temporary(compiler, depth);
+    if (compile_function_value(compiler, expression->values[1], false, condition, depth) == AOT_TYPE_NONE) {
+        return AOT_TYPE_NONE;
+    }
+    append_code(&compiler->code, depth, "if (t%ld != 0) {\n", condition);
+    aot_type_t true_type = compile_function_expression(compiler, expression->values[2], is_tail, target, depth + 1);
+    append_code(&compiler->code, depth, "} else {\n");
+    aot_type_t false_type = compile_function_expression(compiler, expression->values[3], is_tail, target, depth + 1);
+    append_code(&compiler->code, depth, "}\n");
+    return true_type == false_type ? true_type : AOT_TYPE_NONE;
+}
+
+/* Compiles the evaluation of expression(a s-expression, or a q-expression of a branch or the body) like the JIT does,
+ * the symbols are resolved by their names, the guards check the bindings when the code is called */
+static aot_type_t compile_function_expression(aot_function_compiler_t* compiler, lisp_value_t* expression,
+                                              bool is_tail, long target, int depth) {
+    if (expression->count == 1) {
+        return compile_function_value(compiler, expression->values[0], is_tail, target, depth);
+    }
+    lisp_value_t* operator = expression->count >= 2 ? expression->values[0] : NULL;
+    if (operator == NULL || operator->value_type != VAL_SYMBOL
+        || get_formal_argument_index(compiler, operator->value_symbol) >= 0) {
+        return AOT_TYPE_NONE;
+    }
+
+    if (strcmp(operator->value_symbol, compiler->name) == 0) {
+        add_guard_name(compiler, operator->value_symbol);
+        return compile_self_call(compiler, expression, is_tail, target, depth);
+    }
+    for (size_t i = 0; i < sizeof(AOT_OPERATIONS) / sizeof(AOT_OPERATIONS[0]); i++) {
+        if (strcmp(operator->value_symbol, AOT_OPERATIONS[i].name) != 0) {
+            continue;
+        }
+        add_guard_name(compiler, operator->value_symbol);
+        aot_operation_t operation = AOT_OPERATIONS[i].operation;
+        if (operation == AOT_OP_IF) {
+            return compile_if(compiler, expression, is_tail, target, depth);
+        }
+        if (operation >= AOT_OP_EQ) {
+            return compile_comparison(compiler, operation, AOT_OPERATIONS[i].c_operation, expression, target, depth);
+        }
+        return compile_arithmetic(compiler, operation, AOT_OPERATIONS[i].c_operation, expression, target, depth);
+    }
+    return AOT_TYPE_NONE;
+}
+
+/* Compiles the body to the C function native_function_<index>, see lisp_jit_native_function_t */
+static aot_type_t compile_function(aot_function_compiler_t* compiler, lisp_value_t* body, aot_type_t result_type) {
+    free(compiler->code.chars);
+    compiler->code = (aot_code_t) {.ok = true};
+    compiler->guards_count = 0;
+    compiler->temporaries_count = 0;
+    compiler->result_type = result_type;
+
+    aot_code_t* code = &compiler->code;
+    append_code(code, 0, "static int native_function_%ld(const long* arguments, long* result, uintptr_t stack_end) {\n",
+                compiler->index);
+    append_code(code, 1, "char marker;\n");
+    append_code(code, 1, "if ((uintptr_t) &marker <= stack_end) {\n");
+    append_code(code, 2, "return 0;\n");
+    append_code(code, 1, "}\n");
+    append_code(code, 1, "long a[%ld];\n", compiler->arguments_count);
+    append_code(code, 1, "for (long i = 0; i < %ld; i++) {\n", compiler->arguments_count);
+    append_code(code, 2, "a[i] = arguments[i];\n");
+    append_code(code, 1, "}\n");
+    append_code(code, 0, "body:;\n");
+    long target = new_temporary(compiler, 1);
+    aot_type_t type = compile_function_expression(compiler, body, true, target, 1);
+    append_code(code, 1, "*result = t%ld;\n", target);
+    append_code(code, 1, "return 1;\n");
+    append_code(code, 0, "}\n\n");
+    return code->ok ? type : AOT_TYPE_NONE;
+}
+
+/* Finds the name, the formal arguments and the body of (fun {name arguments...} {body}) or
+ * (def {name} (\ {arguments...} {body})), false if value is not one of them */
+static bool get_function_definition(lisp_value_t* value, char** name, lisp_value_t** formal_arguments,
+                                    long* first_formal_argument, lisp_value_t** body) {
+    if (value->value_type != VAL_SEXPR || value->count != 3 || value->values[0]->value_type != VAL_SYMBOL
+        || value->values[1]->value_type != VAL_QEXPR || value->values[1]->count < 1
+        || value->values[1]->values[0]->value_type != VAL_SYMBOL) {
+        return false;
+    }
+    *name = value->values[1]->values[0]->value_symbol;
+    if (strcmp(value->values[0]->value_symbol, BUILTIN_DEF_FUN) == 0 && value->values[2]->value_type == VAL_QEXPR) {
+        *formal_arguments = value->values[1];
+        *first_formal_argument = 1;
+        *body = value->values[2];
+        return true;
+    }
+    lisp_value_t* lambda = value->values[2];
+    if (strcmp(value->values[0]->value_symbol, BUILTIN_DEF) == 0 && value->values[1]->count == 1
+        && lambda->value_type == VAL_SEXPR && lambda->count == 3 && lambda->values[0]->value_type == VAL_SYMBOL
+        && strcmp(lambda->values[0]->value_symbol, BUILTIN_LAMBDA) == 0
+        && lambda->values[1]->value_type == VAL_QEXPR && lambda->values[2]->value_type == VAL_QEXPR) {
+        *formal_arguments = lambda->values[1];
+        *first_formal_argument = 0;
+        *body = lambda->values[2];
+        return true;
+    }
+    return false;
+}
+
+static bool is_native_function_signature(lisp_value_t* formal_arguments, long first_formal_argument) {
+    long arguments_count = formal_arguments->count - first_formal_argument;
+    if (arguments_count < 1 || arguments_count > MAX_NATIVE_ARGUMENTS) {
+        return false;
+    }
+    for (long i = first_formal_argument; i < formal_arguments->count; i++) {
+        if (formal_arguments->values[i]->value_type != VAL_SYMBOL
+            || strcmp(formal_arguments->values[i]->value_symbol, VARARGS_SYMBOL) == 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool add_native_function(aot_compiler_t* compiler, long form, char* name, bool is_result_boolean) {
+    if (compiler->native_functions_count == compiler->native_functions_capacity) {
+        long capacity = compiler->native_functions_capacity == 0 ? 16 : compiler->native_functions_capacity * 2;
+        aot_native_function_t* native_functions = realloc(compiler->native_functions,
+                                                          sizeof(aot_native_function_t) * capacity);
+        if (native_functions == NULL) {
+            return false;
+        }
+        compiler->native_functions = native_functions;
+        compiler->native_functions_capacity = capacity;
+    }
+    char* native_function_name = malloc(strlen(name) + 1);
+    if (native_function_name == NULL) {
+        return false;
+    }
+    strcpy(native_function_name, name);
+    compiler->native_functions[compiler->native_functions_count++] = (aot_native_function_t) {
+        .form = form,
+        .name = native_function_name,
+        .is_result_boolean = is_result_boolean
+    };
+    return true;
+}
+
+/* Translates the function defined by the form to C if its body can be translated, otherwise nothing is emitted
+ * @return false if out of memory */
+static bool translate_function(aot_compiler_t* compiler, lisp_value_t* value, long form) {
+    char* name = NULL;
+    lisp_value_t* formal_arguments = NULL;
+    long first_formal_argument = 0;
+    lisp_value_t* body = NULL;
+    if (!get_function_definition(value, &name, &formal_arguments, &first_formal_argument, &body)
+        || !is_native_function_signature(formal_arguments, first_formal_argument)) {
+        return true;
+    }
+
+    aot_function_compiler_t function_compiler = {
+        .name = name,
+        .formal_arguments = formal_arguments,
+        .first_formal_argument = first_formal_argument,
+        .arguments_count = formal_arguments->count - first_formal_argument,
+        .index = form
+    };
+    aot_type_t result_type = compile_function(&function_compiler, body, AOT_TYPE_NUMBER);
+    if (result_type == AOT_TYPE_BOOLEAN) {
+        result_type = compile_function(&function_compiler, body, AOT_TYPE_BOOLEAN) == AOT_TYPE_BOOLEAN
+            ? AOT_TYPE_BOOLEAN
+            : AOT_TYPE_NONE;
+    }
+    bool ok = function_compiler.code.ok;
+    if (result_type != AOT_TYPE_NONE) {
+        FILE* output = compiler->output;
+        fputs("/* ", output);
+        emit_c_string_contents(output, name);
+        fputs(" translated to C */\n", output);
+        fwrite(function_compiler.code.chars, 1, function_compiler.code.count, output);
+
+        // the formal arguments and the body that the function has to have when the native code is set
+        fprintf(output, "static lisp_value_t* native_function_%ld_formal_arguments() {\n    return children(lisp_value_qexpr_new(), %ld", form, function_compiler.arguments_count);
+        for (long i = first_formal_argument; i < formal_arguments->count; i++) {
+            fputs(",\n", output);
+            emit_indent(output, 2);
+            emit_value(output, formal_arguments->values[i], 2);
+        }
+        fprintf(output, ");\n}\n\nstatic lisp_value_t* native_function_%ld_body() {\n    return ", form);
+        ok = emit_value(output, body, 1);
+        fprintf(output, ";\n}\n\nstatic char* native_function_%ld_guard_names[] = {\n", form);
+        for (long i = 0; i < function_compiler.guards_count; i++) {
+            emit_indent(output, 1);
+            emit_c_string(output, function_compiler.guard_names[i]);
+            fputs(",\n", output);
+        }
+        fputs("    NULL\n};\n\n", output);
+        ok = ok && add_native_function(compiler, form, name, result_type == AOT_TYPE_BOOLEAN);
+    }
+    free(function_compiler.code.chars);
+    free(function_compiler.guard_names);
+    return ok;
+}
+
+static bool add_form(aot_compiler_t* compiler, lisp_value_t* value, const char* filename) {
+    if (compiler->forms_count == compiler->forms_capacity) {
+        long capacity = compiler->forms_capacity == 0 ? 64 : compiler->forms_capacity * 2;
+        char** form_files = realloc(compiler->form_files, sizeof(char*) * capacity);
+        if (form_files == NULL) {
+            return false;
+        }
+        compiler->form_files = form_files;
+        compiler->forms_capacity = capacity;
+    }
+    char* form_file = malloc(strlen(filename) + 1);
+    if (form_file == NULL) {
+        return false;
+    }
+    strcpy(form_file, filename);
+    compiler->form_files[compiler->forms_count] = form_file;
+
+    long form = compiler->forms_count;
+    fprintf(compiler->output, "static lisp_value_t* form_%ld() {\n    return ", form);
+    compiler->forms_count++;
+    if (!emit_value(compiler->output, value, 1)) {
+        return false;
+    }
+    fputs(";\n}\n\n", compiler->output);
+    return translate_function(compiler, value, form);
+}
+
+static bool is_literal_load(lisp_value_t* value) {
+    return value->value_type == VAL_SEXPR
+        && value->count == 2
+        && value->values[0]->value_type == VAL_SYMBOL
+        && strcmp(value->values[0]->value_symbol, BUILTIN_LOAD) == 0
+        && value->values[1]->value_type == VAL_STRING;
+}
+
+static bool translate_file(aot_compiler_t* compiler, const char* filename, int load_depth) {
+    if (load_depth > MAX_LOAD_DEPTH) {
+        printf("Error translating file %s: files are loaded more than %d levels deep\n", filename, MAX_LOAD_DEPTH);
+        return false;
+    }
+    lisp_value_t* expressions = lisp_read_file(filename);
+    if (is_lisp_value_null(expressions)) {
+        printf("Error translating file %s: null lisp value\n", filename);
+        return false;
+    }
+    if (expressions->value_type == VAL_ERR) {
+        fputs(expressions->error_message, stdout);
+        lisp_value_delete(expressions);
+        return false;
+    }
+
+    bool ok = true;
+    for (long i = 0; ok && i < expressions->count; i++) {
+        lisp_value_t* expression = expressions->values[i];
+        if (is_literal_load(expression)) {
+            ok = translate_file(compiler, expression->values[1]->value_string, load_depth + 1);
+        } else {
+            ok = add_form(compiler, expression, filename);
+            if (!ok) {
+                printf("Error translating file %s: out of memory\n", filename);
+            }
+        }
+    }
+    lisp_value_delete(expressions);
+    return ok;
+}
+
+static void emit_forms_table(aot_compiler_t* compiler) {
+    fputs("static form_t FORMS[] = {\n", compiler->output);
+    for (long i = 0; i < compiler->forms_count; i++) {
+        fprintf(compiler->output, "    form_%ld,\n", i);
+    }
+    fputs("    NULL\n};\n\nstatic char* FORM_FILES[] = {\n", compiler->output);
+    for (long i = 0; i < compiler->forms_count; i++) {
+        emit_indent(compiler->output, 1);
+        emit_c_string(compiler->output, compiler->form_files[i]);
+        fputs(",\n", compiler->output);
+    }
+    fputs("    NULL\n};\n\nstatic native_function_t NATIVE_FUNCTIONS[] = {\n", compiler->output);
+    for (long i = 0; i < compiler->native_functions_count; i++) {
+        aot_native_function_t* native_function = &compiler->native_functions[i];
+        long form = native_function->form;
+        fprintf(compiler->output, "    {%ld, ", form);
+        emit_c_string(compiler->output, native_function->name);
+        fprintf(compiler->output, ", native_function_%ld_formal_arguments, native_function_%ld_body, %s, native_function_%ld, native_function_%ld_guard_names},\n",
+                form, form, native_function->is_result_boolean ? "true" : "false", form, form);
+    }
+    fputs("    {0, NULL, NULL, NULL, false, NULL, NULL}\n};\n\n", compiler->output);
+}
+
+int main(int argc, char **argv) {
+    if (argc < 3) {
+        printf("Usage: %s output.c program.mlisp...\n", argv[0]);
+        return 1;
+    }
+    aot_compiler_t compiler = {.output = fopen(argv[1], "w")};
+    if (compiler.output == NULL) {
+        printf("Error opening output file %s\n", argv[1]);
+        return 1;
+    }
+    fputs(GENERATED_PROLOGUE, compiler.output);
+    bool ok = true;
+    for (int i = 2; ok && i < argc; i++) {
+        ok = translate_file(&compiler, argv[i], 0);
+    }
+    if (ok) {
+        emit_forms_table(&compiler);
+        fputs(GENERATED_MAIN, compiler.output);
+    }
+
+    ok = fclose(compiler.output) == 0 && ok;
+    if (!ok) {
+        remove(argv[1]);
+    }
+    for (long i = 0; i < compiler.forms_count; i++) {
+        free(compiler.form_files[i]);
+    }
+    free(compiler.form_files);
+    for (long i = 0; i < compiler.native_functions_count; i++) {
+        free(compiler.native_functions[i].name);
+    }
+    free(compiler.native_functions);
+    return ok ? 0 : 1;
+}
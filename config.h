@@ -11,3 +11,11 @@
 #if defined(_UNIX_STYLE_OS) && !defined(READ_LINE_STDIN_WITH_STDIO)
 #define _UNIX_STYLE_OS_EAD_LINE_STDIN_WITH_EDITLINE
 #endif
+
+#if defined(_UNIX_STYLE_OS) && defined(__x86_64__)
+#define _X86_64_JIT
+#endif
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define _X86_64_SIMD_SCAN
+#endif
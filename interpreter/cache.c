@@ -0,0 +1,578 @@
+// mkstemp, fdopen and fchmod are not declared in strict ISO C mode
+#define _DEFAULT_SOURCE
+
+#include "cache.h"
+#include "config.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_UNIX_STYLE_OS)
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static char* CACHE_FILE_EXTENSION = ".cache";
+// the template of mkstemp, the temporary file is a unique file next to the cache file
+static char* TEMPORARY_FILE_TEMPLATE = ".tmpXXXXXX";
+// the first bytes of a cache file, the digit is the version of the format
+static char* CACHE_MAGIC = "mlispc1\n";
+static constexpr size_t CACHE_MAGIC_LENGTH = 8;
+static constexpr size_t MAX_VARINT_LENGTH = 10;
+static constexpr size_t HASH_LENGTH = 8;
+static constexpr size_t HASH_LANES = 4;
+static constexpr size_t HASH_BLOCK_LENGTH = 32;
+// deeper expressions are not cached, so reading a cache file does not recurse deeper
+static constexpr int MAX_CACHED_DEPTH = 1000;
+// symbols that fit are copied to the stack to be terminated
+static constexpr size_t SYMBOL_BUFFER_SIZE = 64;
+
+/* The cache file: the header(CACHE_MAGIC, the length and the characters of the path, the size, the modification time
+ * and the hash of the contents of the file), the expressions, TAG_END and the hash of everything before it.
+ * An expression is its tag followed by: a number(zigzag varint), the bits of a decimal(8 bytes), a boolean(1 byte), the
+ * length and the characters of a symbol or a string(the contents, without escapes), the count and the children of an
+ * S-expression or a Q-expression. The integers are little endian, a varint has 7 bits in every byte.
+ */
+typedef enum {
+    TAG_NUMBER,
+    TAG_DECIMAL,
+    TAG_BOOLEAN,
+    TAG_SYMBOL,
+    TAG_STRING,
+    TAG_SEXPR,
+    TAG_QEXPR,
+    // the reader makes errors only from numbers that are out of range
+    TAG_BAD_NUMERIC_VALUE,
+    TAG_END
+} cache_tag_t;
+
+/* FNV-1a of the 8 byte words of 32 byte blocks, every word of a block is hashed by its own lane so the
+ * multiplications do not wait for each other, the hash is FNV-1a of the lanes and the bytes after the last block */
+typedef struct cache_hash_t {
+    uint64_t lanes[HASH_LANES];
+} cache_hash_t;
+
+typedef struct lisp_cache_t {
+    // the cache file that is read, the expressions are contents[position..end)
+    unsigned char* contents;
+    size_t position;
+    size_t end;
+    bool is_valid;
+    // the new cache file, written to temporary_path and renamed to path when it is committed
+    char* path;
+    char* temporary_path;
+    unsigned char* header;
+    size_t header_length;
+    // the hash of the source at the end of the header is set only after the rest of the header matched
+    bool is_source_hashed;
+    FILE* output;
+    // the hash of the blocks that are written, the bytes of an incomplete block are pending
+    cache_hash_t output_hash;
+    unsigned char pending[HASH_BLOCK_LENGTH];
+    size_t pending_length;
+    bool is_output_failed;
+} lisp_cache_t;
+
+static bool is_cache_enabled = false;
+static char* cache_directory = NULL;
+
+bool lisp_cache_enable(const char* directory) {
+    char* directory_copy = NULL;
+    if (directory != NULL) {
+        directory_copy = malloc(strlen(directory) + 1);
+        if (directory_copy == NULL) {
+            return false;
+        }
+        strcpy(directory_copy, directory);
+    }
+    free(cache_directory);
+    cache_directory = directory_copy;
+    is_cache_enabled = true;
+    return true;
+}
+
+static uint64_t load_u64(const unsigned char* input) {
+    uint64_t value = 0;
+    for (size_t i = 0; i < 8; i++) {
+        value |= (uint64_t) input[i] << (8 * i);
+    }
+    return value;
+}
+
+static uint64_t hash_step(uint64_t hash, uint64_t value) {
+    return (hash ^ value) * 1099511628211ULL;
+}
+
+static void hash_new(cache_hash_t* hash) {
+    for (size_t lane = 0; lane < HASH_LANES; lane++) {
+        hash->lanes[lane] = 14695981039346656037ULL;
+    }
+}
+
+/* Hashes the whole blocks of bytes, the lanes hash the words of a block independently of each other. The words are in
+ * the byte order of the machine, a cache file is valid only on the machine it was written on */
+static size_t hash_blocks(cache_hash_t* hash, const unsigned char* bytes, size_t length) {
+    uint64_t lanes[HASH_LANES];
+    memcpy(lanes, hash->lanes, sizeof(lanes));
+    size_t i = 0;
+    for (; i + HASH_BLOCK_LENGTH <= length; i += HASH_BLOCK_LENGTH) {
+        uint64_t words[HASH_LANES];
+        memcpy(words, bytes + i, sizeof(words));
+        for (size_t lane = 0; lane < HASH_LANES; lane++) {
+            lanes[lane] = hash_step(lanes[lane], words[lane]);
+        }
+    }
+    memcpy(hash->lanes, lanes, sizeof(lanes));
+    return i;
+}
+
+/* @param bytes the bytes after the last whole block */
+static uint64_t hash_finish(cache_hash_t* hash, const unsigned char* bytes, size_t length) {
+    uint64_t result = 14695981039346656037ULL;
+    for (size_t lane = 0; lane < HASH_LANES; lane++) {
+        result = hash_step(result, hash->lanes[lane]);
+    }
+    for (size_t i = 0; i < length; i++) {
+        result = hash_step(result, bytes[i]);
+    }
+    return result;
+}
+
+static uint64_t hash_bytes(const unsigned char* bytes, size_t length) {
+    cache_hash_t hash;
+    hash_new(&hash);
+    size_t blocks_length = hash_blocks(&hash, bytes, length);
+    return hash_finish(&hash, bytes + blocks_length, length - blocks_length);
+}
+
+static size_t put_varint(unsigned char* output, uint64_t value) {
+    size_t length = 0;
+    while (value >= 0x80) {
+        output[length++] = (unsigned char) (value | 0x80);
+        value >>= 7;
+    }
+    output[length++] = (unsigned char) value;
+    return length;
+}
+
+static size_t put_u64(unsigned char* output, uint64_t value) {
+    for (size_t i = 0; i < 8; i++) {
+        output[i] = (unsigned char) (value >> (8 * i));
+    }
+    return 8;
+}
+
+static bool get_varint(lisp_cache_t* cache, size_t* position, uint64_t* value) {
+    *value = 0;
+    for (int shift = 0; shift < 64 && *position < cache->end; shift += 7) {
+        unsigned char byte = cache->contents[(*position)++];
+        *value |= (uint64_t) (byte & 0x7F) << shift;
+        if (byte < 0x80) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool get_u64(lisp_cache_t* cache, size_t* position, uint64_t* value) {
+    if (cache->end - *position < 8) {
+        return false;
+    }
+    *value = load_u64(cache->contents + *position);
+    *position += 8;
+    return true;
+}
+
+/* The file next to the source(file.cache), or the hash of the path in the cache directory */
+static char* get_cache_path(const char* filename) {
+    char* path = NULL;
+    if (cache_directory == NULL) {
+        path = malloc(strlen(filename) + strlen(CACHE_FILE_EXTENSION) + 1);
+        if (path != NULL) {
+            sprintf(path, "%s%s", filename, CACHE_FILE_EXTENSION);
+        }
+        return path;
+    }
+    unsigned long long path_hash = hash_bytes((const unsigned char*) filename, strlen(filename));
+    int length = snprintf(NULL, 0, "%s/%016llx%s", cache_directory, path_hash, CACHE_FILE_EXTENSION);
+    path = malloc(length + 1);
+    if (path != NULL) {
+        sprintf(path, "%s/%016llx%s", cache_directory, path_hash, CACHE_FILE_EXTENSION);
+    }
+    return path;
+}
+
+/* The hash of the source at the end of the header is zero, see set_source_hash */
+static unsigned char* make_header(const char* filename, size_t length, long long modification_time, size_t* header_length) {
+    size_t filename_length = strlen(filename);
+    unsigned char* header = malloc(CACHE_MAGIC_LENGTH + MAX_VARINT_LENGTH + filename_length + 3 * 8);
+    if (header == NULL) {
+        return NULL;
+    }
+    size_t position = 0;
+    memcpy(header, CACHE_MAGIC, CACHE_MAGIC_LENGTH);
+    position += CACHE_MAGIC_LENGTH;
+    position += put_varint(header + position, filename_length);
+    memcpy(header + position, filename, filename_length);
+    position += filename_length;
+    position += put_u64(header + position, length);
+    position += put_u64(header + position, (uint64_t) modification_time);
+    position += put_u64(header + position, 0);
+    *header_length = position;
+    return header;
+}
+
+/* Checks that the expressions of the cache file are complete, so they can be read without checks */
+static bool skip_value(lisp_cache_t* cache, size_t* position, int depth) {
+    if (depth > MAX_CACHED_DEPTH || *position >= cache->end) {
+        return false;
+    }
+    uint64_t value = 0;
+    switch (cache->contents[(*position)++]) {
+        case TAG_NUMBER:
+            return get_varint(cache, position, &value);
+        case TAG_DECIMAL:
+            return get_u64(cache, position, &value);
+        case TAG_BOOLEAN:
+            if (*position == cache->end) {
+                return false;
+            }
+            (*position)++;
+            return true;
+        case TAG_SYMBOL:
+        case TAG_STRING:
+            if (!get_varint(cache, position, &value) || value > cache->end - *position) {
+                return false;
+            }
+            *position += value;
+            return true;
+        case TAG_SEXPR:
+        case TAG_QEXPR:
+            if (!get_varint(cache, position, &value)) {
+                return false;
+            }
+            for (uint64_t i = 0; i < value; i++) {
+                if (!skip_value(cache, position, depth + 1)) {
+                    return false;
+                }
+            }
+            return true;
+        case TAG_BAD_NUMERIC_VALUE:
+            return true;
+        default:
+            return false;
+    }
+}
+
+static void set_source_hash(lisp_cache_t* cache, const char* source, size_t length) {
+    put_u64(cache->header + cache->header_length - HASH_LENGTH, hash_bytes((const unsigned char*) source, length));
+    cache->is_source_hashed = true;
+}
+
+/* Reads the cache file, it is valid if it has the header of the source, it is complete and its hash matches
+ * The source is hashed only when the path, the size and the modification time in the header match */
+static bool read_cache_file(lisp_cache_t* cache, const char* source, size_t source_length) {
+    FILE* file = fopen(cache->path, "rb");
+    if (file == NULL) {
+        return false;
+    }
+    long length = -1;
+    if (fseek(file, 0, SEEK_END) == 0) {
+        length = ftell(file);
+    }
+    if (length < (long) (cache->header_length + 1 + HASH_LENGTH) || fseek(file, 0, SEEK_SET) != 0) {
+        fclose(file);
+        return false;
+    }
+    cache->contents = malloc(length);
+    size_t hash_position = cache->header_length - HASH_LENGTH;
+    bool ok = cache->contents != NULL
+        && fread(cache->contents, 1, cache->header_length, file) == cache->header_length
+        && memcmp(cache->contents, cache->header, hash_position) == 0;
+    if (ok) {
+        set_source_hash(cache, source, source_length);
+        ok = memcmp(cache->contents + hash_position, cache->header + hash_position, HASH_LENGTH) == 0
+            && fread(cache->contents + cache->header_length, 1, length - cache->header_length, file) == length - cache->header_length;
+    }
+    fclose(file);
+    if (!ok) {
+        return false;
+    }
+
+    cache->end = length - HASH_LENGTH;
+    if (hash_bytes(cache->contents, cache->end) != load_u64(cache->contents + cache->end)) {
+        return false;
+    }
+    size_t position = cache->header_length;
+    while (position < cache->end && cache->contents[position] != TAG_END) {
+        if (!skip_value(cache, &position, 0)) {
+            return false;
+        }
+    }
+    if (position + 1 != cache->end) {
+        return false;
+    }
+    cache->position = cache->header_length;
+    return true;
+}
+
+static void write_bytes(lisp_cache_t* cache, const void* bytes, size_t length) {
+    if (fwrite(bytes, 1, length, cache->output) != length) {
+        cache->is_output_failed = true;
+    }
+    const unsigned char* input = bytes;
+    while (length > 0) {
+        if (cache->pending_length == 0 && length >= HASH_BLOCK_LENGTH) {
+            size_t blocks_length = hash_blocks(&cache->output_hash, input, length);
+            input += blocks_length;
+            length -= blocks_length;
+            continue;
+        }
+        size_t free_length = HASH_BLOCK_LENGTH - cache->pending_length;
+        size_t count = free_length < length ? free_length : length;
+        memcpy(cache->pending + cache->pending_length, input, count);
+        cache->pending_length += count;
+        input += count;
+        length -= count;
+        if (cache->pending_length == HASH_BLOCK_LENGTH) {
+            hash_blocks(&cache->output_hash, cache->pending, HASH_BLOCK_LENGTH);
+            cache->pending_length = 0;
+        }
+    }
+}
+
+static void write_byte(lisp_cache_t* cache, unsigned char byte) {
+    write_bytes(cache, &byte, 1);
+}
+
+static void write_varint(lisp_cache_t* cache, uint64_t value) {
+    unsigned char buffer[MAX_VARINT_LENGTH];
+    write_bytes(cache, buffer, put_varint(buffer, value));
+}
+
+static void write_u64(lisp_cache_t* cache, uint64_t value) {
+    unsigned char buffer[8];
+    write_bytes(cache, buffer, put_u64(buffer, value));
+}
+
+/* @return false if the value can not be cached */
+static bool write_value(lisp_cache_t* cache, lisp_value_t* value, int depth) {
+    if (depth > MAX_CACHED_DEPTH) {
+        return false;
+    }
+    switch (value->value_type) {
+        case VAL_NUMBER: {
+            long long number = value->value_number;
+            write_byte(cache, TAG_NUMBER);
+            write_varint(cache, ((uint64_t) number << 1) ^ (uint64_t) (number >> 63));
+            return true;
+        }
+        case VAL_DECIMAL: {
+            uint64_t bits = 0;
+            memcpy(&bits, &value->value_decimal, sizeof(bits));
+            write_byte(cache, TAG_DECIMAL);
+            write_u64(cache, bits);
+            return true;
+        }
+        case VAL_BOOLEAN:
+            write_byte(cache, TAG_BOOLEAN);
+            write_byte(cache, value->value_number != 0);
+            return true;
+        case VAL_SYMBOL:
+        case VAL_STRING: {
+            char* string = value->value_type == VAL_SYMBOL ? value->value_symbol : value->value_string;
+            size_t length = strlen(string);
+            write_byte(cache, value->value_type == VAL_SYMBOL ? TAG_SYMBOL : TAG_STRING);
+            write_varint(cache, length);
+            write_bytes(cache, string, length);
+            return true;
+        }
+        case VAL_SEXPR:
+        case VAL_QEXPR:
+            write_byte(cache, value->value_type == VAL_SEXPR ? TAG_SEXPR : TAG_QEXPR);
+            write_varint(cache, value->count);
+            for (long i = 0; i < value->count; i++) {
+                if (!write_value(cache, value->values[i], depth + 1)) {
+                    return false;
+                }
+            }
+            return true;
+        case VAL_ERR:
+            write_byte(cache, TAG_BAD_NUMERIC_VALUE);
+            return true;
+        case VAL_ROOT:
+        case VAL_BUILTIN_FUN:
+        case VAL_USERDEFINED_FUN:
+            return false;
+    }
+    return false;
+}
+
+static void open_output(lisp_cache_t* cache) {
+#if defined(_UNIX_STYLE_OS)
+    cache->temporary_path = malloc(strlen(cache->path) + strlen(TEMPORARY_FILE_TEMPLATE) + 1);
+    if (cache->temporary_path == NULL) {
+        return;
+    }
+    sprintf(cache->temporary_path, "%s%s", cache->path, TEMPORARY_FILE_TEMPLATE);
+    // a unique file, so loads of the same file that run at the same time do not write to the same temporary file
+    int descriptor = mkstemp(cache->temporary_path);
+    if (descriptor == -1) {
+        return;
+    }
+    // mkstemp makes the file readable only by its owner
+    fchmod(descriptor, 0644);
+    cache->output = fdopen(descriptor, "wb");
+    if (cache->output == NULL) {
+        close(descriptor);
+        remove(cache->temporary_path);
+        return;
+    }
+#else
+    // the reader uses the cache only on unix-style os
+    return;
+#endif
+    hash_new(&cache->output_hash);
+    write_bytes(cache, cache->header, cache->header_length);
+}
+
+lisp_cache_t* lisp_cache_open(const char* filename, const char* source, size_t length, long long modification_time) {
+    if (!is_cache_enabled) {
+        return NULL;
+    }
+    lisp_cache_t* cache = calloc(1, sizeof(lisp_cache_t));
+    if (cache == NULL) {
+        return NULL;
+    }
+    cache->path = get_cache_path(filename);
+    cache->header = make_header(filename, length, modification_time, &cache->header_length);
+    if (cache->path == NULL || cache->header == NULL) {
+        lisp_cache_delete(cache);
+        return NULL;
+    }
+    cache->is_valid = read_cache_file(cache, source, length);
+    if (!cache->is_valid) {
+        free(cache->contents);
+        cache->contents = NULL;
+        if (!cache->is_source_hashed) {
+            set_source_hash(cache, source, length);
+        }
+        open_output(cache);
+    }
+    return cache;
+}
+
+bool lisp_cache_is_valid(lisp_cache_t* cache) {
+    return cache->is_valid;
+}
+
+static lisp_value_t* make_symbol(const unsigned char* characters, size_t length) {
+    char buffer[SYMBOL_BUFFER_SIZE];
+    char* symbol = length < SYMBOL_BUFFER_SIZE ? buffer : malloc(length + 1);
+    if (symbol == NULL) {
+        return get_null_lisp_value();
+    }
+    memcpy(symbol, characters, length);
+    symbol[length] = '\0';
+    lisp_value_t* value = lisp_value_symbol_new(symbol);
+    if (symbol != buffer) {
+        free(symbol);
+    }
+    return value;
+}
+
+/* Reads an expression that skip_value checked */
+static lisp_value_t* read_value(lisp_cache_t* cache) {
+    unsigned char tag = cache->contents[cache->position++];
+    uint64_t value = 0;
+    switch (tag) {
+        case TAG_NUMBER:
+            get_varint(cache, &cache->position, &value);
+            return lisp_value_number_new((long) ((long long) (value >> 1) ^ -(long long) (value & 1)));
+        case TAG_DECIMAL: {
+            double decimal = 0;
+            get_u64(cache, &cache->position, &value);
+            memcpy(&decimal, &value, sizeof(decimal));
+            return lisp_value_decimal_new(decimal);
+        }
+        case TAG_BOOLEAN:
+            return lisp_value_boolean_new(cache->contents[cache->position++]);
+        case TAG_SYMBOL:
+        case TAG_STRING: {
+            get_varint(cache, &cache->position, &value);
+            const unsigned char* characters = cache->contents + cache->position;
+            cache->position += value;
+            if (tag == TAG_SYMBOL) {
+                return make_symbol(characters, value);
+            }
+            return lisp_value_string_contents_new((const char*) characters, value);
+        }
+        case TAG_SEXPR:
+        case TAG_QEXPR: {
+            get_varint(cache, &cache->position, &value);
+            lisp_value_t* expression = tag == TAG_SEXPR ? lisp_value_sexpr_new() : lisp_value_qexpr_new();
+            if (is_lisp_value_null(expression)) {
+                return expression;
+            }
+            for (uint64_t i = 0; i < value; i++) {
+                lisp_value_t* child = read_value(cache);
+                if (is_lisp_value_null(child) || !append_lisp_value(expression, child)) {
+                    lisp_value_delete(child);
+                    lisp_value_delete(expression);
+                    return get_null_lisp_value();
+                }
+            }
+            return expression;
+        }
+        case TAG_BAD_NUMERIC_VALUE:
+            return get_lisp_value_error_bad_numeric_value();
+    }
+    return get_null_lisp_value();
+}
+
+lisp_value_t* lisp_cache_next(lisp_cache_t* cache) {
+    if (!cache->is_valid || cache->contents[cache->position] == TAG_END) {
+        return NULL;
+    }
+    return read_value(cache);
+}
+
+void lisp_cache_add(lisp_cache_t* cache, lisp_value_t* expression) {
+    if (cache->output == NULL || cache->is_output_failed) {
+        return;
+    }
+    if (!write_value(cache, expression, 0)) {
+        cache->is_output_failed = true;
+    }
+}
+
+void lisp_cache_commit(lisp_cache_t* cache) {
+    if (cache->output == NULL) {
+        return;
+    }
+    write_byte(cache, TAG_END);
+    unsigned char hash[HASH_LENGTH];
+    put_u64(hash, hash_finish(&cache->output_hash, cache->pending, cache->pending_length));
+    bool ok = !cache->is_output_failed && fwrite(hash, 1, HASH_LENGTH, cache->output) == HASH_LENGTH;
+    ok = fclose(cache->output) == 0 && ok;
+    cache->output = NULL;
+    // rename does not replace an existing file on windows
+    if (!ok || (rename(cache->temporary_path, cache->path) != 0
+                && (remove(cache->path) != 0 || rename(cache->temporary_path, cache->path) != 0))) {
+        remove(cache->temporary_path);
+    }
+}
+
+void lisp_cache_delete(lisp_cache_t* cache) {
+    if (cache->output != NULL) {
+        fclose(cache->output);
+        remove(cache->temporary_path);
+    }
+    free(cache->contents);
+    free(cache->header);
+    free(cache->temporary_path);
+    free(cache->path);
+    free(cache);
+}
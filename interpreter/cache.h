@@ -0,0 +1,49 @@
+#pragma once
+
+#include <stddef.h>
+
+#include "interpreter.h"
+
+/* The parse cache, the expressions of a file that is read are stored in a binary form, so the next read of the file
+ * reads them from the cache file instead of reading the source.
+ * A cache file is valid for the path, the size, the modification time and the hash(FNV-1a) of the contents of the file
+ * it was written for, the contents are hashed only when the others match. The cache file ends with the hash of its own
+ * contents, so a cache file that is written partially is not used. A file with a syntax error is not cached.
+ * The cache is used only when it is enabled, the reader uses it for the files it maps(see lisp_reader_new_file).
+ */
+
+typedef struct lisp_cache_t lisp_cache_t;
+
+/**
+ * Enables the cache for the files that are read after the call
+ * @param directory the directory of the cache files, NULL to write the cache file of file next to it(file.cache)
+ * @return false if out of memory
+ */
+bool lisp_cache_enable(const char* directory);
+/**
+ * Opens the cache of a file
+ * @param source length characters, the contents of the file
+ * @return NULL if the cache is not enabled or out of memory
+ */
+lisp_cache_t* lisp_cache_open(const char* filename, const char* source, size_t length, long long modification_time);
+/**
+ * @return true if the expressions are read from the cache(lisp_cache_next), otherwise the expressions that are read
+ * from the source are written to a new cache file(lisp_cache_add)
+ */
+bool lisp_cache_is_valid(lisp_cache_t* cache);
+/**
+ * @return the next expression, NULL after the last one, null lisp value if out of memory
+ */
+lisp_value_t* lisp_cache_next(lisp_cache_t* cache);
+/**
+ * Writes the next expression of the source to the new cache file, the expression is not consumed
+ */
+void lisp_cache_add(lisp_cache_t* cache, lisp_value_t* expression);
+/**
+ * Replaces the cache file of the file with the new one, after the last expression of the source is added
+ */
+void lisp_cache_commit(lisp_cache_t* cache);
+/**
+ * A new cache file that is not committed is removed
+ */
+void lisp_cache_delete(lisp_cache_t* cache);
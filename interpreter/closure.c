@@ -0,0 +1,200 @@
+#include "closure.h"
+#include "symbol.h"
+
+#include <stdlib.h>
+
+static char* BUILTIN_IF = "if";
+
+static bool is_evaluation_aborted_by(lisp_value_t* value) {
+    return is_lisp_value_null(value) || (is_lisp_value_error(value) && value->is_error_user_defined_value == 0);
+}
+
+/* Same as the other evaluations, the error is recreated in every enclosing s-expression */
+static lisp_value_t* abort_evaluation(lisp_value_t* value) {
+    if (is_lisp_value_null(value)) {
+        return value;
+    }
+    lisp_value_t* error = lisp_value_error_new(value->error_message);
+    lisp_value_delete(value);
+    return error;
+}
+
+static lisp_value_t* evaluate_constant(lisp_closure_t* closure, [[maybe_unused]] lisp_environment_t* env,
+    [[maybe_unused]] lisp_tail_call_t* tail_call) {
+    return lisp_value_share(closure->value);
+}
+
+static lisp_value_t* evaluate_symbol(lisp_closure_t* closure, lisp_environment_t* env, [[maybe_unused]] lisp_tail_call_t* tail_call) {
+    return lisp_environment_get(env, closure->value);
+}
+
+static lisp_value_t* evaluate_empty(lisp_closure_t* closure, lisp_environment_t* env, lisp_tail_call_t* tail_call) {
+    return evaluate_expression(env, closure->value, tail_call);
+}
+
+static lisp_value_t* evaluate_call(lisp_closure_t* closure, lisp_environment_t* env, lisp_tail_call_t* tail_call) {
+    lisp_value_t* arguments = lisp_value_sexpr_new();
+    if (is_lisp_value_null(arguments)) {
+        return arguments;
+    }
+    for (size_t i = 0; i < closure->count; i++) {
+        lisp_closure_t* child = closure->children[i];
+        lisp_value_t* value = child->evaluate(child, env, NULL);
+        if (is_evaluation_aborted_by(value)) {
+            lisp_value_delete(arguments);
+            return abort_evaluation(value);
+        }
+        if (!append_lisp_value(arguments, value)) {
+            lisp_value_delete(value);
+            lisp_value_delete(arguments);
+            return get_null_lisp_value();
+        }
+    }
+    return call_function_or_builtin_operation_in_tail_position(env, arguments, tail_call);
+}
+
+/* (if condition {true branch} {false branch}), children are the operator, the condition and the compiled branches,
+ * the value is the s-expression, its literal branches are used when if is called as a function */
+static lisp_value_t* evaluate_if(lisp_closure_t* closure, lisp_environment_t* env, lisp_tail_call_t* tail_call) {
+    lisp_value_t* if_value = closure->children[0]->evaluate(closure->children[0], env, NULL);
+    if (is_evaluation_aborted_by(if_value)) {
+        return abort_evaluation(if_value);
+    }
+    lisp_value_t* condition = closure->children[1]->evaluate(closure->children[1], env, NULL);
+    if (is_evaluation_aborted_by(condition)) {
+        lisp_value_delete(if_value);
+        return abort_evaluation(condition);
+    }
+
+    bool is_builtin_if = if_value->value_type == VAL_BUILTIN_FUN && if_value->value_builtin_fun == builtin_fun_if;
+    if (is_builtin_if && (condition->value_type == VAL_NUMBER || condition->value_type == VAL_BOOLEAN)) {
+        lisp_closure_t* branch = condition->value_number != 0 ? closure->children[2] : closure->children[3];
+        lisp_value_delete(if_value);
+        lisp_value_delete(condition);
+        return branch->evaluate(branch, env, tail_call);
+    }
+
+    // the symbol if is not bound to the builtin if, or the condition is invalid, if is called as a function
+    lisp_value_t* arguments = lisp_value_sexpr_new();
+    bool ok = !is_lisp_value_null(arguments)
+        && append_lisp_value(arguments, if_value)
+        && append_lisp_value(arguments, condition)
+        && append_lisp_value(arguments, lisp_value_share(closure->value->values[2]))
+        && append_lisp_value(arguments, lisp_value_share(closure->value->values[3]));
+    if (!ok) {
+        lisp_value_delete(arguments);
+        return get_null_lisp_value();
+    }
+    return call_function_or_builtin_operation_in_tail_position(env, arguments, tail_call);
+}
+
+static lisp_closure_t* closure_new(lisp_closure_fun_t evaluate, lisp_value_t* value, size_t count) {
+    lisp_closure_t* closure = malloc(sizeof(lisp_closure_t));
+    if (closure == NULL) {
+        return NULL;
+    }
+    closure->children = count > 0 ? calloc(count, sizeof(lisp_closure_t*)) : NULL;
+    if (count > 0 && closure->children == NULL) {
+        free(closure);
+        return NULL;
+    }
+    closure->evaluate = evaluate;
+    closure->reference_count = 1;
+    closure->value = value == NULL ? NULL : lisp_value_share(value);
+    closure->count = count;
+    return closure;
+}
+
+static lisp_closure_t* compile_expression(lisp_value_t* expression, char* if_symbol);
+
+static lisp_closure_t* compile_value(lisp_value_t* value, char* if_symbol) {
+    if (value->value_type == VAL_SYMBOL) {
+        return closure_new(evaluate_symbol, value, 0);
+    }
+    if (value->value_type == VAL_SEXPR) {
+        return compile_expression(value, if_symbol);
+    }
+    return closure_new(evaluate_constant, value, 0);
+}
+
+static bool is_inlinable_if(lisp_value_t* expression, char* if_symbol) {
+    return expression->count == 4
+        && expression->values[0]->value_type == VAL_SYMBOL
+        && expression->values[0]->value_symbol == if_symbol
+        && expression->values[2]->value_type == VAL_QEXPR
+        && expression->values[3]->value_type == VAL_QEXPR;
+}
+
+/* Compiles the evaluation of the children of expression as a s-expression */
+static lisp_closure_t* compile_expression(lisp_value_t* expression, char* if_symbol) {
+    if (expression->count == 0) {
+        return closure_new(evaluate_empty, expression, 0);
+    }
+    if (expression->count == 1) {
+        // the value of the s-expression is the value of the only child
+        return compile_value(expression->values[0], if_symbol);
+    }
+
+    lisp_closure_t* closure = NULL;
+    bool ok = true;
+    if (is_inlinable_if(expression, if_symbol)) {
+        closure = closure_new(evaluate_if, expression, 4);
+        ok = closure != NULL
+            && (closure->children[0] = compile_value(expression->values[0], if_symbol)) != NULL
+            && (closure->children[1] = compile_value(expression->values[1], if_symbol)) != NULL
+            && (closure->children[2] = compile_expression(expression->values[2], if_symbol)) != NULL
+            && (closure->children[3] = compile_expression(expression->values[3], if_symbol)) != NULL;
+    } else {
+        closure = closure_new(evaluate_call, NULL, expression->count);
+        ok = closure != NULL;
+        for (long i = 0; ok && i < expression->count; i++) {
+            closure->children[i] = compile_value(expression->values[i], if_symbol);
+            ok = closure->children[i] != NULL;
+        }
+    }
+    if (!ok) {
+        lisp_closure_delete(closure);
+        return NULL;
+    }
+    return closure;
+}
+
+lisp_closure_t* lisp_closure_compile(lisp_value_t* value) {
+    char* if_symbol = lisp_symbol_intern(BUILTIN_IF);
+    if (if_symbol == NULL) {
+        return NULL;
+    }
+    if (value->value_type == VAL_ROOT || value->value_type == VAL_QEXPR) {
+        return compile_expression(value, if_symbol);
+    }
+    return compile_value(value, if_symbol);
+}
+
+lisp_closure_t* lisp_closure_share(lisp_closure_t* closure) {
+    if (closure != NULL) {
+        closure->reference_count++;
+    }
+    return closure;
+}
+
+void lisp_closure_delete(lisp_closure_t* closure) {
+    if (closure == NULL) {
+        return;
+    }
+    closure->reference_count--;
+    if (closure->reference_count > 0) {
+        return;
+    }
+    for (size_t i = 0; i < closure->count; i++) {
+        lisp_closure_delete(closure->children[i]);
+    }
+    if (closure->value != NULL) {
+        lisp_value_delete(closure->value);
+    }
+    free(closure->children);
+    free(closure);
+}
+
+lisp_value_t* lisp_closure_evaluate(lisp_closure_t* closure, lisp_environment_t* env, lisp_tail_call_t* tail_call) {
+    return closure->evaluate(closure, env, tail_call);
+}
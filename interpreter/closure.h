@@ -0,0 +1,39 @@
+#pragma once
+
+#include "interpreter.h"
+
+/* The closure compiler, the evaluation of the closure engine
+ * An expression is compiled once to a tree of nodes, every node has a pointer to the function that evaluates it:
+ * a constant, a symbol lookup, a call with the number of arguments known, or an if with its branches compiled.
+ * Evaluating a node calls the functions of its children directly, the type of the code is not checked again.
+ * The bodies of user defined functions are compiled on the first call, the tree is kept with the function.
+ * Symbols are looked up at runtime(scoping is dynamic, a builtin can be shadowed by an argument), the lookup uses
+ * the slot hints of the symbols(see lisp_environment_get_borrowed).
+ */
+
+typedef struct lisp_closure_t lisp_closure_t;
+typedef lisp_value_t* (*lisp_closure_fun_t)(lisp_closure_t* closure, lisp_environment_t* env, lisp_tail_call_t* tail_call);
+
+typedef struct lisp_closure_t {
+    lisp_closure_fun_t evaluate;
+    // only the root of a tree is shared
+    long reference_count;
+    // the constant, the symbol, or the compiled expression
+    lisp_value_t* value;
+    lisp_closure_t** children;
+    size_t count;
+} lisp_closure_t;
+
+/**
+ * @param value the value is shared with the closure, a root or a q-expression(the body of a function) is compiled as
+ * a s-expression
+ * @return compiled value, NULL if out of memory
+ */
+lisp_closure_t* lisp_closure_compile(lisp_value_t* value);
+lisp_closure_t* lisp_closure_share(lisp_closure_t* closure);
+void lisp_closure_delete(lisp_closure_t* closure);
+/**
+ * @param tail_call NULL, or where the call in tail position is returned(see call_function_or_builtin_operation_in_tail_position)
+ * @return the value of the expression evaluated in env, owned by the caller
+ */
+lisp_value_t* lisp_closure_evaluate(lisp_closure_t* closure, lisp_environment_t* env, lisp_tail_call_t* tail_call);
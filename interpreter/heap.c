@@ -0,0 +1,461 @@
+#include "heap.h"
+
+#include <stdalign.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Every kind of node(and every size class of pointer arrays) is allocated from its own pool
+ * A pool allocates chunks of elements, a freed element is put on the free list of the pool and reused by the next
+ * allocation, so allocating and freeing is popping and pushing the free list.
+ * The pools are thread local, values must be freed by the thread that allocated them.
+ */
+
+typedef struct lisp_heap_chunk_t {
+    struct lisp_heap_chunk_t* next;
+    size_t size;
+    size_t free_count;
+    alignas(max_align_t) unsigned char elements[];
+} lisp_heap_chunk_t;
+
+typedef struct lisp_heap_free_element_t {
+    struct lisp_heap_free_element_t* next;
+} lisp_heap_free_element_t;
+
+typedef struct lisp_heap_pool_t {
+    size_t element_size;
+    lisp_heap_chunk_t* chunks;
+    lisp_heap_free_element_t* free_list;
+    size_t next_chunk_size;
+    /* free elements that survived the last trim(in chunks that still have live elements) are not counted
+     * towards the next trim, otherwise every allocation would trigger a trim that can not release anything */
+    size_t free_after_last_trim;
+    lisp_heap_stats_t stats;
+} lisp_heap_pool_t;
+
+/* the pointer arrays store their capacity in front of the pointers, and the owners and the length of a shared array */
+typedef struct lisp_heap_array_header_t {
+    size_t capacity;
+    // 0 while the array was never shared
+    size_t owners;
+    size_t length;
+} lisp_heap_array_header_t;
+
+static constexpr size_t ARRAY_SIZE_CLASSES_COUNT = 4;
+static constexpr size_t SMALLEST_ARRAY_SIZE_CLASS = 4;
+static constexpr size_t LARGEST_ARRAY_SIZE_CLASS = SMALLEST_ARRAY_SIZE_CLASS << (ARRAY_SIZE_CLASSES_COUNT - 1);
+
+static lisp_heap_settings_t heap_settings = {
+    .initial_chunk_size = 256,
+    .max_chunk_size = 65536,
+    .growth_factor = 2.0,
+    .trim_free_ratio = 4.0,
+    .trim_min_free = 65536,
+    .evaluation_stack_budget = 64 * 1024 * 1024
+};
+
+static thread_local lisp_heap_pool_t value_pool = {.element_size = sizeof(lisp_value_t)};
+static thread_local lisp_heap_pool_t environment_pool = {.element_size = sizeof(lisp_environment_t)};
+static thread_local lisp_heap_pool_t userdefined_fun_pool = {.element_size = sizeof(lisp_value_userdefined_fun_t)};
+static thread_local lisp_heap_pool_t array_pools[ARRAY_SIZE_CLASSES_COUNT] = {
+    {.element_size = sizeof(lisp_heap_array_header_t) + sizeof(void*) * (SMALLEST_ARRAY_SIZE_CLASS << 0)},
+    {.element_size = sizeof(lisp_heap_array_header_t) + sizeof(void*) * (SMALLEST_ARRAY_SIZE_CLASS << 1)},
+    {.element_size = sizeof(lisp_heap_array_header_t) + sizeof(void*) * (SMALLEST_ARRAY_SIZE_CLASS << 2)},
+    {.element_size = sizeof(lisp_heap_array_header_t) + sizeof(void*) * (SMALLEST_ARRAY_SIZE_CLASS << 3)},
+};
+
+static void read_size_setting(const char* name, size_t* setting) {
+    char* value = getenv(name);
+    if (value == NULL) {
+        return;
+    }
+    char* end = NULL;
+    unsigned long parsed = strtoul(value, &end, 10);
+    if (end != value && parsed > 0) {
+        *setting = parsed;
+    }
+}
+
+static void read_ratio_setting(const char* name, double* setting) {
+    char* value = getenv(name);
+    if (value == NULL) {
+        return;
+    }
+    char* end = NULL;
+    double parsed = strtod(value, &end);
+    if (end != value && parsed > 0) {
+        *setting = parsed;
+    }
+}
+
+void lisp_heap_configure_from_environment_variables() {
+    lisp_heap_settings_t settings = heap_settings;
+    read_size_setting("MY_OWN_LISP_HEAP_INITIAL_CHUNK_SIZE", &settings.initial_chunk_size);
+    read_size_setting("MY_OWN_LISP_HEAP_MAX_CHUNK_SIZE", &settings.max_chunk_size);
+    read_ratio_setting("MY_OWN_LISP_HEAP_GROWTH_FACTOR", &settings.growth_factor);
+    read_ratio_setting("MY_OWN_LISP_HEAP_TRIM_FREE_RATIO", &settings.trim_free_ratio);
+    read_size_setting("MY_OWN_LISP_HEAP_TRIM_MIN_FREE", &settings.trim_min_free);
+    read_size_setting("MY_OWN_LISP_HEAP_EVALUATION_STACK_BUDGET", &settings.evaluation_stack_budget);
+    lisp_heap_configure(settings);
+}
+
+void lisp_heap_configure(lisp_heap_settings_t settings) {
+    if (settings.max_chunk_size < settings.initial_chunk_size) {
+        settings.max_chunk_size = settings.initial_chunk_size;
+    }
+    if (settings.growth_factor < 1) {
+        settings.growth_factor = 1;
+    }
+    heap_settings = settings;
+}
+
+lisp_heap_settings_t lisp_heap_get_settings() {
+    return heap_settings;
+}
+
+static void pool_push_free_element(lisp_heap_pool_t* pool, void* element) {
+    lisp_heap_free_element_t* free_element = element;
+    free_element->next = pool->free_list;
+    pool->free_list = free_element;
+    pool->stats.free++;
+}
+
+static bool pool_grow(lisp_heap_pool_t* pool) {
+    if (pool->next_chunk_size == 0) {
+        pool->next_chunk_size = heap_settings.initial_chunk_size;
+    }
+
+    lisp_heap_chunk_t* chunk = malloc(sizeof(lisp_heap_chunk_t) + pool->element_size * pool->next_chunk_size);
+    if (chunk == NULL) {
+        return false;
+    }
+    chunk->size = pool->next_chunk_size;
+    chunk->next = pool->chunks;
+    pool->chunks = chunk;
+    pool->stats.chunks++;
+
+    // pushed in reverse so that the elements are handed out in address order
+    for (size_t i = chunk->size; i > 0; i--) {
+        pool_push_free_element(pool, chunk->elements + (i - 1) * pool->element_size);
+    }
+
+    size_t grown_chunk_size = (size_t) ((double) pool->next_chunk_size * heap_settings.growth_factor);
+    pool->next_chunk_size = grown_chunk_size < heap_settings.max_chunk_size ? grown_chunk_size : heap_settings.max_chunk_size;
+    return true;
+}
+
+static int compare_chunk_addresses(const void* first, const void* second) {
+    uintptr_t first_address = (uintptr_t) *(lisp_heap_chunk_t* const*) first;
+    uintptr_t second_address = (uintptr_t) *(lisp_heap_chunk_t* const*) second;
+    return (first_address > second_address) - (first_address < second_address);
+}
+
+static lisp_heap_chunk_t* find_chunk(lisp_heap_chunk_t** sorted_chunks, size_t count, size_t element_size, void* element) {
+    size_t low = 0;
+    size_t high = count;
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        lisp_heap_chunk_t* chunk = sorted_chunks[middle];
+        unsigned char* start = chunk->elements;
+        unsigned char* end = start + chunk->size * element_size;
+        if ((unsigned char*) element < start) {
+            high = middle;
+        } else if ((unsigned char*) element >= end) {
+            low = middle + 1;
+        } else {
+            return chunk;
+        }
+    }
+    return NULL;
+}
+
+/* Counts the free elements of every chunk by walking the free list, the chunks that contain only free elements are
+ * released and the free list is rebuilt from the free elements of the remaining chunks */
+static void pool_trim(lisp_heap_pool_t* pool) {
+    pool->stats.trims++;
+    size_t chunks_count = pool->stats.chunks;
+    lisp_heap_chunk_t** sorted_chunks = malloc(sizeof(lisp_heap_chunk_t*) * chunks_count);
+    if (sorted_chunks == NULL) {
+        return;
+    }
+    size_t i = 0;
+    for (lisp_heap_chunk_t* chunk = pool->chunks; chunk != NULL; chunk = chunk->next) {
+        chunk->free_count = 0;
+        sorted_chunks[i++] = chunk;
+    }
+    qsort(sorted_chunks, chunks_count, sizeof(lisp_heap_chunk_t*), compare_chunk_addresses);
+
+    for (lisp_heap_free_element_t* element = pool->free_list; element != NULL; element = element->next) {
+        find_chunk(sorted_chunks, chunks_count, pool->element_size, element)->free_count++;
+    }
+
+    lisp_heap_free_element_t* free_list = pool->free_list;
+    pool->free_list = NULL;
+    pool->stats.free = 0;
+    while (free_list != NULL) {
+        lisp_heap_free_element_t* next = free_list->next;
+        lisp_heap_chunk_t* chunk = find_chunk(sorted_chunks, chunks_count, pool->element_size, free_list);
+        if (chunk->free_count != chunk->size) {
+            pool_push_free_element(pool, free_list);
+        }
+        free_list = next;
+    }
+    free(sorted_chunks);
+
+    lisp_heap_chunk_t** link = &pool->chunks;
+    while (*link != NULL) {
+        lisp_heap_chunk_t* chunk = *link;
+        if (chunk->free_count == chunk->size) {
+            *link = chunk->next;
+            free(chunk);
+            pool->stats.chunks--;
+            pool->stats.released_chunks++;
+        } else {
+            link = &chunk->next;
+        }
+    }
+
+    // start growing again from the initial size since the pool got smaller
+    pool->next_chunk_size = 0;
+    pool->free_after_last_trim = pool->stats.free;
+}
+
+static bool pool_should_trim(lisp_heap_pool_t* pool) {
+    size_t free_since_last_trim = pool->stats.free > pool->free_after_last_trim
+        ? pool->stats.free - pool->free_after_last_trim
+        : 0;
+    return free_since_last_trim > heap_settings.trim_min_free
+        && (double) pool->stats.free > (double) pool->stats.live * heap_settings.trim_free_ratio;
+}
+
+static void* pool_allocate(lisp_heap_pool_t* pool) {
+    if (pool_should_trim(pool)) {
+        pool_trim(pool);
+    }
+    if (pool->free_list == NULL && !pool_grow(pool)) {
+        return NULL;
+    }
+
+    lisp_heap_free_element_t* element = pool->free_list;
+    pool->free_list = element->next;
+    pool->stats.free--;
+    pool->stats.live++;
+    pool->stats.allocations++;
+    if (pool->stats.live > pool->stats.peak_live) {
+        pool->stats.peak_live = pool->stats.live;
+    }
+    return element;
+}
+
+static void pool_free(lisp_heap_pool_t* pool, void* element) {
+    pool_push_free_element(pool, element);
+    pool->stats.live--;
+}
+
+lisp_value_t* lisp_heap_allocate_value() {
+    return pool_allocate(&value_pool);
+}
+
+void lisp_heap_free_value(lisp_value_t* value) {
+    pool_free(&value_pool, value);
+}
+
+lisp_environment_t* lisp_heap_allocate_environment() {
+    return pool_allocate(&environment_pool);
+}
+
+void lisp_heap_free_environment(lisp_environment_t* env) {
+    pool_free(&environment_pool, env);
+}
+
+lisp_value_userdefined_fun_t* lisp_heap_allocate_userdefined_fun() {
+    return pool_allocate(&userdefined_fun_pool);
+}
+
+void lisp_heap_free_userdefined_fun(lisp_value_userdefined_fun_t* userdefined_fun) {
+    if (userdefined_fun != NULL) {
+        pool_free(&userdefined_fun_pool, userdefined_fun);
+    }
+}
+
+static lisp_heap_pool_t* get_array_pool(size_t capacity) {
+    size_t size_class = SMALLEST_ARRAY_SIZE_CLASS;
+    for (size_t i = 0; i < ARRAY_SIZE_CLASSES_COUNT; i++) {
+        if (capacity <= size_class) {
+            return &array_pools[i];
+        }
+        size_class <<= 1;
+    }
+    return NULL;
+}
+
+static size_t get_array_size_class(size_t capacity) {
+    size_t size_class = SMALLEST_ARRAY_SIZE_CLASS;
+    while (size_class < capacity) {
+        size_class <<= 1;
+    }
+    return size_class;
+}
+
+void* lisp_heap_allocate_pointer_array(size_t capacity) {
+    lisp_heap_pool_t* pool = get_array_pool(capacity);
+    lisp_heap_array_header_t* header = NULL;
+    if (pool != NULL) {
+        header = pool_allocate(pool);
+        capacity = get_array_size_class(capacity);
+    } else {
+        header = malloc(sizeof(lisp_heap_array_header_t) + sizeof(void*) * capacity);
+    }
+    if (header == NULL) {
+        return NULL;
+    }
+    header->capacity = capacity;
+    header->owners = 0;
+    header->length = 0;
+    return header + 1;
+}
+
+void* lisp_heap_reallocate_pointer_array(void* array, size_t capacity) {
+    if (array == NULL) {
+        return lisp_heap_allocate_pointer_array(capacity);
+    }
+
+    lisp_heap_array_header_t* header = (lisp_heap_array_header_t*) array - 1;
+    if (capacity <= header->capacity && (capacity > header->capacity / 2 || header->capacity <= SMALLEST_ARRAY_SIZE_CLASS)) {
+        return array;
+    }
+    if (header->capacity > LARGEST_ARRAY_SIZE_CLASS && capacity > LARGEST_ARRAY_SIZE_CLASS) {
+        lisp_heap_array_header_t* new_header = realloc(header, sizeof(lisp_heap_array_header_t) + sizeof(void*) * capacity);
+        if (new_header == NULL) {
+            return NULL;
+        }
+        new_header->capacity = capacity;
+        return new_header + 1;
+    }
+
+    void* new_array = lisp_heap_allocate_pointer_array(capacity);
+    if (new_array == NULL) {
+        return NULL;
+    }
+    size_t copied_capacity = capacity < header->capacity ? capacity : header->capacity;
+    memcpy(new_array, array, sizeof(void*) * copied_capacity);
+    lisp_heap_free_pointer_array(array);
+    return new_array;
+}
+
+void* lisp_heap_reserve_pointer_array(void* array, size_t capacity) {
+    size_t current_capacity = lisp_heap_get_pointer_array_capacity(array);
+    if (capacity <= current_capacity) {
+        return array;
+    }
+    if (capacity < current_capacity * 2) {
+        capacity = current_capacity * 2;
+    }
+    return lisp_heap_reallocate_pointer_array(array, capacity);
+}
+
+void* lisp_heap_shrink_pointer_array(void* array, size_t count) {
+    size_t capacity = lisp_heap_get_pointer_array_capacity(array);
+    if (count >= capacity / 4 || capacity <= SMALLEST_ARRAY_SIZE_CLASS) {
+        return array;
+    }
+    void* new_array = lisp_heap_reallocate_pointer_array(array, count * 2);
+    return new_array == NULL ? array : new_array;
+}
+
+size_t lisp_heap_get_pointer_array_capacity(void* array) {
+    if (array == NULL) {
+        return 0;
+    }
+    return ((lisp_heap_array_header_t*) array - 1)->capacity;
+}
+
+void lisp_heap_share_pointer_array(void* array, size_t length) {
+    lisp_heap_array_header_t* header = (lisp_heap_array_header_t*) array - 1;
+    if (header->owners == 0) {
+        header->owners = 1;
+        header->length = length;
+    }
+    header->owners++;
+}
+
+bool lisp_heap_release_pointer_array(void* array) {
+    lisp_heap_array_header_t* header = (lisp_heap_array_header_t*) array - 1;
+    if (header->owners > 1) {
+        header->owners--;
+        return false;
+    }
+    return true;
+}
+
+size_t lisp_heap_get_pointer_array_owners(void* array) {
+    if (array == NULL) {
+        return 0;
+    }
+    return ((lisp_heap_array_header_t*) array - 1)->owners;
+}
+
+bool lisp_heap_extend_shared_pointer_array(void* array, size_t end) {
+    lisp_heap_array_header_t* header = (lisp_heap_array_header_t*) array - 1;
+    if (end != header->length || header->length == header->capacity) {
+        return false;
+    }
+    header->length++;
+    return true;
+}
+
+size_t lisp_heap_get_pointer_array_length(void* array) {
+    if (array == NULL) {
+        return 0;
+    }
+    return ((lisp_heap_array_header_t*) array - 1)->length;
+}
+
+void lisp_heap_unshare_pointer_array(void* array) {
+    lisp_heap_array_header_t* header = (lisp_heap_array_header_t*) array - 1;
+    header->owners = 0;
+    header->length = 0;
+}
+
+void lisp_heap_free_pointer_array(void* array) {
+    if (array == NULL) {
+        return;
+    }
+    lisp_heap_array_header_t* header = (lisp_heap_array_header_t*) array - 1;
+    lisp_heap_pool_t* pool = get_array_pool(header->capacity);
+    if (pool != NULL) {
+        pool_free(pool, header);
+    } else {
+        free(header);
+    }
+}
+
+void lisp_heap_trim() {
+    pool_trim(&value_pool);
+    pool_trim(&environment_pool);
+    pool_trim(&userdefined_fun_pool);
+    for (size_t i = 0; i < ARRAY_SIZE_CLASSES_COUNT; i++) {
+        pool_trim(&array_pools[i]);
+    }
+}
+
+static void add_pool_stats(lisp_heap_stats_t* stats, lisp_heap_pool_t* pool) {
+    stats->live += pool->stats.live;
+    stats->free += pool->stats.free;
+    stats->peak_live += pool->stats.peak_live;
+    stats->chunks += pool->stats.chunks;
+    stats->allocations += pool->stats.allocations;
+    stats->trims += pool->stats.trims;
+    stats->released_chunks += pool->stats.released_chunks;
+}
+
+lisp_heap_stats_t lisp_heap_get_stats() {
+    lisp_heap_stats_t stats = {0};
+    add_pool_stats(&stats, &value_pool);
+    add_pool_stats(&stats, &environment_pool);
+    add_pool_stats(&stats, &userdefined_fun_pool);
+    for (size_t i = 0; i < ARRAY_SIZE_CLASSES_COUNT; i++) {
+        add_pool_stats(&stats, &array_pools[i]);
+    }
+    return stats;
+}
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <stddef.h>
+
+#include "interpreter.h"
+
+/* The heap that stores lisp_value_t nodes, environments, user defined functions and the arrays of children/bindings
+ * Every kind of node is allocated from its own thread local pool of chunks, a freed node is put on the free list
+ * of its pool and reused by the next allocation.
+ * Pointer arrays are allocated from pools of size classes of 4, 8, 16 and 32 pointers, larger arrays are allocated with malloc.
+ * There is no garbage collector, nodes are reclaimed by reference counting(see lisp_value_delete) when their
+ * last owner deletes them, nothing is traced from roots. A trim walks the free list of a pool and releases the chunks
+ * that contain only free nodes back to the operating system.
+ */
+
+typedef struct lisp_heap_settings_t {
+    /* number of nodes in the first chunk */
+    size_t initial_chunk_size;
+    /* number of nodes in a chunk is never larger than this */
+    size_t max_chunk_size;
+    /* every new chunk is this many times larger than the previous one */
+    double growth_factor;
+    /* a pool is trimmed when the number of free nodes is larger than this many times the number of live nodes */
+    double trim_free_ratio;
+    /* a pool is never trimmed when there are less free nodes than this */
+    size_t trim_min_free;
+    /* number of bytes the stacks of the virtual machine can use, a call that needs more evaluates to an error */
+    size_t evaluation_stack_budget;
+} lisp_heap_settings_t;
+
+typedef struct lisp_heap_stats_t {
+    size_t live;
+    size_t free;
+    size_t peak_live;
+    size_t chunks;
+    size_t allocations;
+    size_t trims;
+    size_t released_chunks;
+} lisp_heap_stats_t;
+
+/**
+ * Reads the settings from the environment variables
+ * MY_OWN_LISP_HEAP_INITIAL_CHUNK_SIZE, MY_OWN_LISP_HEAP_MAX_CHUNK_SIZE, MY_OWN_LISP_HEAP_GROWTH_FACTOR,
+ * MY_OWN_LISP_HEAP_TRIM_FREE_RATIO, MY_OWN_LISP_HEAP_TRIM_MIN_FREE and MY_OWN_LISP_HEAP_EVALUATION_STACK_BUDGET,
+ * the ones that are not set keep the default
+ */
+void lisp_heap_configure_from_environment_variables();
+void lisp_heap_configure(lisp_heap_settings_t settings);
+lisp_heap_settings_t lisp_heap_get_settings();
+
+/**
+ * @return uninitialized node, NULL if out of memory
+ */
+lisp_value_t* lisp_heap_allocate_value();
+void lisp_heap_free_value(lisp_value_t* value);
+
+/**
+ * @return uninitialized environment, NULL if out of memory
+ */
+lisp_environment_t* lisp_heap_allocate_environment();
+void lisp_heap_free_environment(lisp_environment_t* env);
+
+/**
+ * @return uninitialized user defined function, NULL if out of memory
+ */
+lisp_value_userdefined_fun_t* lisp_heap_allocate_userdefined_fun();
+void lisp_heap_free_userdefined_fun(lisp_value_userdefined_fun_t* userdefined_fun);
+
+/**
+ * @return uninitialized array of at least capacity pointers, NULL if out of memory
+ */
+void* lisp_heap_allocate_pointer_array(size_t capacity);
+/**
+ * Moves the array to an array of at least capacity pointers, the pointers that fit are kept.
+ * @return the moved array(can be the same array), NULL if out of memory in which case the original array is left intact
+ */
+void* lisp_heap_reallocate_pointer_array(void* array, size_t capacity);
+/**
+ * Makes room for at least capacity pointers, the array at least doubles when it grows,
+ * so that appending pointers one at a time takes amortized constant time
+ * @return the array(can be moved), NULL if out of memory in which case the original array is left intact
+ */
+void* lisp_heap_reserve_pointer_array(void* array, size_t capacity);
+/**
+ * Moves the array to a smaller one only when less than a quarter of it is used by count pointers,
+ * so that alternating appends and removals around a size class do not move the array every time
+ * @return the array(can be moved), the original array if out of memory
+ */
+void* lisp_heap_shrink_pointer_array(void* array, size_t count);
+size_t lisp_heap_get_pointer_array_capacity(void* array);
+/**
+ * Adds an owner to the array, a shared array is not mutated or moved by its owners(see the slices of lisp_value_t).
+ * @param length the number of pointers that the owners keep alive, recorded when the array is shared for the first time
+ */
+void lisp_heap_share_pointer_array(void* array, size_t length);
+/**
+ * Removes an owner from a shared array
+ * @return true if the caller was the last owner, in which case the caller releases the pointers and frees the array
+ */
+bool lisp_heap_release_pointer_array(void* array);
+/**
+ * @return the number of owners of a shared array, 0 if the array was never shared
+ */
+size_t lisp_heap_get_pointer_array_owners(void* array);
+/**
+ * Lets the slice of a shared array that ends at end append a pointer in place, the other slices end before it
+ * @return true if the pointer at end can be set by the caller(the length of the array is increased),
+ * false if end is not the length of the array or the array is full
+ */
+bool lisp_heap_extend_shared_pointer_array(void* array, size_t end);
+size_t lisp_heap_get_pointer_array_length(void* array);
+/**
+ * Gives a shared array that is left with a single owner back to the owner, which can mutate and move it again
+ */
+void lisp_heap_unshare_pointer_array(void* array);
+void lisp_heap_free_pointer_array(void* array);
+
+/**
+ * Releases the chunks of every pool that contain only free nodes, the pools are also trimmed by the allocations
+ * according to the settings
+ */
+void lisp_heap_trim();
+lisp_heap_stats_t lisp_heap_get_stats();
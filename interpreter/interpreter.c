@@ -1,9 +1,14 @@
 #include "interpreter.h"
-
-#include "mpc/mpc.h"
-
+#include "heap.h"
+#include "symbol.h"
+#include "vm.h"
+#include "closure.h"
+#include "jit.h"
+#include "reader.h"
+
+#include <limits.h>
 #include <math.h>
-#include <parser.h>
+#include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -60,42 +65,81 @@ static char* BUILTIN_NOT_NOT = "not";
 static char* BUILTIN_LOAD = "load";
 static char* BUILTIN_PRINT = "print";
 static char* BUILTIN_ERROR = "error";
+static char* BUILTIN_HEAP_STATS = "heap-stats";
+
+typedef enum {
+    NUMERIC_OP_ADD,
+    NUMERIC_OP_SUBTRACT,
+    NUMERIC_OP_MULTIPLY,
+    NUMERIC_OP_DIVIDE,
+    NUMERIC_OP_MOD,
+    NUMERIC_OP_POW,
+    NUMERIC_OP_MIN,
+    NUMERIC_OP_MAX
+} numeric_operation_t;
+
+typedef enum {
+    ORDERING_OP_GT,
+    ORDERING_OP_GE,
+    ORDERING_OP_LT,
+    ORDERING_OP_LE
+} ordering_operation_t;
+
+typedef enum {
+    LOGICAL_OP_OR,
+    LOGICAL_OP_AND,
+    LOGICAL_OP_NOT
+} logical_operation_t;
 
 static lisp_value_t null_lisp_value = {
     .value_type = 0,
-    .error_message = NULL,
-    .value_number = 0,
-    .value_decimal = 0,
-    .value_symbol = NULL,
-    .count = 0,
-    .values = NULL
+    .values = NULL,
+    .count = 0
+};
+
+/* Small numbers and booleans are preallocated immortal values, creating them does not allocate and sharing or deleting
+ * them does not touch the reference count. They are never mutated, lisp_value_unshare returns a copy of them */
+static constexpr int IMMORTAL_REFERENCE_COUNT = INT_MAX;
+static constexpr long SMALL_NUMBER_MIN = -128;
+static constexpr long SMALL_NUMBER_MAX = 1023;
+
+static constexpr size_t ENVIRONMENT_INDEX_MIN_COUNT = 8;
+static constexpr size_t ENVIRONMENT_INDEX_INITIAL_CAPACITY = 32;
+
+static lisp_value_t small_number_values[SMALL_NUMBER_MAX - SMALL_NUMBER_MIN + 1];
+
+static lisp_value_t boolean_values[2] = {
+    {.value_type = VAL_BOOLEAN, .reference_count = IMMORTAL_REFERENCE_COUNT, .value_number = 0},
+    {.value_type = VAL_BOOLEAN, .reference_count = IMMORTAL_REFERENCE_COUNT, .value_number = 1}
 };
 
 static lisp_environment_t null_lisp_environment = {
     .symbols = NULL,
     .values = NULL,
+    .index = NULL,
     .parent_environment = NULL
 };
 
 static lisp_environment_t lisp_environment_referenced_by_root_environment = {
     .symbols = NULL,
     .values = NULL,
+    .index = NULL,
     .parent_environment = NULL
 };
 
+static lisp_evaluation_engine_t evaluation_engine = EVAL_ENGINE_DESTRUCTIVE;
+
 lisp_value_t* lisp_value_new(lisp_value_type_t value_type) {
-    lisp_value_t* lisp_value = malloc(sizeof(lisp_value_t));
+    lisp_value_t* lisp_value = lisp_heap_allocate_value();
     if (lisp_value == NULL) {
         return NULL;
     }
     lisp_value->value_type = value_type;
-    lisp_value->error_message = NULL;
-    lisp_value->value_number = 0;
-    lisp_value->value_decimal = 0;
-    lisp_value->value_symbol = NULL;
-    lisp_value->value_userdefined_fun = NULL;
-    lisp_value->count = 0;
+    lisp_value->reference_count = 1;
+    // clears the largest payload, which clears the pointers of the other payloads
     lisp_value->values = NULL;
+    lisp_value->count = 0;
+    lisp_value->values_offset = 0;
     return lisp_value;
 }
 
@@ -128,87 +172,17 @@ char* get_value_type_string(lisp_value_type_t value_type) {
     }
 }
 
-bool has_tag(mpc_ast_t * ast, char * tag) {
-    return strstr(ast->tag, tag) != NULL;
-}
-
-bool is_root(mpc_ast_t * ast) {
-    return strcmp(ast->tag, ">") == 0;
-}
-
-/* Assumes ast is not NULL
- * Will return get_null_lisp_value() if the lisp_value is not parsed completely
- *  * if the ast does not represent the language that this function parses
- *  * if the program is not able to allocate lisp_value_t* objects
- */
-lisp_value_t* parse_lisp_value(mpc_ast_t* ast) {
-    if (has_tag(ast, "number")) {
-        errno = 0;
-        long number = strtol(ast->contents, NULL, 10);
-        if (errno != 0) {
-            return get_lisp_value_error_bad_numeric_value();
-        }
-        return lisp_value_number_new(number);
-    }
-    if (has_tag(ast, "boolean")) {
-        int r = 0;
-        if (strcmp("true", ast->contents) == 0) {
-            r = 1;
-        }
-        return lisp_value_boolean_new(r);
-    }
-    if (has_tag(ast, "decimal")) {
-        errno = 0;
-        double number_decimal = strtod(ast->contents, NULL);
-        if (errno != 0) {
-            return get_lisp_value_error_bad_numeric_value();
-        }
-        return lisp_value_decimal_new(number_decimal);
-    }
-    if (has_tag(ast, "string")) {
-        return lisp_value_string_new(ast->contents);
-    }
-    if (has_tag(ast, "symbol")) {
-        return lisp_value_symbol_new(ast->contents);
-    }
-
-    lisp_value_t* lisp_value = get_null_lisp_value();
-    if (is_root(ast)) {
-        lisp_value = lisp_value_root_new();
-    } else if (has_tag(ast, "sexpr")) {
-        lisp_value = lisp_value_sexpr_new();
-    } else if (has_tag(ast, "qexpr")) {
-        lisp_value = lisp_value_qexpr_new();
-    }
-
-    if (is_lisp_value_null(lisp_value)) {
-        return get_null_lisp_value();
-    }
-
-    int i = 1;
-    while (has_tag(ast->children[i], "expr")) {
-        if (has_tag(ast->children[i], "comment")) {
-            i++;
-            continue;
-        }
-        lisp_value_t* current_parsed_lisp_value = parse_lisp_value(ast->children[i]);
-        if (is_lisp_value_null(current_parsed_lisp_value)) {
-            lisp_value_delete(lisp_value);
-            return get_null_lisp_value();
-        }
-        bool ok = append_lisp_value(lisp_value, current_parsed_lisp_value);
-        if (!ok) {
-            lisp_value_delete(current_parsed_lisp_value);
-            lisp_value_delete(lisp_value);
-            return get_null_lisp_value();
+lisp_value_t* lisp_value_number_new(long value) {
+    if (value >= SMALL_NUMBER_MIN && value <= SMALL_NUMBER_MAX) {
+        lisp_value_t* small_number = &small_number_values[value - SMALL_NUMBER_MIN];
+        if (small_number->reference_count != IMMORTAL_REFERENCE_COUNT) {
+            small_number->value_type = VAL_NUMBER;
+            small_number->value_number = value;
+            small_number->reference_count = IMMORTAL_REFERENCE_COUNT;
         }
-        i++;
+        return small_number;
     }
 
-    return lisp_value;
-}
-
-lisp_value_t* lisp_value_number_new(long value) {
     lisp_value_t* lisp_value = lisp_value_new(VAL_NUMBER);
     if (lisp_value == NULL) {
         return &null_lisp_value;
@@ -231,12 +205,12 @@ lisp_value_t* lisp_value_symbol_new(char* value) {
     if (lisp_value == NULL) {
         return &null_lisp_value;
     }
-    lisp_value->value_symbol = malloc(strlen(value) + 1);
+    lisp_value->value_symbol = lisp_symbol_intern(value);
     if (lisp_value->value_symbol == NULL) {
         lisp_value_delete(lisp_value);
         return &null_lisp_value;
     }
-    strcpy(lisp_value->value_symbol, value);
+    lisp_value->symbol_slot_hint = -1;
     return lisp_value;
 }
 
@@ -264,20 +238,85 @@ lisp_value_t * lisp_value_qexpr_new() {
     return lisp_value;
 }
 
+/* The children of a value are a slice(values, count) of its buffer(see get_buffer). A buffer that was never shared belongs to a single
+ * value and holds exactly its children, the value owns them and can mutate and move the buffer.
+ * A buffer that is shared by slices(see lisp_value_slice) owns the first length children(see lisp_heap_share_pointer_array)
+ * and is never mutated, it is released with the last slice. */
+
+/* The buffer is not stored in the value to keep values small, it is values_offset children before the slice */
+static lisp_value_t** get_buffer(lisp_value_t* value) {
+    return value->values == NULL ? NULL : value->values - value->values_offset;
+}
+
+/* Releases the buffer of value, and the children when value is the last owner of the buffer */
+static void release_children(lisp_value_t* value) {
+    lisp_value_t** buffer = get_buffer(value);
+    if (buffer == NULL) {
+        return;
+    }
+    long count = value->count;
+    if (lisp_heap_get_pointer_array_owners(buffer) != 0) {
+        if (!lisp_heap_release_pointer_array(buffer)) {
+            return;
+        }
+        count = (long) lisp_heap_get_pointer_array_length(buffer);
+    }
+    for (long i = 0; i < count; i++) {
+        lisp_value_delete(buffer[i]);
+    }
+    lisp_heap_free_pointer_array(buffer);
+}
+
+/* Makes value the only owner of its children, so that they can be mutated(copy-on-write of a slice)
+ * A slice that is the last owner of its buffer is moved to the front of the buffer, otherwise the children are copied
+ * to a buffer of at least capacity children
+ * @return false if out of memory, value is left intact */
+static bool own_children(lisp_value_t* value, long capacity) {
+    lisp_value_t** buffer = get_buffer(value);
+    if (buffer == NULL || lisp_heap_get_pointer_array_owners(buffer) == 0) {
+        return true;
+    }
+
+    if (lisp_heap_get_pointer_array_owners(buffer) == 1) {
+        long offset = value->values_offset;
+        long length = (long) lisp_heap_get_pointer_array_length(buffer);
+        for (long i = 0; i < offset; i++) {
+            lisp_value_delete(buffer[i]);
+        }
+        for (long i = offset + value->count; i < length; i++) {
+            lisp_value_delete(buffer[i]);
+        }
+        memmove(buffer, value->values, sizeof(lisp_value_t*) * value->count);
+        lisp_heap_unshare_pointer_array(buffer);
+        value->values = buffer;
+        value->values_offset = 0;
+        return true;
+    }
+
+    lisp_value_t** values = lisp_heap_allocate_pointer_array(capacity > value->count ? capacity : value->count);
+    if (values == NULL) {
+        return false;
+    }
+    for (long i = 0; i < value->count; i++) {
+        values[i] = lisp_value_share(value->values[i]);
+    }
+    lisp_heap_release_pointer_array(buffer);
+    value->values = values;
+    value->values_offset = 0;
+    return true;
+}
+
 void lisp_value_delete(lisp_value_t* lisp_value) {
-    if (lisp_value == &null_lisp_value) {
+    if (lisp_value == &null_lisp_value || lisp_value->reference_count == IMMORTAL_REFERENCE_COUNT) {
+        return;
+    }
+    lisp_value->reference_count--;
+    if (lisp_value->reference_count > 0) {
         return;
     }
 
     if (lisp_value->value_type == VAL_SEXPR || lisp_value->value_type == VAL_ROOT || lisp_value->value_type == VAL_QEXPR) {
-        if (lisp_value->values != NULL) {
-            for (int i = 0; i < lisp_value->count; i++) {
-                lisp_value_delete(lisp_value->values[i]);
-            }
-        }
-        free(lisp_value->values);
-    } else if (lisp_value->value_type == VAL_SYMBOL || lisp_value->value_type == VAL_BUILTIN_FUN) {
-        free(lisp_value->value_symbol);
+        release_children(lisp_value);
     } else if (lisp_value->value_type == VAL_ERR) {
         free(lisp_value->error_message);
     } else if (lisp_value->value_type == VAL_USERDEFINED_FUN) {
@@ -286,24 +325,137 @@ void lisp_value_delete(lisp_value_t* lisp_value) {
             lisp_value_delete(lisp_value->value_userdefined_fun->varargs_symbol);
             lisp_value_delete(lisp_value->value_userdefined_fun->body);
             lisp_environment_delete(lisp_value->value_userdefined_fun->local_env);
+            lisp_bytecode_delete(lisp_value->value_userdefined_fun->bytecode);
+            lisp_closure_delete(lisp_value->value_userdefined_fun->closure);
+            lisp_jit_code_delete(lisp_value->value_userdefined_fun->jit_code);
         }
-        free(lisp_value->value_userdefined_fun);
+        lisp_heap_free_userdefined_fun(lisp_value->value_userdefined_fun);
     } else if (lisp_value->value_type == VAL_STRING) {
         free(lisp_value->value_string);
     }
-    free(lisp_value);
+    lisp_heap_free_value(lisp_value);
 }
 
-lisp_value_t * lisp_value_builtin_fun_new(char *symbol) {
+lisp_value_t * lisp_value_builtin_fun_new(char *symbol, lisp_builtin_fun_t builtin_fun) {
     lisp_value_t* lisp_value = lisp_value_symbol_new(symbol);
     if (lisp_value == &null_lisp_value) {
         return &null_lisp_value;
     }
     lisp_value->value_type = VAL_BUILTIN_FUN;
+    lisp_value->value_builtin_fun = builtin_fun;
     return lisp_value;
 }
 
+/* @return the slot of the formal argument that symbol refers to, the current hint of symbol if it is not a formal argument */
+static long find_symbol_slot_hint(lisp_value_t* symbol, lisp_value_t* formal_arguments, lisp_value_t* varargs_symbol) {
+    for (long i = 0; i < formal_arguments->count; i++) {
+        if (formal_arguments->values[i]->value_symbol == symbol->value_symbol) {
+            return formal_arguments->values[i]->symbol_slot_hint;
+        }
+    }
+    if (varargs_symbol != &null_lisp_value && varargs_symbol->value_symbol == symbol->value_symbol) {
+        return varargs_symbol->symbol_slot_hint;
+    }
+    return symbol->symbol_slot_hint;
+}
+
+static bool has_stale_symbol_slot_hints(lisp_value_t* value, lisp_value_t* formal_arguments, lisp_value_t* varargs_symbol) {
+    if (value->value_type == VAL_SYMBOL) {
+        return find_symbol_slot_hint(value, formal_arguments, varargs_symbol) != value->symbol_slot_hint;
+    }
+    if (value->value_type == VAL_SEXPR || value->value_type == VAL_QEXPR) {
+        for (long i = 0; i < value->count; i++) {
+            if (has_stale_symbol_slot_hints(value->values[i], formal_arguments, varargs_symbol)) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+/* Sets the slot hint of every symbol in value that is one of the formal arguments, the formal arguments are bound
+ * in this order in the frame of the function(see call_userdefined_function), so a reference to an argument is found
+ * without searching the frame. The hints are only hints, they are validated on every lookup.
+ * The body can be shared with other functions and the environment, so the nodes on the path to a hint that changes are
+ * unshared(copy-on-write) instead of overwriting the hints of the other owners
+ * @param value consumed
+ * @return value with the hints set, null lisp value if out of memory */
+static lisp_value_t* resolve_symbol_slot_hints(lisp_value_t* value, lisp_value_t* formal_arguments, lisp_value_t* varargs_symbol) {
+    if (!has_stale_symbol_slot_hints(value, formal_arguments, varargs_symbol)) {
+        return value;
+    }
+    value = lisp_value_unshare(value);
+    if (value == &null_lisp_value) {
+        return value;
+    }
+    if (value->value_type == VAL_SYMBOL) {
+        value->symbol_slot_hint = find_symbol_slot_hint(value, formal_arguments, varargs_symbol);
+        return value;
+    }
+    for (long i = 0; i < value->count; i++) {
+        // value is not shared any more, its reference to the child is handed over
+        value->values[i] = resolve_symbol_slot_hints(value->values[i], formal_arguments, varargs_symbol);
+        if (value->values[i] == &null_lisp_value) {
+            lisp_value_delete(value);
+            return &null_lisp_value;
+        }
+    }
+    return value;
+}
+
+/* Sets the slot hint of symbol(consumed), the symbol is unshared if the hint changes
+ * @return the symbol, null lisp value if out of memory */
+static lisp_value_t* set_symbol_slot_hint(lisp_value_t* symbol, long slot) {
+    if (symbol->symbol_slot_hint == slot) {
+        return symbol;
+    }
+    symbol = lisp_value_unshare(symbol);
+    if (symbol != &null_lisp_value) {
+        symbol->symbol_slot_hint = slot;
+    }
+    return symbol;
+}
+
+/* The formal arguments get the slots in the order they are bound, a repeated symbol keeps its first slot
+ * formal_arguments is not shared, its symbols can be
+ * @return false if out of memory */
+static bool resolve_formal_argument_slots(lisp_value_t* formal_arguments, lisp_value_t** varargs_symbol) {
+    long slot = 0;
+    for (long i = 0; i < formal_arguments->count; i++) {
+        long formal_argument_slot = slot;
+        for (long j = 0; j < i; j++) {
+            if (formal_arguments->values[j]->value_symbol == formal_arguments->values[i]->value_symbol) {
+                formal_argument_slot = formal_arguments->values[j]->symbol_slot_hint;
+                break;
+            }
+        }
+        if (formal_argument_slot == slot) {
+            slot++;
+        }
+        formal_arguments->values[i] = set_symbol_slot_hint(formal_arguments->values[i], formal_argument_slot);
+        if (formal_arguments->values[i] == &null_lisp_value) {
+            return false;
+        }
+    }
+    if (*varargs_symbol != &null_lisp_value) {
+        long varargs_slot = slot;
+        for (long i = 0; i < formal_arguments->count; i++) {
+            if (formal_arguments->values[i]->value_symbol == (*varargs_symbol)->value_symbol) {
+                varargs_slot = formal_arguments->values[i]->symbol_slot_hint;
+                break;
+            }
+        }
+        *varargs_symbol = set_symbol_slot_hint(*varargs_symbol, varargs_slot);
+        if (*varargs_symbol == &null_lisp_value) {
+            return false;
+        }
+    }
+    return true;
+}
+
 lisp_value_t* lisp_value_userdefined_fun_new(lisp_environment_t* environment, lisp_value_t* formal_arguments, lisp_value_t* body) {
+    // the varargs signifier is popped from formal_arguments
+    formal_arguments = lisp_value_unshare(formal_arguments);
     if (formal_arguments->value_type != VAL_QEXPR || body->value_type != VAL_QEXPR) {
         lisp_value_delete(formal_arguments);
         lisp_value_delete(body);
@@ -343,22 +495,44 @@ lisp_value_t* lisp_value_userdefined_fun_new(lisp_environment_t* environment, li
         lisp_value_delete(lisp_value_pop_child(formal_arguments, varargs_signifier_index));
         varargs_symbol = lisp_value_pop_child(formal_arguments, varargs_signifier_index);
     }
+    if (!resolve_formal_argument_slots(formal_arguments, &varargs_symbol)) {
+        lisp_value_delete(formal_arguments);
+        lisp_value_delete(varargs_symbol);
+        lisp_value_delete(body);
+        return &null_lisp_value;
+    }
+    body = resolve_symbol_slot_hints(body, formal_arguments, varargs_symbol);
+    if (body == &null_lisp_value) {
+        lisp_value_delete(formal_arguments);
+        lisp_value_delete(varargs_symbol);
+        return &null_lisp_value;
+    }
 
     lisp_value_t* lisp_value = lisp_value_new(VAL_USERDEFINED_FUN);
     // TODO: replace this(and in every occurence with check if lisp_value equals to null_lisp_value
     //  basically make lisp_value_new return null_lisp_value
     if (lisp_value == NULL) {
+        lisp_value_delete(formal_arguments);
+        lisp_value_delete(varargs_symbol);
+        lisp_value_delete(body);
         return &null_lisp_value;
     }
-    lisp_value_userdefined_fun_t* userdefined_fun = malloc(sizeof(lisp_value_userdefined_fun_t));
+    lisp_value_userdefined_fun_t* userdefined_fun = lisp_heap_allocate_userdefined_fun();
     if (userdefined_fun == NULL) {
         lisp_value_delete(lisp_value);
+        lisp_value_delete(formal_arguments);
+        lisp_value_delete(varargs_symbol);
+        lisp_value_delete(body);
         return &null_lisp_value;
     }
     userdefined_fun->formal_arguments = formal_arguments;
     userdefined_fun->varargs_symbol = varargs_symbol;
     userdefined_fun->body = body;
     userdefined_fun->local_env = lisp_environment_new_with_parent(environment);
+    userdefined_fun->bytecode = NULL;
+    userdefined_fun->closure = NULL;
+    userdefined_fun->call_count = 0;
+    userdefined_fun->jit_code = NULL;
     lisp_value->value_userdefined_fun = userdefined_fun;
     if (userdefined_fun->local_env == &null_lisp_environment) {
         lisp_value_delete(lisp_value);
@@ -368,12 +542,51 @@ lisp_value_t* lisp_value_userdefined_fun_new(lisp_environment_t* environment, li
 }
 
 lisp_value_t* lisp_value_boolean_new(long value) {
-    lisp_value_t* lisp_value = lisp_value_new(VAL_BOOLEAN);
-    if (lisp_value == NULL) {
-        return &null_lisp_value;
+    return &boolean_values[value != 0];
+}
+
+// the characters that are escaped in string literals and the letters of their escapes, the escapes of C
+static char* ESCAPED_CHARACTERS = "\a\b\f\n\r\t\v\\'\"";
+static char* ESCAPE_LETTERS = "abfnrtv\\'\"";
+
+/* Replaces the escapes in string in place, \0 is removed and a backslash that does not start an escape is kept */
+static void unescape_string(char* string) {
+    char* output = string;
+    for (char* c = string; *c != '\0'; c++) {
+        char* letter = c[0] == '\\' && c[1] != '\0' ? strchr(ESCAPE_LETTERS, c[1]) : NULL;
+        if (letter != NULL) {
+            *output++ = ESCAPED_CHARACTERS[letter - ESCAPE_LETTERS];
+            c++;
+        } else if (c[0] == '\\' && c[1] == '0') {
+            c++;
+        } else {
+            *output++ = *c;
+        }
     }
-    lisp_value->value_number = value;
-    return lisp_value;
+    *output = '\0';
+}
+
+char* lisp_string_escape(const char* string) {
+    size_t length = 0;
+    for (const char* c = string; *c != '\0'; c++) {
+        length += strchr(ESCAPED_CHARACTERS, *c) != NULL ? 2 : 1;
+    }
+    char* escaped_string = malloc(length + 1);
+    if (escaped_string == NULL) {
+        return NULL;
+    }
+    char* output = escaped_string;
+    for (const char* c = string; *c != '\0'; c++) {
+        char* character = strchr(ESCAPED_CHARACTERS, *c);
+        if (character != NULL) {
+            *output++ = '\\';
+            *output++ = ESCAPE_LETTERS[character - ESCAPED_CHARACTERS];
+        } else {
+            *output++ = *c;
+        }
+    }
+    *output = '\0';
+    return escaped_string;
 }
 
 lisp_value_t* lisp_value_string_new(const char* value) {
@@ -391,12 +604,23 @@ lisp_value_t* lisp_value_string_new(const char* value) {
     }
     strncpy(value_without_quotes, value + 1, value_without_quotes_buffer_size - 1);
     value_without_quotes[value_without_quotes_buffer_size - 1] = '\0';
-    lisp_value->value_string = mpcf_unescape(value_without_quotes);
-    // we do not free value_without_quotes since mpcf_unescape frees it already
+    unescape_string(value_without_quotes);
+    lisp_value->value_string = value_without_quotes;
+    return lisp_value;
+}
+
+lisp_value_t* lisp_value_string_contents_new(const char* contents, size_t length) {
+    lisp_value_t* lisp_value = lisp_value_new(VAL_STRING);
+    if (lisp_value == NULL) {
+        return &null_lisp_value;
+    }
+    lisp_value->value_string = malloc(length + 1);
     if (lisp_value->value_string == NULL) {
         lisp_value_delete(lisp_value);
         return &null_lisp_value;
     }
+    memcpy(lisp_value->value_string, contents, length);
+    lisp_value->value_string[length] = '\0';
     return lisp_value;
 }
 
@@ -429,6 +653,7 @@ lisp_value_t* lisp_value_error_new(char* error_message_template, ...) {
     return lisp_error;
 }
 
+/* Copies the value itself, the values it references(children, function arguments and body) are shared with the copy */
 lisp_value_t * lisp_value_copy(lisp_value_t *value) {
     if (value == &null_lisp_value) {
         return &null_lisp_value;
@@ -448,6 +673,7 @@ lisp_value_t * lisp_value_copy(lisp_value_t *value) {
                 break;
             }
             strcpy(copy->error_message, value->error_message);
+            copy->is_error_user_defined_value = value->is_error_user_defined_value;
             break;
         case VAL_NUMBER:
         case VAL_BOOLEAN:
@@ -457,49 +683,42 @@ lisp_value_t * lisp_value_copy(lisp_value_t *value) {
             copy->value_decimal = value->value_decimal;
             break;
         case VAL_SYMBOL:
+            copy->value_symbol = value->value_symbol;
+            copy->symbol_slot_hint = value->symbol_slot_hint;
+            break;
         case VAL_BUILTIN_FUN:
-            copy->value_symbol = malloc(strlen(value->value_symbol) + 1);
-            if (copy->value_symbol == NULL) {
-                ok = false;
-                break;
-            }
-            strcpy(copy->value_symbol, value->value_symbol);
+            copy->value_symbol = value->value_symbol;
+            copy->value_builtin_fun = value->value_builtin_fun;
             break;
         case VAL_SEXPR:
         case VAL_ROOT:
         case VAL_QEXPR:
-            copy->count = value->count;
-            /*
-             * Set malloc size to the next larger value divisible by 10,
-             * for example, if count is 16, the next larger value divisible by 10 is 20
-             *  This is in order to not break the implementation for appending a child to sexpr lisp_value_t*
-             */
-            copy->values = malloc(sizeof(lisp_value_t*) * (value->count + (10 - value->count % 10)));
+            copy->values = lisp_heap_allocate_pointer_array(value->count);
             if (copy->values == NULL) {
                 ok = false;
                 break;
             }
+            copy->count = value->count;
             for (int i = 0; i < value->count; i++) {
-                copy->values[i] = lisp_value_copy(value->values[i]);
-                if (copy->values[i] == &null_lisp_value && value->values[i] != &null_lisp_value) {
-                    ok = false;
-                    break;
-                }
+                copy->values[i] = lisp_value_share(value->values[i]);
             }
             break;
         case VAL_USERDEFINED_FUN:
-            copy->value_userdefined_fun = malloc(sizeof(lisp_value_userdefined_fun_t));
+            copy->value_userdefined_fun = lisp_heap_allocate_userdefined_fun();
             if (copy->value_userdefined_fun == NULL) {
                 ok = false;
                 break;
             }
             copy->value_userdefined_fun->local_env = lisp_environment_copy(value->value_userdefined_fun->local_env);
-            copy->value_userdefined_fun->formal_arguments = lisp_value_copy(value->value_userdefined_fun->formal_arguments);
-            copy->value_userdefined_fun->varargs_symbol = lisp_value_copy(value->value_userdefined_fun->varargs_symbol);
-            copy->value_userdefined_fun->body = lisp_value_copy(value->value_userdefined_fun->body);
-            if ((copy->value_userdefined_fun->local_env == &null_lisp_environment && value->value_userdefined_fun->local_env != &null_lisp_environment)
-                || (copy->value_userdefined_fun->formal_arguments == &null_lisp_value && value->value_userdefined_fun->formal_arguments != &null_lisp_value)
-                || (copy->value_userdefined_fun->body == &null_lisp_value && value->value_userdefined_fun->body != &null_lisp_value)) {
+            copy->value_userdefined_fun->formal_arguments = lisp_value_share(value->value_userdefined_fun->formal_arguments);
+            copy->value_userdefined_fun->varargs_symbol = lisp_value_share(value->value_userdefined_fun->varargs_symbol);
+            copy->value_userdefined_fun->body = lisp_value_share(value->value_userdefined_fun->body);
+            copy->value_userdefined_fun->bytecode = lisp_bytecode_share(value->value_userdefined_fun->bytecode);
+            copy->value_userdefined_fun->closure = lisp_closure_share(value->value_userdefined_fun->closure);
+            // the native code is specialized on the function itself, the copy is compiled again
+            copy->value_userdefined_fun->call_count = 0;
+            copy->value_userdefined_fun->jit_code = NULL;
+            if (copy->value_userdefined_fun->local_env == &null_lisp_environment && value->value_userdefined_fun->local_env != &null_lisp_environment) {
                 ok = false;
             }
         break;
@@ -521,6 +740,33 @@ lisp_value_t * lisp_value_copy(lisp_value_t *value) {
     return copy;
 }
 
+/* Adds an owner to the value, every owner deletes the value with lisp_value_delete */
+lisp_value_t* lisp_value_share(lisp_value_t* value) {
+    if (value != &null_lisp_value && value->reference_count != IMMORTAL_REFERENCE_COUNT) {
+        value->reference_count++;
+    }
+    return value;
+}
+
+/* Takes the reference that the caller owns and returns a value that only the caller owns
+ * The value is copied only if it is shared */
+lisp_value_t* lisp_value_unshare(lisp_value_t* value) {
+    if (value == &null_lisp_value) {
+        return value;
+    }
+    if (value->reference_count == 1) {
+        bool has_children = value->value_type == VAL_SEXPR || value->value_type == VAL_ROOT || value->value_type == VAL_QEXPR;
+        if (has_children && !own_children(value, value->count)) {
+            lisp_value_delete(value);
+            return &null_lisp_value;
+        }
+        return value;
+    }
+    lisp_value_t* copy = lisp_value_copy(value);
+    lisp_value_delete(value);
+    return copy;
+}
+
 int lisp_value_equals(lisp_value_t* first, lisp_value_t* second) {
     if (first == &null_lisp_value && second == &null_lisp_value) {
         return 1;
@@ -543,7 +789,7 @@ int lisp_value_equals(lisp_value_t* first, lisp_value_t* second) {
                 r = first->value_decimal == second->value_decimal;
             break;
             case VAL_SYMBOL:
-                r = strcmp(first->value_symbol, second->value_symbol) == 0;
+                r = first->value_symbol == second->value_symbol;
             break;
             case VAL_SEXPR:
             case VAL_ROOT:
@@ -557,7 +803,7 @@ int lisp_value_equals(lisp_value_t* first, lisp_value_t* second) {
                 }
             break;
             case VAL_BUILTIN_FUN:
-                r = strcmp(first->value_symbol, second->value_symbol) == 0;
+                r = first->value_symbol == second->value_symbol;
             break;
             case VAL_USERDEFINED_FUN:
                 int equals_formal_arguments = lisp_value_equals(first->value_userdefined_fun->formal_arguments, second->value_userdefined_fun->formal_arguments);
@@ -586,26 +832,67 @@ bool should_contain_children(lisp_value_t* value) {
     && (value->value_type == VAL_ROOT || value->value_type == VAL_SEXPR || value->value_type == VAL_QEXPR);
 }
 
-bool append_lisp_value(lisp_value_t* value, lisp_value_t* child_to_append) {
-    if (should_contain_children(value)) {
-        if (value->values == NULL) {
-            value->values = malloc(sizeof(lisp_value_t) * 10);
-        } else if (value->count > 0 && value->count % 10 == 0) {
-            lisp_value_t** new_values = realloc(value->values, sizeof(lisp_value_t*) * (value->count + 10));
-            if (new_values == NULL) {
-                return false;
-            }
-            value->values = new_values;
+lisp_value_t* lisp_value_slice(lisp_value_t* value, long offset, long count) {
+    lisp_value_t* slice = value;
+    if (value->reference_count != 1) {
+        slice = lisp_value_new(value->value_type);
+        if (slice == NULL) {
+            lisp_value_delete(value);
+            return &null_lisp_value;
         }
-
-        if (value->values == NULL) {
-            return false;
+        slice->values = value->values;
+        slice->values_offset = value->values_offset;
+        if (value->values != NULL) {
+            lisp_heap_share_pointer_array(get_buffer(value), value->count);
         }
+        lisp_value_delete(value);
+    } else if (value->values != NULL && lisp_heap_get_pointer_array_owners(get_buffer(value)) == 0) {
+        // value is the only owner, but the buffer keeps all of the children alive from now on
+        lisp_heap_share_pointer_array(get_buffer(value), value->count);
+        lisp_heap_release_pointer_array(get_buffer(value));
+    }
+    if (slice->values != NULL) {
+        slice->values += offset;
+        slice->values_offset += (int) offset;
+    }
+    slice->count = (int) count;
+    return slice;
+}
+
+bool append_lisp_value(lisp_value_t* value, lisp_value_t* child_to_append) {
+    if (!should_contain_children(value)) {
+        return false;
+    }
+
+    if (value->count == INT_MAX) {
+        return false;
+    }
+
+    // a slice that ends where its shared buffer ends appends in place, so a list that is joined repeatedly is not copied
+    lisp_value_t** buffer = get_buffer(value);
+    if (buffer != NULL
+        && lisp_heap_get_pointer_array_owners(buffer) != 0
+        && lisp_heap_extend_shared_pointer_array(buffer, (size_t) value->values_offset + (size_t) value->count)) {
         value->values[value->count] = child_to_append;
         value->count++;
         return true;
     }
-    return false;
+    if (!own_children(value, value->count * 2 + 1)) {
+        return false;
+    }
+    // the count of children is never negative
+    size_t count = (size_t) value->count;
+    if (count == lisp_heap_get_pointer_array_capacity(value->values)) {
+        lisp_value_t** new_values = lisp_heap_reserve_pointer_array(value->values, count + 1);
+        if (new_values == NULL) {
+            return false;
+        }
+        value->values = new_values;
+    }
+
+    value->values[value->count] = child_to_append;
+    value->count++;
+    return true;
 }
 
 void lisp_value_set_child(lisp_value_t *value, int index, lisp_value_t *child) {
@@ -615,7 +902,7 @@ void lisp_value_set_child(lisp_value_t *value, int index, lisp_value_t *child) {
 }
 
 lisp_value_t* lisp_value_pop_child(lisp_value_t *value, int index) {
-    if (!should_contain_children(value)) {
+    if (!should_contain_children(value) || !own_children(value, value->count)) {
         return &null_lisp_value;
     }
 
@@ -634,15 +921,7 @@ lisp_value_t* lisp_value_pop_child(lisp_value_t *value, int index) {
         value->count = 0;
     }
 
-    /* reallocate with size that is the first value larger or equal to count which is divisible by 10, for example if
-     * count is 16, the next larger value divisible by 10 is 20
-     *  This is in order to not break the implementation for appending a child to sexpr lisp_value_t*
-     * */
-    lisp_value_t** new_values = realloc(value->values, sizeof(lisp_value_t*) * (value->count + (10 - value->count % 10)));
-    if (new_values == NULL) {
-        return &null_lisp_value;
-    }
-    value->values = new_values;
+    value->values = lisp_heap_shrink_pointer_array(value->values, value->count);
     return popped;
 }
 
@@ -711,9 +990,10 @@ void print_lisp_value(lisp_value_t* lisp_value) {
             }
         break;
         case VAL_STRING:
-            char* escaped_string = malloc(strlen(lisp_value->value_string) + 1);
-            strcpy(escaped_string, lisp_value->value_string);
-            escaped_string = mpcf_escape(escaped_string);
+            char* escaped_string = lisp_string_escape(lisp_value->value_string);
+            if (escaped_string == NULL) {
+                break;
+            }
             printf("\"%s\"", escaped_string);
             free(escaped_string);
             break;
@@ -728,265 +1008,152 @@ void print_lisp_eval_result(lisp_eval_result_t *lisp_eval_result) {
     }
 }
 
-//// evaluate non-destructive implementation
-
-lisp_value_t* add_lisp_values(lisp_value_t* value1, lisp_value_t* value2) {
-    if (value1->value_type == VAL_NUMBER && value2->value_type == VAL_NUMBER) {
-        return lisp_value_number_new(value1->value_number + value2->value_number);
-    }
-    if (value1->value_type == VAL_DECIMAL && value2->value_type == VAL_DECIMAL) {
-        return lisp_value_decimal_new(value1->value_decimal + value2->value_decimal);
-    }
-    if (value1->value_type == VAL_NUMBER && value2->value_type == VAL_DECIMAL) {
-        return lisp_value_decimal_new((double) value1->value_number + value2->value_decimal);
-    }
-    if (value1->value_type == VAL_DECIMAL && value2->value_type == VAL_NUMBER) {
-        return lisp_value_decimal_new(value1->value_decimal + (double) value2->value_number);
-    }
-
-    return lisp_value_error_new(ERR_INCOMPATIBLE_TYPES_MESSAGE);
+void lisp_set_evaluation_engine(lisp_evaluation_engine_t engine) {
+    evaluation_engine = engine;
 }
 
-lisp_value_t* subtract_lisp_values(lisp_value_t* value1, lisp_value_t* value2) {
-    if (value1->value_type == VAL_NUMBER && value2->value_type == VAL_NUMBER) {
-        return lisp_value_number_new(value1->value_number - value2->value_number);
-    }
-    if (value1->value_type == VAL_DECIMAL && value2->value_type == VAL_DECIMAL) {
-        return lisp_value_decimal_new(value1->value_decimal - value2->value_decimal);
-    }
-    if (value1->value_type == VAL_NUMBER && value2->value_type == VAL_DECIMAL) {
-        return lisp_value_decimal_new((double) value1->value_number - value2->value_decimal);
-    }
-    if (value1->value_type == VAL_DECIMAL && value2->value_type == VAL_NUMBER) {
-        return lisp_value_decimal_new(value1->value_decimal - (double) value2->value_number);
-    }
-
-    return lisp_value_error_new(ERR_INCOMPATIBLE_TYPES_MESSAGE);
+lisp_evaluation_engine_t lisp_get_evaluation_engine() {
+    return evaluation_engine;
 }
 
-lisp_value_t* multiply_lisp_values(lisp_value_t* value1, lisp_value_t* value2) {
-    if (value1->value_type == VAL_NUMBER && value2->value_type == VAL_NUMBER) {
-        return lisp_value_number_new(value1->value_number * value2->value_number);
-    }
-    if (value1->value_type == VAL_DECIMAL && value2->value_type == VAL_DECIMAL) {
-        return lisp_value_decimal_new(value1->value_decimal * value2->value_decimal);
-    }
-    if (value1->value_type == VAL_NUMBER && value2->value_type == VAL_DECIMAL) {
-        return lisp_value_decimal_new((double) value1->value_number * value2->value_decimal);
-    }
-    if (value1->value_type == VAL_DECIMAL && value2->value_type == VAL_NUMBER) {
-        return lisp_value_decimal_new(value1->value_decimal * (double) value2->value_number);
-    }
-
-    return lisp_value_error_new(ERR_INCOMPATIBLE_TYPES_MESSAGE);
-}
+//// evaluate non-destructive implementation
 
-lisp_value_t* divide_lisp_values(lisp_value_t* value1, lisp_value_t* value2) {
-    if (value2->value_type == VAL_NUMBER && value2->value_number == 0) {
-        return lisp_value_error_new(ERR_DIV_ZERO_MESSAGE);
-    }
-    if (value2->value_type == VAL_DECIMAL && value2->value_decimal== 0) {
-        return lisp_value_error_new(ERR_DIV_ZERO_MESSAGE);
+/* Evaluates the children of expression(a s-expression, or a q-expression evaluated as a s-expression) without
+ * modifying it, the code is shared and only the results are allocated.
+ * The evaluated children are collected in a new s-expression that is consumed by the call,
+ * the call is in tail position if tail_call is not NULL(see call_function_or_builtin_operation_in_tail_position) */
+lisp_value_t* evaluate_expression(lisp_environment_t* env, lisp_value_t* expression, lisp_tail_call_t* tail_call) {
+    if (expression->count < 1) {
+        return lisp_value_new(expression->value_type == VAL_ROOT ? VAL_ROOT : VAL_SEXPR);
     }
 
-    if (value1->value_type == VAL_NUMBER && value2->value_type == VAL_NUMBER) {
-        return lisp_value_number_new(value1->value_number / value2->value_number);
-    }
-    if (value1->value_type == VAL_DECIMAL && value2->value_type == VAL_DECIMAL) {
-        return lisp_value_decimal_new(value1->value_decimal / value2->value_decimal);
-    }
-    if (value1->value_type == VAL_NUMBER && value2->value_type == VAL_DECIMAL) {
-        return lisp_value_decimal_new((double) value1->value_number / value2->value_decimal);
-    }
-    if (value1->value_type == VAL_DECIMAL && value2->value_type == VAL_NUMBER) {
-        return lisp_value_decimal_new(value1->value_decimal / (double) value2->value_number);
+    if (expression->count == 1) {
+        // the only child is in tail position, the value of the expression is the value of the child
+        lisp_value_t* child = expression->values[0];
+        if (child->value_type == VAL_SEXPR) {
+            return evaluate_expression(env, child, tail_call);
+        }
+        return evaluate_lisp_value(env, child);
     }
 
-    return lisp_value_error_new(ERR_INCOMPATIBLE_TYPES_MESSAGE);
-}
-
-lisp_value_t* division_remainder_lisp_value(lisp_value_t* value1, lisp_value_t* value2) {
-    if (value1->value_type != VAL_NUMBER || value2->value_type != VAL_NUMBER) {
-        return lisp_value_error_new(ERR_INCOMPATIBLE_TYPES_MESSAGE);
+    lisp_value_t* evaluated = lisp_value_sexpr_new();
+    if (evaluated == &null_lisp_value) {
+        return &null_lisp_value;
     }
-    if (value2->value_number == 0) {
-        return lisp_value_error_new(ERR_DIV_ZERO_MESSAGE);
+    for (int i = 0; i < expression->count; i++) {
+        lisp_value_t* child = evaluate_lisp_value(env, expression->values[i]);
+        if (is_lisp_value_error(child) && child->is_error_user_defined_value == 0) {
+            lisp_value_t* error_value = lisp_value_error_new(child->error_message);
+            lisp_value_delete(child);
+            lisp_value_delete(evaluated);
+            return error_value;
+        }
+        if (child == &null_lisp_value || !append_lisp_value(evaluated, child)) {
+            lisp_value_delete(child);
+            lisp_value_delete(evaluated);
+            return &null_lisp_value;
+        }
     }
-
-    return lisp_value_number_new(value1->value_number % value2->value_number);
+    return call_function_or_builtin_operation_in_tail_position(env, evaluated, tail_call);
 }
 
-lisp_value_t* pow_lisp_value(lisp_value_t* value1, lisp_value_t* value2) {
-    if (value1->value_type == VAL_NUMBER && value2->value_type == VAL_NUMBER) {
-        return lisp_value_number_new((long) pow((double) value1->value_number, (double) value2->value_number));
-    }
-    if (value1->value_type == VAL_DECIMAL && value2->value_type == VAL_DECIMAL) {
-        return lisp_value_decimal_new(pow(value1->value_decimal, value2->value_decimal));
-    }
-    if (value1->value_type == VAL_NUMBER && value2->value_type == VAL_DECIMAL) {
-        return lisp_value_decimal_new(pow((double) value1->value_number, value2->value_decimal));
+/**
+ *
+ * @param value to be evaluated, not modified and not consumed
+ * @return evaluated lisp_value, can be error, can be null_lisp_value when out of memory
+ */
+lisp_value_t* evaluate_lisp_value(lisp_environment_t* env, lisp_value_t* value) {
+    if (value->value_type == VAL_SYMBOL) {
+        return lisp_environment_get(env, value);
     }
-    if (value1->value_type == VAL_DECIMAL && value2->value_type == VAL_NUMBER) {
-        return lisp_value_decimal_new(pow( value1->value_decimal, (double) value2->value_number));
+    if (value->value_type == VAL_SEXPR || value->value_type == VAL_ROOT) {
+        return evaluate_expression(env, value, NULL);
     }
-
-    return lisp_value_error_new(ERR_INCOMPATIBLE_TYPES_MESSAGE);
+    return lisp_value_share(value);
 }
 
-lisp_value_t* min_lisp_value(lisp_value_t* value1, lisp_value_t* value2) {
-    if (value1->value_type == VAL_NUMBER && value2->value_type == VAL_NUMBER) {
-        long min = value1->value_number < value2->value_number ? value1->value_number : value2->value_number;
-        return lisp_value_number_new(min);
+/* Evaluates the value with the closure engine, value is not consumed */
+lisp_value_t* evaluate_lisp_value_compiled(lisp_environment_t* env, lisp_value_t* value) {
+    lisp_closure_t* closure = lisp_closure_compile(value);
+    if (closure == NULL) {
+        return evaluate_lisp_value(env, value);
     }
-    if (value1->value_type == VAL_DECIMAL && value2->value_type == VAL_DECIMAL) {
-        double min = value1->value_decimal < value2->value_decimal ? value1->value_decimal : value2->value_decimal;
-        return lisp_value_decimal_new(min);
-    }
-
-    return lisp_value_error_new(ERR_INCOMPATIBLE_TYPES_MESSAGE);
+    lisp_value_t* result = lisp_closure_evaluate(closure, env, NULL);
+    lisp_closure_delete(closure);
+    return result;
 }
 
-lisp_value_t* max_lisp_value(lisp_value_t* value1, lisp_value_t* value2) {
-    if (value1->value_type == VAL_NUMBER && value2->value_type == VAL_NUMBER) {
-        long max = value1->value_number > value2->value_number ? value1->value_number : value2->value_number;
-        return lisp_value_number_new(max);
-    }
-    if (value1->value_type == VAL_DECIMAL && value2->value_type == VAL_DECIMAL) {
-        double max = value1->value_decimal > value2->value_decimal ? value1->value_decimal : value2->value_decimal;
-        return lisp_value_decimal_new(max);
+/* Evaluates the value with the selected engine that does not consume the value */
+lisp_value_t* evaluate_lisp_value_non_destructive(lisp_environment_t* env, lisp_value_t* value) {
+    if (evaluation_engine == EVAL_ENGINE_CLOSURE) {
+        return evaluate_lisp_value_compiled(env, value);
     }
-
-    return lisp_value_error_new(ERR_INCOMPATIBLE_TYPES_MESSAGE);
+    return evaluate_lisp_value(env, value);
 }
 
-lisp_value_t* negate_lisp_value(lisp_value_t* value) {
-    if (value->value_type == VAL_NUMBER) {
-        return lisp_value_number_new(-value->value_number);
-    }
-    if (value->value_type == VAL_DECIMAL) {
-        return lisp_value_decimal_new(-value->value_decimal);
-    }
-
-    return lisp_value_error_new(ERR_INCOMPATIBLE_TYPES_MESSAGE);
+lisp_value_t* evaluate_body_non_destructive(lisp_environment_t* frame, lisp_value_userdefined_fun_t* userdefined_fun, lisp_tail_call_t* tail_call) {
+    return evaluate_expression(frame, userdefined_fun->body, tail_call);
 }
 
-lisp_value_t* execute_binary_operation(char* operation, lisp_value_t* first_operand, lisp_value_t* second_operand) {
-    if (is_lisp_value_error(first_operand)) {
-        return first_operand;
+lisp_value_t* evaluate_body_compiled(lisp_environment_t* frame, lisp_value_userdefined_fun_t* userdefined_fun, lisp_tail_call_t* tail_call) {
+    if (userdefined_fun->closure == NULL) {
+        userdefined_fun->closure = lisp_closure_compile(userdefined_fun->body);
     }
-    if (is_lisp_value_error(second_operand)) {
-        return second_operand;
+    if (userdefined_fun->closure == NULL) {
+        return evaluate_expression(frame, userdefined_fun->body, tail_call);
     }
+    return lisp_closure_evaluate(userdefined_fun->closure, frame, tail_call);
+}
 
-    if (strcmp(operation, BUILTIN_PLUS) == 0) {
-        return add_lisp_values(first_operand, second_operand);
-    }
-    if (strcmp(operation, BUILTIN_MINUS) == 0) {
-        return subtract_lisp_values(first_operand, second_operand);
-    }
-    if (strcmp(operation, BUILTIN_MULTIPLY) == 0) {
-        return multiply_lisp_values(first_operand, second_operand);
-    }
-    if (strcmp(operation, BUILTIN_DIVIDE) == 0) {
-        return divide_lisp_values(first_operand, second_operand);
-    }
-    if (strcmp(operation, BUILTIN_MOD) == 0) {
-        return division_remainder_lisp_value(first_operand, second_operand);
-    }
-    if (strcmp(operation, BUILTIN_POW) == 0) {
-        return pow_lisp_value(first_operand, second_operand);
-    }
-    if (strcmp(operation, BUILTIN_MIN) == 0) {
-        lisp_value_t* min = min_lisp_value(first_operand, second_operand);
-        return min;
-    }
-    if (strcmp(operation, BUILTIN_MAX) == 0) {
-        lisp_value_t* max = max_lisp_value(first_operand, second_operand);
-        return max;
-    }
-    return lisp_value_error_new(ERR_INVALID_OPERATOR_MESSAGE);
-}
-
-lisp_value_t* execute_unary_operation(char* operation, lisp_value_t* operand) {
-    if (is_lisp_value_error(operand)) {
-        return operand;
-    }
-    if (strcmp(operation, "-") == 0) {
-        return negate_lisp_value(operand);
-    }
-    if (operand->value_type == VAL_NUMBER) {
-        return lisp_value_number_new(operand->value_number);
-    }
-    if (operand->value_type == VAL_DECIMAL) {
-        return lisp_value_decimal_new(operand->value_decimal);
-    }
-    if (operand->value_type == VAL_SYMBOL) {
-        return lisp_value_symbol_new(operand->value_symbol);
-    }
-    return lisp_value_error_new(ERR_INVALID_OPERATOR_MESSAGE);
-}
-
-/**
- *
- * @param value to be evaluated, can be null_lisp_value, assume is never NULL
- * @return evaluated lisp_value, can be error, can never be null_lisp_value
+/* Same as call_userdefined_function, the body is evaluated by evaluate_body.
+ * Calls in tail position of the body(directly or through if and eval) are made in this loop(trampoline) instead of
+ * recursively. The frame of the caller is the parent of the frame of the callee, it is dropped when the callee
+ * shadows it(for example a function that calls itself), otherwise it is kept until the loop ends.
  */
-lisp_value_t* evaluate_lisp_value(lisp_value_t* value) {
-    if (value->value_type == VAL_NUMBER) {
-        return lisp_value_number_new(value->value_number);
-    }
-    if (value->value_type == VAL_DECIMAL) {
-        return lisp_value_decimal_new(value->value_decimal);
-    }
-    if (value->value_type == VAL_SYMBOL) {
-        return lisp_value_symbol_new(value->value_symbol);
-    }
-    if (value->value_type == VAL_SEXPR || value->value_type == VAL_ROOT) {
-        if (value->count < 1) {
-            return lisp_value_sexpr_new();
-        }
-
-        if (value->count == 1) {
-            return evaluate_lisp_value(value->values[0]);
-        }
-
-        lisp_value_t* operation = value->values[0];
-        if (operation->value_type != VAL_SYMBOL) {
-            return lisp_value_error_new(ERR_INCOMPATIBLE_TYPES_MESSAGE);
+lisp_value_t* call_userdefined_function_in_trampoline(lisp_environment_t* env, lisp_value_t* function, lisp_value_t* value,
+    lisp_value_t* (*evaluate_body)(lisp_environment_t* frame, lisp_value_userdefined_fun_t* userdefined_fun, lisp_tail_call_t* tail_call)) {
+    function = lisp_value_share(function);
+    lisp_environment_t* parent_env = env;
+    lisp_value_t* result = &null_lisp_value;
+    while (true) {
+        lisp_value_t* native_result = lisp_jit_try_call(parent_env, function, value);
+        if (native_result != NULL) {
+            result = native_result;
+            lisp_value_delete(function);
+            break;
         }
-
-        lisp_value_t* first_operand = evaluate_lisp_value(value->values[1]);
-        if (is_lisp_value_error(first_operand)) {
-            return first_operand;
+        lisp_environment_t* frame = lisp_environment_new_frame(function->value_userdefined_fun, value, &result);
+        if (frame == &null_lisp_environment) {
+            lisp_value_delete(function);
+            break;
         }
+        frame->parent_environment = parent_env;
 
-        if (value->count == 2) {
-            lisp_value_t* result = execute_unary_operation(operation->value_symbol, first_operand);
-            lisp_value_delete(first_operand);
-            return result;
+        lisp_tail_call_t tail_call = {.function = NULL, .arguments = NULL};
+        result = evaluate_body(frame, function->value_userdefined_fun, &tail_call);
+        lisp_value_delete(function);
+        if (tail_call.function == NULL) {
+            lisp_environment_delete(frame);
+            break;
         }
 
-        for (int i = 2; i < value->count; i++) {
-            lisp_value_t* second_operand = evaluate_lisp_value(value->values[i]);
-            if (is_lisp_value_error(second_operand)) {
-                return second_operand;
-            }
-
-            lisp_value_t* next_value = execute_binary_operation(operation->value_symbol, first_operand, second_operand);
-            if (is_lisp_value_error(next_value)) {
-                lisp_value_delete(second_operand);
-                return next_value;
-            }
-
-            lisp_value_delete(second_operand);
-            lisp_value_delete(first_operand);
-            first_operand = next_value;
+        function = tail_call.function;
+        value = tail_call.arguments;
+        if (is_frame_shadowed_by_function(frame, function->value_userdefined_fun)) {
+            parent_env = frame->parent_environment;
+            lisp_environment_delete(frame);
+        } else {
+            parent_env = frame;
         }
-
-        return first_operand;
     }
 
-    return lisp_value_error_new(ERR_INCOMPATIBLE_TYPES_MESSAGE);
+    // the frames that were kept for the lookups of the callees
+    while (parent_env != env) {
+        lisp_environment_t* kept_frame = parent_env;
+        parent_env = kept_frame->parent_environment;
+        lisp_environment_delete(kept_frame);
+    }
+    return result;
 }
 
 lisp_eval_result_t* lisp_eval_result_from_lisp_value(lisp_value_t* value) {
@@ -1026,14 +1193,14 @@ void lisp_eval_result_delete(lisp_eval_result_t* lisp_eval_result) {
 
 /* Evaluates lisp_value_t* in a non-destructive way,
  * meaning, calling this function with the same parameter multiple times should work and evaluate the same as the first call */
-lisp_eval_result_t* evaluate_root_lisp_value(lisp_value_t* value) {
+lisp_eval_result_t* evaluate_root_lisp_value(lisp_environment_t* env, lisp_value_t* value) {
     if (value == &null_lisp_value || value->value_type != VAL_ROOT) {
         return lisp_eval_result_error_new("invalid root lisp value");
     }
 
     /* this code is valid if we treat root as SEXPR */
-    lisp_value_t* evaluated = evaluate_lisp_value(value);
-    return lisp_eval_result_from_lisp_value(evaluated);
+    lisp_value_t* evaluated = evaluate_lisp_value_non_destructive(env, value);
+    return lisp_eval_result_new(evaluated);
 
     /* this code is valid if we don't treat root as SEXPR */
     // lisp_value_t* evaluated = &null_lisp_value;
@@ -1055,67 +1222,55 @@ lisp_eval_result_t* evaluate_root_lisp_value(lisp_value_t* value) {
 
 //// evaluate destructive implementation
 
-lisp_value_t* numeric_op_number(char* operation, long value1, long value2) {
-    if (operation[0] == '+') {
-        return lisp_value_number_new(value1 + value2);
-    }
-    if (operation[0] == '-') {
-        return lisp_value_number_new(value1 - value2);
-    }
-    if (operation[0] == '*') {
-        return lisp_value_number_new(value1 * value2);
-    }
-    if (operation[0] == '/') {
-        if (value2 == 0) {
-            return lisp_value_error_new(ERR_DIV_ZERO_MESSAGE);
-        }
-        return lisp_value_number_new(value1 / value2);
-    }
-    if (operation[0] == '%') {
-        if (value2 == 0) {
-            return lisp_value_error_new(ERR_DIV_ZERO_MESSAGE);
-        }
-        return lisp_value_number_new(value1 % value2);
-    }
-    if (operation[0] == '^') {
-        return lisp_value_number_new((long) pow((double) value1, (double) value2));
-    }
-    if (strcmp(operation, BUILTIN_MIN) == 0) {
-        return lisp_value_number_new(value1 < value2 ? value1 : value2);
-    }
-    if (strcmp(operation, BUILTIN_MAX) == 0) {
-        return lisp_value_number_new(value1 > value2 ? value1 : value2);
+lisp_value_t* numeric_op_number(numeric_operation_t operation, long value1, long value2) {
+    switch (operation) {
+        case NUMERIC_OP_ADD:
+            return lisp_value_number_new(value1 + value2);
+        case NUMERIC_OP_SUBTRACT:
+            return lisp_value_number_new(value1 - value2);
+        case NUMERIC_OP_MULTIPLY:
+            return lisp_value_number_new(value1 * value2);
+        case NUMERIC_OP_DIVIDE:
+            if (value2 == 0) {
+                return lisp_value_error_new(ERR_DIV_ZERO_MESSAGE);
+            }
+            return lisp_value_number_new(value1 / value2);
+        case NUMERIC_OP_MOD:
+            if (value2 == 0) {
+                return lisp_value_error_new(ERR_DIV_ZERO_MESSAGE);
+            }
+            return lisp_value_number_new(value1 % value2);
+        case NUMERIC_OP_POW:
+            return lisp_value_number_new((long) pow((double) value1, (double) value2));
+        case NUMERIC_OP_MIN:
+            return lisp_value_number_new(value1 < value2 ? value1 : value2);
+        case NUMERIC_OP_MAX:
+            return lisp_value_number_new(value1 > value2 ? value1 : value2);
     }
     return lisp_value_error_new(ERR_INVALID_OPERATOR_MESSAGE);
 }
 
-lisp_value_t* numeric_op_decimal(char* operation, double value1, double value2) {
-    if (operation[0] == '+') {
-        return lisp_value_decimal_new(value1 + value2);
-    }
-    if (operation[0] == '-') {
-        return lisp_value_decimal_new(value1 - value2);
-    }
-    if (operation[0] == '*') {
-        return lisp_value_decimal_new(value1 * value2);
-    }
-    if (operation[0] == '/') {
-        if (value2 == 0) {
-            return lisp_value_error_new(ERR_DIV_ZERO_MESSAGE);
-        }
-        return lisp_value_decimal_new(value1 / value2);
-    }
-    if (operation[0] == '%') {
-        return lisp_value_error_new(ERR_INCOMPATIBLE_TYPES_MESSAGE);
-    }
-    if (operation[0] == '^') {
-        return lisp_value_decimal_new(pow(value1, value2));
-    }
-    if (strcmp(operation, BUILTIN_MIN) == 0) {
-        return lisp_value_decimal_new(value1 < value2 ? value1 : value2);
-    }
-    if (strcmp(operation, BUILTIN_MAX) == 0) {
-        return lisp_value_decimal_new(value1 > value2 ? value1 : value2);
+lisp_value_t* numeric_op_decimal(numeric_operation_t operation, double value1, double value2) {
+    switch (operation) {
+        case NUMERIC_OP_ADD:
+            return lisp_value_decimal_new(value1 + value2);
+        case NUMERIC_OP_SUBTRACT:
+            return lisp_value_decimal_new(value1 - value2);
+        case NUMERIC_OP_MULTIPLY:
+            return lisp_value_decimal_new(value1 * value2);
+        case NUMERIC_OP_DIVIDE:
+            if (value2 == 0) {
+                return lisp_value_error_new(ERR_DIV_ZERO_MESSAGE);
+            }
+            return lisp_value_decimal_new(value1 / value2);
+        case NUMERIC_OP_MOD:
+            return lisp_value_error_new(ERR_INCOMPATIBLE_TYPES_MESSAGE);
+        case NUMERIC_OP_POW:
+            return lisp_value_decimal_new(pow(value1, value2));
+        case NUMERIC_OP_MIN:
+            return lisp_value_decimal_new(value1 < value2 ? value1 : value2);
+        case NUMERIC_OP_MAX:
+            return lisp_value_decimal_new(value1 > value2 ? value1 : value2);
     }
     return lisp_value_error_new(ERR_INVALID_OPERATOR_MESSAGE);
 }
@@ -1139,19 +1294,11 @@ lisp_value_t* builtin_head(lisp_value_t* arguments) {
     ASSERT_ARGUMENTS_REPRESENT_ONE_QEXPR(arguments, BUILTIN_HEAD);
 
     lisp_value_t* qexpr = lisp_value_pop_child(arguments, 0);
-
-    lisp_value_t* head = lisp_value_qexpr_new();
-    if (qexpr->count > 0) {
-        bool ok = append_lisp_value(head, lisp_value_pop_child(qexpr, 0));
-        if (!ok) {
-            lisp_value_delete(head);
-            head = &null_lisp_value;
-        }
-    }
-
     lisp_value_delete(arguments);
-    lisp_value_delete(qexpr);
-    return head;
+    if (qexpr->count < 1) {
+        return qexpr;
+    }
+    return lisp_value_slice(qexpr, 0, 1);
 }
 
 lisp_value_t* builtin_tail(lisp_value_t* arguments) {
@@ -1159,15 +1306,11 @@ lisp_value_t* builtin_tail(lisp_value_t* arguments) {
 
     lisp_value_t* qexpr = lisp_value_pop_child(arguments, 0);
 
+    lisp_value_delete(arguments);
     if (qexpr->count < 1) {
-        lisp_value_delete(arguments);
         return qexpr;
     }
-
-    lisp_value_t* head = lisp_value_pop_child(qexpr, 0);
-    lisp_value_delete(head);
-    lisp_value_delete(arguments);
-    return qexpr;
+    return lisp_value_slice(qexpr, 1, qexpr->count - 1);
 }
 
 lisp_value_t* builtin_join(lisp_value_t* arguments) {
@@ -1180,11 +1323,16 @@ lisp_value_t* builtin_join(lisp_value_t* arguments) {
     }
 
     lisp_value_t* result = lisp_value_pop_child(arguments, 0);
+    if (arguments->count > 0 && result->reference_count != 1) {
+        // a slice of the first Q-expression, the Q-expressions are appended to the buffer they share when possible
+        result = lisp_value_slice(result, 0, result->count);
+    }
     while (arguments->count > 0) {
         lisp_value_t* current_qexpr = lisp_value_pop_child(arguments, 0);
-        while (current_qexpr->count > 0) {
-            bool ok = append_lisp_value(result, lisp_value_pop_child(current_qexpr, 0));
+        for (long i = 0; i < current_qexpr->count; i++) {
+            bool ok = append_lisp_value(result, lisp_value_share(current_qexpr->values[i]));
             if (!ok) {
+                lisp_value_delete(current_qexpr);
                 lisp_value_delete(result);
                 lisp_value_delete(arguments);
                 return &null_lisp_value;
@@ -1198,11 +1346,19 @@ lisp_value_t* builtin_join(lisp_value_t* arguments) {
 }
 
 // TODO: change to accept one qexpr instead of a container of one qexpr
-lisp_value_t* builtin_eval(lisp_environment_t* env, lisp_value_t* arguments) {
+/* tail_call is NULL, or the evaluation is in tail position(see call_function_or_builtin_operation_in_tail_position) */
+lisp_value_t* builtin_eval(lisp_environment_t* env, lisp_value_t* arguments, lisp_tail_call_t* tail_call) {
     ASSERT_ARGUMENTS_REPRESENT_ONE_QEXPR(arguments, BUILTIN_EVAL);
     lisp_value_t* qexpr = lisp_value_pop_child(arguments, 0);
-    qexpr->value_type = VAL_SEXPR;
-    lisp_value_t* result = evaluate_lisp_value_destructive(env, qexpr);
+    lisp_value_t* result = &null_lisp_value;
+    if (evaluation_engine != EVAL_ENGINE_DESTRUCTIVE) {
+        result = evaluate_expression(env, qexpr, tail_call);
+        lisp_value_delete(qexpr);
+    } else {
+        qexpr = lisp_value_unshare(qexpr);
+        qexpr->value_type = VAL_SEXPR;
+        result = evaluate_lisp_value_in_tail_position(env, qexpr, tail_call);
+    }
     lisp_value_delete(arguments);
     return result;
 }
@@ -1235,12 +1391,11 @@ lisp_value_t* builtin_cons(lisp_value_t* arguments) {
         return &null_lisp_value;
     }
 
-    while (existing_qexpr->count > 0) {
-        ok = append_lisp_value(result_qexpr, lisp_value_pop_child(existing_qexpr, 0));
+    for (long i = 0; i < existing_qexpr->count; i++) {
+        ok = append_lisp_value(result_qexpr, lisp_value_share(existing_qexpr->values[i]));
         if (!ok) {
             lisp_value_delete(result_qexpr);
             lisp_value_delete(existing_qexpr);
-            lisp_value_delete(value_to_cons);
             lisp_value_delete(arguments);
             return &null_lisp_value;
         }
@@ -1253,8 +1408,7 @@ lisp_value_t* builtin_cons(lisp_value_t* arguments) {
 
 lisp_value_t* builtin_len(lisp_value_t* arguments) {
     ASSERT_ARGUMENTS_REPRESENT_ONE_QEXPR(arguments, BUILTIN_LEN);
-    lisp_value_t* qexpr = lisp_value_pop_child(arguments, 0);
-    lisp_value_t* result = lisp_value_number_new(qexpr->count);
+    lisp_value_t* result = lisp_value_number_new(arguments->values[0]->count);
     lisp_value_delete(arguments);
     return result;
 }
@@ -1262,12 +1416,11 @@ lisp_value_t* builtin_len(lisp_value_t* arguments) {
 lisp_value_t* builtin_init(lisp_value_t* arguments) {
     ASSERT_ARGUMENTS_REPRESENT_ONE_QEXPR(arguments, BUILTIN_INIT);
     lisp_value_t* qexpr = lisp_value_pop_child(arguments, 0);
+    lisp_value_delete(arguments);
     if (qexpr->count < 1) {
         return qexpr;
     }
-    lisp_value_t* last_child = lisp_value_pop_child(qexpr, qexpr->count - 1);
-    lisp_value_delete(last_child);
-    return qexpr;
+    return lisp_value_slice(qexpr, 0, qexpr->count - 1);
 }
 
 lisp_value_t* builtin_def(lisp_environment_t* env, lisp_value_t* arguments) {
@@ -1312,18 +1465,14 @@ lisp_value_t* lisp_environment_put_variables(lisp_environment_t* env, lisp_value
             lisp_value_delete(arguments);
             return error;
         }
-        // TODO: maybe change this a bit? We are checking if we are trying to overwrite a builtin
-        //  maybe change it to be more efficient(i.e do not use lisp_environment_get since it copes and the copied value
-        //  needs to be freed
-        lisp_value_t* value = lisp_environment_get(env, qexpr_of_symbols->values[i]);
-        if (value->value_type == VAL_BUILTIN_FUN) {
+        // we are only checking if we are trying to overwrite a builtin, so a borrowed value is enough
+        lisp_value_t* value = lisp_environment_get_borrowed(env, qexpr_of_symbols->values[i]);
+        if (value != &null_lisp_value && value->value_type == VAL_BUILTIN_FUN) {
             lisp_value_t* error = lisp_value_error_new(ERR_NOT_ALLOWED_TO_REDEFINE_BUILTIN_FUN_MESSAGE_TEMPLATE, value->value_symbol);
-            lisp_value_delete(value);
             lisp_value_delete(qexpr_of_symbols);
             lisp_value_delete(arguments);
             return error;
         }
-        lisp_value_delete(value);
         lisp_environment_set(env, qexpr_of_symbols->values[i], arguments->values[i]);
     }
 
@@ -1345,16 +1494,13 @@ lisp_value_t * builtin_create_function(lisp_environment_t * env, lisp_value_t *
         return lisp_value_error_new("error defining function");
     }
 
-    lisp_value_t* userdefined_function = lisp_value_userdefined_fun_new(
-        env,
-        lisp_value_copy(value->values[0]),
-        lisp_value_copy(value->values[1])
-        );
+    lisp_value_t* formal_arguments = lisp_value_pop_child(value, 0);
+    lisp_value_t* body = lisp_value_pop_child(value, 0);
     lisp_value_delete(value);
-    return userdefined_function;
+    return lisp_value_userdefined_fun_new(env, formal_arguments, body);
 }
 
-lisp_value_t* builtin_operation_for_numeric_arguments(char* operation, lisp_value_t* arguments) {
+lisp_value_t* builtin_operation_for_numeric_arguments(char* operation, numeric_operation_t numeric_operation, lisp_value_t* arguments) {
     if (arguments->count < 1) {
         lisp_value_t* error = lisp_value_error_new(ERR_AT_LEAST_ONE_ARGUMENT_EXPECTED_MESSAGE_TEMPLATE, operation);
         lisp_value_delete(arguments);
@@ -1378,7 +1524,7 @@ lisp_value_t* builtin_operation_for_numeric_arguments(char* operation, lisp_valu
         }
 
         // min and max should return non-error if all numeric values are only of one type
-        if (strcmp(operation, BUILTIN_MIN) == 0 || strcmp(operation, BUILTIN_MAX) == 0) {
+        if (numeric_operation == NUMERIC_OP_MIN || numeric_operation == NUMERIC_OP_MAX) {
             if ((is_prev_decimal && arguments->values[i]->value_type == VAL_NUMBER)|| (!is_prev_decimal && arguments->values[i]->value_type == VAL_DECIMAL)) {
                 lisp_value_delete(arguments);
                 return lisp_value_error_new(ERR_INCOMPATIBLE_TYPES_MESSAGE);
@@ -1397,14 +1543,14 @@ lisp_value_t* builtin_operation_for_numeric_arguments(char* operation, lisp_valu
         long number = arguments->values[i]->value_type == VAL_NUMBER ? arguments->values[i]->value_number : (long) arguments->values[i]->value_decimal;
         double number_decimal = arguments->values[i]->value_type == VAL_DECIMAL ? arguments->values[i]->value_decimal : (double) arguments->values[i]->value_number;
 
-        lisp_value_t* r = numeric_op_number(operation, result_number, number);
+        lisp_value_t* r = numeric_op_number(numeric_operation, result_number, number);
         if (!should_return_decimal && is_lisp_value_error(r)) {
             lisp_value_delete(arguments);
             return r;
         }
         result_number = r->value_number;
 
-        lisp_value_t* r1 = numeric_op_decimal(operation, result_decimal, number_decimal);
+        lisp_value_t* r1 = numeric_op_decimal(numeric_operation, result_decimal, number_decimal);
         if (should_return_decimal && is_lisp_value_error(r1)) {
             lisp_value_delete(r);
             lisp_value_delete(arguments);
@@ -1416,7 +1562,7 @@ lisp_value_t* builtin_operation_for_numeric_arguments(char* operation, lisp_valu
         lisp_value_delete(r);
     }
 
-    if (operation[0] == '-' && arguments->count == 1) {
+    if (numeric_operation == NUMERIC_OP_SUBTRACT && arguments->count == 1) {
         result_number = -result_number;
         result_decimal = -result_decimal;
     }
@@ -1428,7 +1574,7 @@ lisp_value_t* builtin_operation_for_numeric_arguments(char* operation, lisp_valu
     return lisp_value_number_new(result_number);
 }
 
-lisp_value_t* builtin_ordering_operation_for_numeric_arguments(char* operation, lisp_value_t* arguments) {
+lisp_value_t* builtin_ordering_operation_for_numeric_arguments(char* operation, ordering_operation_t ordering_operation, lisp_value_t* arguments) {
     if (arguments->count != 2) {
         lisp_value_t* error = lisp_value_error_new(ERR_AT_EXACTLY_N_ARGUMENT_EXPECTED_MESSAGE_TEMPLATE, 2, operation);
         lisp_value_delete(arguments);
@@ -1448,25 +1594,25 @@ lisp_value_t* builtin_ordering_operation_for_numeric_arguments(char* operation,
     lisp_value_type_t numeric_type = arguments->values[0]->value_type;
 
     int r = 0;
-    if (strcmp(operation, ">") == 0) {
+    if (ordering_operation == ORDERING_OP_GT) {
         if (numeric_type == VAL_NUMBER) {
             r = arguments->values[0]->value_number > arguments->values[1]->value_number;
         } else {
             r = arguments->values[0]->value_decimal > arguments->values[1]->value_decimal;
         }
-    } else if (strcmp(operation, ">=") == 0) {
+    } else if (ordering_operation == ORDERING_OP_GE) {
         if (numeric_type == VAL_NUMBER) {
             r = arguments->values[0]->value_number >= arguments->values[1]->value_number;
         } else {
             r = arguments->values[0]->value_decimal >= arguments->values[1]->value_decimal;
         }
-    } else if (strcmp(operation, "<") == 0) {
+    } else if (ordering_operation == ORDERING_OP_LT) {
         if (numeric_type == VAL_NUMBER) {
             r = arguments->values[0]->value_number < arguments->values[1]->value_number;
         } else {
             r = arguments->values[0]->value_decimal < arguments->values[1]->value_decimal;
         }
-    } else if (strcmp(operation, "<=") == 0) {
+    } else if (ordering_operation == ORDERING_OP_LE) {
         if (numeric_type == VAL_NUMBER) {
             r = arguments->values[0]->value_number <= arguments->values[1]->value_number;
         } else {
@@ -1478,7 +1624,7 @@ lisp_value_t* builtin_ordering_operation_for_numeric_arguments(char* operation,
     return lisp_value_number_new(r);
 }
 
-lisp_value_t* builtin_eq(char* operation, lisp_value_t* arguments) {
+lisp_value_t* builtin_eq(char* operation, bool is_not_equal, lisp_value_t* arguments) {
     if (arguments->count != 2) {
         lisp_value_t* error = lisp_value_error_new(ERR_AT_EXACTLY_N_ARGUMENT_EXPECTED_MESSAGE_TEMPLATE, 2, operation);
         lisp_value_delete(arguments);
@@ -1489,7 +1635,7 @@ lisp_value_t* builtin_eq(char* operation, lisp_value_t* arguments) {
 
     int r = lisp_value_equals(first, second);
 
-    if (strcmp(operation, "!=") == 0) {
+    if (is_not_equal) {
         r = !r;
     }
     lisp_value_delete(arguments);
@@ -1513,19 +1659,19 @@ lisp_value_t * builtin_def_fun(lisp_environment_t * env, lisp_value_t * value) {
         return lisp_value_error_new("error defining function");
     }
 
-    lisp_value_t* function_name_symbol = lisp_value_pop_child(value->values[0], 0);
+    lisp_value_t* formal_arguments = lisp_value_unshare(lisp_value_pop_child(value, 0));
+    lisp_value_t* body = lisp_value_pop_child(value, 0);
+    lisp_value_delete(value);
+
+    lisp_value_t* function_name_symbol = lisp_value_pop_child(formal_arguments, 0);
     if (function_name_symbol->value_type != VAL_SYMBOL) {
-        lisp_value_delete(value);
+        lisp_value_delete(function_name_symbol);
+        lisp_value_delete(formal_arguments);
+        lisp_value_delete(body);
         return lisp_value_error_new("error defining function");
     }
 
-    lisp_value_t* function = lisp_value_userdefined_fun_new(
-        env,
-        lisp_value_copy(value->values[0]),
-        lisp_value_copy(value->values[1])
-        );
-
-    lisp_value_delete(value);
+    lisp_value_t* function = lisp_value_userdefined_fun_new(env, formal_arguments, body);
 
     lisp_value_t* def_arguments = lisp_value_sexpr_new();
     if (def_arguments == &null_lisp_value) {
@@ -1547,7 +1693,8 @@ lisp_value_t * builtin_def_fun(lisp_environment_t * env, lisp_value_t * value) {
     return builtin_def(env, def_arguments);
 }
 
-lisp_value_t* builtin_if(lisp_environment_t* env, lisp_value_t* value) {
+/* tail_call is NULL, or the evaluation is in tail position(see call_function_or_builtin_operation_in_tail_position) */
+lisp_value_t* builtin_if(lisp_environment_t* env, lisp_value_t* value, lisp_tail_call_t* tail_call) {
     if (value->count != 3) {
         lisp_value_delete(value);
         return lisp_value_error_new("if: required 3 arguments");
@@ -1567,23 +1714,17 @@ lisp_value_t* builtin_if(lisp_environment_t* env, lisp_value_t* value) {
 
     lisp_value_t* container_for_evaluation = lisp_value_qexpr_new();
     if (value->values[0]->value_number == 0) {
-        append_lisp_value(container_for_evaluation, value->values[2]);
-        // builtin_eval will destroy the body, so to ignore double free, we set the reference to &null_lisp_value
-        // if we don't want to do this, we could pop this child
-        value->values[2] = &null_lisp_value;
+        append_lisp_value(container_for_evaluation, lisp_value_pop_child(value, 2));
     } else {
-        append_lisp_value(container_for_evaluation, value->values[1]);
-        // builtin_eval will destroy the body, so to ignore double free, we set the reference to &null_lisp_value
-        // if we don't want to do this, we could pop this child
-        value->values[1] = &null_lisp_value;
+        append_lisp_value(container_for_evaluation, lisp_value_pop_child(value, 1));
     }
-    lisp_value_t* result = builtin_eval(env, container_for_evaluation);
+    lisp_value_t* result = builtin_eval(env, container_for_evaluation, tail_call);
     lisp_value_delete(value);
     return result;
 }
 
-lisp_value_t* builtin_logical_operation(char* operation, lisp_value_t* arguments) {
-    if (strcmp(operation, BUILTIN_NOT) == 0 || strcmp(operation, BUILTIN_NOT_NOT) == 0) {
+lisp_value_t* builtin_logical_operation(char* operation, logical_operation_t logical_operation, lisp_value_t* arguments) {
+    if (logical_operation == LOGICAL_OP_NOT) {
         if (arguments->count != 1) {
             lisp_value_t* error = lisp_value_error_new(ERR_INVALID_NUMBER_OF_ARGUMENTS_MESSAGE_TEMPLATE, operation, 1, arguments->count);
             lisp_value_delete(arguments);
@@ -1594,9 +1735,7 @@ lisp_value_t* builtin_logical_operation(char* operation, lisp_value_t* arguments
             lisp_value_delete(arguments);
             return error;
         }
-        lisp_value_t* result = lisp_value_pop_child(arguments, 0);
-        result->value_type = VAL_BOOLEAN;
-        result->value_number = !result->value_number;
+        lisp_value_t* result = lisp_value_boolean_new(!arguments->values[0]->value_number);
         lisp_value_delete(arguments);
         return result;
     } else {
@@ -1605,16 +1744,14 @@ lisp_value_t* builtin_logical_operation(char* operation, lisp_value_t* arguments
             lisp_value_delete(arguments);
             return error;
         }
-        int r = strcmp(operation, BUILTIN_AND) == 0 || strcmp(operation, BUILTIN_AND_AND) == 0
-        ? 1
-        : 0;
+        int r = logical_operation == LOGICAL_OP_AND ? 1 : 0;
         for (size_t i = 0; i < arguments->count; i++) {
             if (arguments->values[i]->value_type != VAL_NUMBER && arguments->values[i]->value_type != VAL_BOOLEAN) {
                 lisp_value_t* error = lisp_value_error_new(ERR_INCOMPATIBLE_TYPES_MESSAGE_TEMPLATE, 1, operation, get_value_type_string(VAL_NUMBER), get_value_type_string(arguments->values[0]->value_type));
                 lisp_value_delete(arguments);
                 return error;
             }
-            if (strcmp(operation, BUILTIN_AND) == 0 || strcmp(operation, BUILTIN_AND_AND) == 0) {
+            if (logical_operation == LOGICAL_OP_AND) {
                 r = r && arguments->values[i]->value_number;
                 if (r == 0) {
                     break;
@@ -1631,6 +1768,21 @@ lisp_value_t* builtin_logical_operation(char* operation, lisp_value_t* arguments
     }
 }
 
+void evaluate_loaded_lisp_value(lisp_environment_t* root_env, lisp_value_t* value) {
+    lisp_value_t* evaluated = &null_lisp_value;
+    if (evaluation_engine != EVAL_ENGINE_DESTRUCTIVE) {
+        evaluated = evaluate_lisp_value_non_destructive(root_env, value);
+        lisp_value_delete(value);
+    } else {
+        evaluated = evaluate_lisp_value_destructive(root_env, value);
+    }
+    if (evaluated->value_type == VAL_ERR) {
+        print_lisp_value(evaluated);
+        putchar('\n');
+    }
+    lisp_value_delete(evaluated);
+}
+
 lisp_value_t* builtin_load(char* operation, lisp_environment_t* env, lisp_value_t* arguments) {
     if (arguments->count != 1) {
         lisp_value_t* error = lisp_value_error_new(ERR_INVALID_NUMBER_OF_ARGUMENTS_MESSAGE_TEMPLATE, operation, 1, arguments->count);
@@ -1648,31 +1800,24 @@ lisp_value_t* builtin_load(char* operation, lisp_environment_t* env, lisp_value_
         root_env = root_env->parent_environment;
     }
 
-    mpc_result_t parse_result;
-    if (parse_contents(arguments->values[0]->value_string, &parse_result)) {
-        lisp_value_t* loaded_lisp_expressions = parse_lisp_value(parse_result.output);
-        if (loaded_lisp_expressions->value_type == VAL_ROOT) {
-            while (loaded_lisp_expressions->count > 0) {
-                lisp_value_t* lisp_value = lisp_value_pop_child(loaded_lisp_expressions, 0);
-                lisp_value_t* evaluated = evaluate_lisp_value_destructive(root_env, lisp_value);
-                if (evaluated->value_type == VAL_ERR) {
-                    print_lisp_value(evaluated);
-                    putchar('\n');
-                }
-                lisp_value_delete(evaluated);
-            }
-        }
-        lisp_value_delete(loaded_lisp_expressions);
-        mpc_ast_delete(parse_result.output);
-    } else {
-        lisp_value_t* error = lisp_value_error_new(mpc_err_string(parse_result.error));
-        lisp_value_delete(arguments);
-        mpc_err_delete(parse_result.error);
-        return error;
+    // every expression is evaluated as soon as it is read, the expressions before a syntax error are evaluated
+    lisp_reader_t* reader = lisp_reader_new_file(arguments->values[0]->value_string);
+    lisp_value_delete(arguments);
+    if (reader == NULL) {
+        return &null_lisp_value;
+    }
+    lisp_value_t* expression = NULL;
+    while ((expression = lisp_reader_next(reader)) != NULL && expression != &null_lisp_value) {
+        evaluate_loaded_lisp_value(root_env, expression);
     }
 
-    lisp_value_delete(arguments);
-    return lisp_value_sexpr_new();
+    lisp_value_t* result = expression;
+    if (result == NULL) {
+        lisp_value_t* error = lisp_reader_get_error(reader);
+        result = error != NULL ? lisp_value_share(error) : lisp_value_sexpr_new();
+    }
+    lisp_reader_delete(reader);
+    return result;
 }
 
 lisp_value_t* builtin_print(lisp_value_t* arguments) {
@@ -1712,214 +1857,386 @@ lisp_value_t* builtin_error(lisp_value_t* arguments) {
     return error_value;
 }
 
-/* Assumes value is sexpr of one operator(builtin fun) and at least one operand and all operands are previously evaluated */
-lisp_value_t* builtin_operation(lisp_environment_t* env, lisp_value_t* value) {
-    lisp_value_t* operation = lisp_value_pop_child(value, 0);
-    if (operation == &null_lisp_value) {
-        lisp_value_delete(value);
-        return &null_lisp_value;
+bool append_lisp_value_heap_stat(lisp_value_t* stats, char* name, size_t value) {
+    lisp_value_t* stat = lisp_value_qexpr_new();
+    if (stat == &null_lisp_value) {
+        return false;
     }
-    if (operation->value_type != VAL_BUILTIN_FUN) {
-        lisp_value_delete(operation);
-        lisp_value_delete(value);
-        return lisp_value_error_new(ERR_INVALID_OPERATOR_MESSAGE);
+    lisp_value_t* name_value = lisp_value_new(VAL_STRING);
+    if (name_value == NULL) {
+        lisp_value_delete(stat);
+        return false;
     }
-
-    if (strpbrk(operation->value_symbol, "+-*/^%") != NULL
-        || strcmp(operation->value_symbol, BUILTIN_MIN) == 0 || strcmp(operation->value_symbol, BUILTIN_MAX) == 0) {
-        lisp_value_t* result = builtin_operation_for_numeric_arguments(operation->value_symbol, value);
-        lisp_value_delete(operation);
-        return result;
+    name_value->value_string = malloc(strlen(name) + 1);
+    if (name_value->value_string == NULL) {
+        lisp_value_delete(name_value);
+        lisp_value_delete(stat);
+        return false;
     }
-
-    if (strcmp(operation->value_symbol, BUILTIN_GT) == 0
-        || strcmp(operation->value_symbol, BUILTIN_LT) == 0
-        || strcmp(operation->value_symbol, BUILTIN_GE) == 0
-        || strcmp(operation->value_symbol, BUILTIN_LE) == 0) {
-        lisp_value_t* result = builtin_ordering_operation_for_numeric_arguments(operation->value_symbol, value);
-        lisp_value_delete(operation);
-        return result;
+    strcpy(name_value->value_string, name);
+    bool ok = append_lisp_value(stat, name_value);
+    ok = ok && append_lisp_value(stat, lisp_value_number_new((long) value));
+    ok = ok && append_lisp_value(stats, stat);
+    if (!ok) {
+        lisp_value_delete(stat);
     }
+    return ok;
+}
 
-    if (strcmp(operation->value_symbol, BUILTIN_EQ) == 0 || strcmp(operation->value_symbol, BUILTIN_NE) == 0) {
-        lisp_value_t* result = builtin_eq(operation->value_symbol, value);
-        lisp_value_delete(operation);
-        return result;
+/* Returns the statistics of the heap as q-expression of {name value} pairs, the arguments are ignored
+ * (a builtin alone in a s-expression evaluates to itself, so call it with any argument, for example (heap-stats ())) */
+lisp_value_t* builtin_heap_stats(lisp_value_t* arguments) {
+    lisp_value_delete(arguments);
+    lisp_heap_stats_t heap_stats = lisp_heap_get_stats();
+    lisp_value_t* stats = lisp_value_qexpr_new();
+    if (stats == &null_lisp_value) {
+        return &null_lisp_value;
     }
-
-    if (strcmp(operation->value_symbol, BUILTIN_LIST) == 0) {
-        value->value_type = VAL_QEXPR;
-        lisp_value_delete(operation);
-        return value;
+    bool ok = append_lisp_value_heap_stat(stats, "live", heap_stats.live);
+    ok = ok && append_lisp_value_heap_stat(stats, "free", heap_stats.free);
+    ok = ok && append_lisp_value_heap_stat(stats, "peak-live", heap_stats.peak_live);
+    ok = ok && append_lisp_value_heap_stat(stats, "chunks", heap_stats.chunks);
+    ok = ok && append_lisp_value_heap_stat(stats, "allocations", heap_stats.allocations);
+    ok = ok && append_lisp_value_heap_stat(stats, "trims", heap_stats.trims);
+    ok = ok && append_lisp_value_heap_stat(stats, "released-chunks", heap_stats.released_chunks);
+    if (!ok) {
+        lisp_value_delete(stats);
+        return &null_lisp_value;
     }
+    return stats;
+}
 
-    if (strcmp(operation->value_symbol, BUILTIN_HEAD) == 0) {
-        lisp_value_t* result = builtin_head(value);
-        lisp_value_delete(operation);
-        return result;
-    }
+lisp_value_t* builtin_fun_plus([[maybe_unused]] lisp_environment_t* env, char* name, lisp_value_t* arguments) {
+    return builtin_operation_for_numeric_arguments(name, NUMERIC_OP_ADD, arguments);
+}
 
-    if (strcmp(operation->value_symbol, BUILTIN_TAIL) == 0) {
-        lisp_value_t* result = builtin_tail(value);
-        lisp_value_delete(operation);
-        return result;
-    }
+lisp_value_t* builtin_fun_minus([[maybe_unused]] lisp_environment_t* env, char* name, lisp_value_t* arguments) {
+    return builtin_operation_for_numeric_arguments(name, NUMERIC_OP_SUBTRACT, arguments);
+}
 
-    if (strcmp(operation->value_symbol, BUILTIN_JOIN) == 0) {
-        lisp_value_t* result = builtin_join(value);
-        lisp_value_delete(operation);
-        return result;
-    }
+lisp_value_t* builtin_fun_multiply([[maybe_unused]] lisp_environment_t* env, char* name, lisp_value_t* arguments) {
+    return builtin_operation_for_numeric_arguments(name, NUMERIC_OP_MULTIPLY, arguments);
+}
 
-    if (strcmp(operation->value_symbol, BUILTIN_EVAL) == 0) {
-        lisp_value_t* result = builtin_eval(env, value);
-        lisp_value_delete(operation);
-        return result;
-    }
+lisp_value_t* builtin_fun_divide([[maybe_unused]] lisp_environment_t* env, char* name, lisp_value_t* arguments) {
+    return builtin_operation_for_numeric_arguments(name, NUMERIC_OP_DIVIDE, arguments);
+}
 
-    if (strcmp(operation->value_symbol, BUILTIN_CONS) == 0) {
-        lisp_value_t* result = builtin_cons(value);
-        lisp_value_delete(operation);
-        return result;
-    }
+lisp_value_t* builtin_fun_mod([[maybe_unused]] lisp_environment_t* env, char* name, lisp_value_t* arguments) {
+    return builtin_operation_for_numeric_arguments(name, NUMERIC_OP_MOD, arguments);
+}
 
-    if (strcmp(operation->value_symbol, BUILTIN_LEN) == 0) {
-        lisp_value_t* result = builtin_len(value);
-        lisp_value_delete(operation);
-        return result;
-    }
+lisp_value_t* builtin_fun_pow([[maybe_unused]] lisp_environment_t* env, char* name, lisp_value_t* arguments) {
+    return builtin_operation_for_numeric_arguments(name, NUMERIC_OP_POW, arguments);
+}
 
-    if (strcmp(operation->value_symbol, BUILTIN_INIT) == 0) {
-        lisp_value_t* result = builtin_init(value);
-        lisp_value_delete(operation);
-        return result;
-    }
+lisp_value_t* builtin_fun_min([[maybe_unused]] lisp_environment_t* env, char* name, lisp_value_t* arguments) {
+    return builtin_operation_for_numeric_arguments(name, NUMERIC_OP_MIN, arguments);
+}
 
-    if (strcmp(operation->value_symbol, BUILTIN_DEF) == 0) {
-        lisp_value_t* result = builtin_def(env, value);
-        lisp_value_delete(operation);
-        return result;
-    }
+lisp_value_t* builtin_fun_max([[maybe_unused]] lisp_environment_t* env, char* name, lisp_value_t* arguments) {
+    return builtin_operation_for_numeric_arguments(name, NUMERIC_OP_MAX, arguments);
+}
 
-    if (strcmp(operation->value_symbol, BUILTIN_LOCAL_DEF) == 0) {
-        lisp_value_t* result = builtin_local_def(env, value);
-        lisp_value_delete(operation);
-        return result;
-    }
+lisp_value_t* builtin_fun_gt([[maybe_unused]] lisp_environment_t* env, char* name, lisp_value_t* arguments) {
+    return builtin_ordering_operation_for_numeric_arguments(name, ORDERING_OP_GT, arguments);
+}
 
-    if (strcmp(operation->value_symbol, BUILTIN_CREATE_FUNCTION) == 0) {
-        lisp_value_t* result = builtin_create_function(env, value);
-        lisp_value_delete(operation);
-        return result;
-    }
+lisp_value_t* builtin_fun_ge([[maybe_unused]] lisp_environment_t* env, char* name, lisp_value_t* arguments) {
+    return builtin_ordering_operation_for_numeric_arguments(name, ORDERING_OP_GE, arguments);
+}
 
-    if (strcmp(operation->value_symbol, BUILTIN_DEF_FUN) == 0) {
-        lisp_value_t* result = builtin_def_fun(env, value);
-        lisp_value_delete(operation);
-        return result;
-    }
+lisp_value_t* builtin_fun_lt([[maybe_unused]] lisp_environment_t* env, char* name, lisp_value_t* arguments) {
+    return builtin_ordering_operation_for_numeric_arguments(name, ORDERING_OP_LT, arguments);
+}
 
-    if (strcmp(operation->value_symbol, BUILTIN_IF) == 0) {
-        lisp_value_t* result = builtin_if(env, value);
-        lisp_value_delete(operation);
-        return result;
-    }
+lisp_value_t* builtin_fun_le([[maybe_unused]] lisp_environment_t* env, char* name, lisp_value_t* arguments) {
+    return builtin_ordering_operation_for_numeric_arguments(name, ORDERING_OP_LE, arguments);
+}
 
-    if (strcmp(operation->value_symbol, BUILTIN_OR) == 0 || strcmp(operation->value_symbol, BUILTIN_OR_OR) == 0
-        || strcmp(operation->value_symbol, BUILTIN_AND) == 0 || strcmp(operation->value_symbol, BUILTIN_AND_AND) == 0
-        || strcmp(operation->value_symbol, BUILTIN_NOT) == 0 || strcmp(operation->value_symbol, BUILTIN_NOT_NOT) == 0) {
-        lisp_value_t* result = builtin_logical_operation(operation->value_symbol, value);
-        lisp_value_delete(operation);
-        return result;
-    }
+lisp_value_t* builtin_fun_eq([[maybe_unused]] lisp_environment_t* env, char* name, lisp_value_t* arguments) {
+    return builtin_eq(name, false, arguments);
+}
 
-    if (strcmp(operation->value_symbol, BUILTIN_LOAD) == 0) {
-        lisp_value_t* result = builtin_load(operation->value_symbol, env, value);
-        lisp_value_delete(operation);
-        return result;
+lisp_value_t* builtin_fun_ne([[maybe_unused]] lisp_environment_t* env, char* name, lisp_value_t* arguments) {
+    return builtin_eq(name, true, arguments);
+}
+
+lisp_value_t* builtin_fun_or([[maybe_unused]] lisp_environment_t* env, char* name, lisp_value_t* arguments) {
+    return builtin_logical_operation(name, LOGICAL_OP_OR, arguments);
+}
+
+lisp_value_t* builtin_fun_and([[maybe_unused]] lisp_environment_t* env, char* name, lisp_value_t* arguments) {
+    return builtin_logical_operation(name, LOGICAL_OP_AND, arguments);
+}
+
+lisp_value_t* builtin_fun_not([[maybe_unused]] lisp_environment_t* env, char* name, lisp_value_t* arguments) {
+    return builtin_logical_operation(name, LOGICAL_OP_NOT, arguments);
+}
+
+lisp_value_t* builtin_fun_list([[maybe_unused]] lisp_environment_t* env, [[maybe_unused]] char* name, lisp_value_t* arguments) {
+    arguments->value_type = VAL_QEXPR;
+    return arguments;
+}
+
+lisp_value_t* builtin_fun_head([[maybe_unused]] lisp_environment_t* env, [[maybe_unused]] char* name, lisp_value_t* arguments) {
+    return builtin_head(arguments);
+}
+
+lisp_value_t* builtin_fun_tail([[maybe_unused]] lisp_environment_t* env, [[maybe_unused]] char* name, lisp_value_t* arguments) {
+    return builtin_tail(arguments);
+}
+
+lisp_value_t* builtin_fun_join([[maybe_unused]] lisp_environment_t* env, [[maybe_unused]] char* name, lisp_value_t* arguments) {
+    return builtin_join(arguments);
+}
+
+lisp_value_t* builtin_fun_eval(lisp_environment_t* env, [[maybe_unused]] char* name, lisp_value_t* arguments) {
+    return builtin_eval(env, arguments, NULL);
+}
+
+lisp_value_t* builtin_fun_cons([[maybe_unused]] lisp_environment_t* env, [[maybe_unused]] char* name, lisp_value_t* arguments) {
+    return builtin_cons(arguments);
+}
+
+lisp_value_t* builtin_fun_len([[maybe_unused]] lisp_environment_t* env, [[maybe_unused]] char* name, lisp_value_t* arguments) {
+    return builtin_len(arguments);
+}
+
+lisp_value_t* builtin_fun_init([[maybe_unused]] lisp_environment_t* env, [[maybe_unused]] char* name, lisp_value_t* arguments) {
+    return builtin_init(arguments);
+}
+
+lisp_value_t* builtin_fun_def(lisp_environment_t* env, [[maybe_unused]] char* name, lisp_value_t* arguments) {
+    return builtin_def(env, arguments);
+}
+
+lisp_value_t* builtin_fun_local_def(lisp_environment_t* env, [[maybe_unused]] char* name, lisp_value_t* arguments) {
+    return builtin_local_def(env, arguments);
+}
+
+lisp_value_t* builtin_fun_create_function(lisp_environment_t* env, [[maybe_unused]] char* name, lisp_value_t* arguments) {
+    return builtin_create_function(env, arguments);
+}
+
+lisp_value_t* builtin_fun_def_fun(lisp_environment_t* env, [[maybe_unused]] char* name, lisp_value_t* arguments) {
+    return builtin_def_fun(env, arguments);
+}
+
+lisp_value_t* builtin_fun_if(lisp_environment_t* env, [[maybe_unused]] char* name, lisp_value_t* arguments) {
+    return builtin_if(env, arguments, NULL);
+}
+
+lisp_value_t* builtin_fun_load(lisp_environment_t* env, char* name, lisp_value_t* arguments) {
+    return builtin_load(name, env, arguments);
+}
+
+lisp_value_t* builtin_fun_print([[maybe_unused]] lisp_environment_t* env, [[maybe_unused]] char* name, lisp_value_t* arguments) {
+    return builtin_print(arguments);
+}
+
+lisp_value_t* builtin_fun_error([[maybe_unused]] lisp_environment_t* env, [[maybe_unused]] char* name, lisp_value_t* arguments) {
+    return builtin_error(arguments);
+}
+
+lisp_value_t* builtin_fun_heap_stats([[maybe_unused]] lisp_environment_t* env, [[maybe_unused]] char* name, lisp_value_t* arguments) {
+    return builtin_heap_stats(arguments);
+}
+
+/* Assumes value is sexpr of the operands of the operation and all operands are previously evaluated
+ * The operation(builtin fun) is borrowed, it is not deleted by this function.
+ * The function pointer of the builtin is resolved when the builtin is registered, so dispatch is a single call */
+lisp_value_t* builtin_operation(lisp_environment_t* env, lisp_value_t* operation, lisp_value_t* value) {
+    if (operation->value_type != VAL_BUILTIN_FUN || operation->value_builtin_fun == NULL) {
+        lisp_value_delete(value);
+        return lisp_value_error_new(ERR_INVALID_OPERATOR_MESSAGE);
     }
+    return operation->value_builtin_fun(env, operation->value_symbol, value);
+}
 
-    if (strcmp(operation->value_symbol, BUILTIN_PRINT) == 0) {
-        lisp_value_t* result = builtin_print(value);
-        lisp_value_delete(operation);
-        return result;
+/* Binds the arguments in the sexpr value to a new environment(frame) of the function, value is consumed.
+ * The frame contains the arguments bound so far(local_env of the function) and the new arguments.
+ * If the function can not be evaluated yet(partial application) or binding fails, result is set to the partially applied
+ * function or the error and null_lisp_environment is returned */
+lisp_environment_t* lisp_environment_new_frame(lisp_value_userdefined_fun_t* userdefined_fun, lisp_value_t* value, lisp_value_t** result) {
+    lisp_value_t* formal_arguments = userdefined_fun->formal_arguments;
+    size_t argument_values_count = value->count;
+    size_t argument_symbols_count = formal_arguments->count;
+    if (argument_values_count > argument_symbols_count && userdefined_fun->varargs_symbol == &null_lisp_value) {
+        lisp_value_delete(value);
+        // TODO: move this (and others cases similar to this) to a constant
+        *result = lisp_value_error_new("error evaluating function");
+        return &null_lisp_environment;
     }
 
-    if (strcmp(operation->value_symbol, BUILTIN_ERROR) == 0) {
-        lisp_value_t* result = builtin_error(value);
-        lisp_value_delete(operation);
-        return result;
+    size_t frame_capacity = argument_symbols_count + (userdefined_fun->varargs_symbol != &null_lisp_value ? 1 : 0);
+    lisp_environment_t* frame = lisp_environment_copy_with_capacity(userdefined_fun->local_env, frame_capacity);
+    if (frame == &null_lisp_environment) {
+        lisp_value_delete(value);
+        *result = &null_lisp_value;
+        return &null_lisp_environment;
     }
 
-    lisp_value_delete(operation);
-    lisp_value_delete(value);
-    return lisp_value_error_new(ERR_INVALID_OPERATOR_MESSAGE);
-}
+    // bind arguments
+    size_t min_size = argument_values_count < argument_symbols_count ? argument_values_count : argument_symbols_count;
+    for (size_t i = 0; i < min_size; i++) {
+        lisp_value_t* argument_value = lisp_value_pop_child(value, 0);
+        lisp_environment_set_owned(frame, formal_arguments->values[i], argument_value);
+    }
 
-lisp_value_t* call_function_or_builtin_operation(lisp_environment_t* env, lisp_value_t* value) {
-    lisp_value_t* operation = value->values[0];
-    if (operation->value_type == VAL_BUILTIN_FUN) {
-        return builtin_operation(env, value);
-    } else if (operation->value_type == VAL_USERDEFINED_FUN) {
-        // bind arguments
-        lisp_value_t* function = lisp_value_pop_child(value, 0);
-        lisp_value_t* formal_arguments = function->value_userdefined_fun->formal_arguments;
-        size_t argument_values_count = value->count;
-        size_t argument_symbols_count = formal_arguments->count;
-        if (argument_values_count > argument_symbols_count && function->value_userdefined_fun->varargs_symbol == &null_lisp_value) {
-            lisp_value_delete(function);
-            lisp_value_delete(value);
-            // TODO: move this (and others cases similar to this) to a constant
-            return lisp_value_error_new("error evaluating function");
+    if (argument_values_count < argument_symbols_count) {
+        // partial application, the result is a new function that has the rest of formal arguments
+        lisp_value_delete(value);
+        *result = &null_lisp_value;
+        lisp_value_t* partially_applied = lisp_value_new(VAL_USERDEFINED_FUN);
+        if (partially_applied == NULL) {
+            lisp_environment_delete(frame);
+            return &null_lisp_environment;
         }
-
-        size_t min_size = argument_values_count < argument_symbols_count ? argument_values_count : argument_symbols_count;
-        for (size_t i = 0; i < min_size; i++) {
-            lisp_value_t* argument_symbol = lisp_value_pop_child(formal_arguments, 0);
-            lisp_value_t* argument_value = lisp_value_pop_child(value, 0);
-            lisp_environment_set(function->value_userdefined_fun->local_env, argument_symbol, argument_value);
-            lisp_value_delete(argument_symbol);
+        partially_applied->value_userdefined_fun = lisp_heap_allocate_userdefined_fun();
+        if (partially_applied->value_userdefined_fun == NULL) {
+            lisp_environment_delete(frame);
+            lisp_value_delete(partially_applied);
+            return &null_lisp_environment;
         }
-
-        if (argument_values_count < argument_symbols_count) {
-            lisp_value_delete(value);
-            return function;
+        partially_applied->value_userdefined_fun->local_env = frame;
+        partially_applied->value_userdefined_fun->formal_arguments = lisp_value_qexpr_new();
+        partially_applied->value_userdefined_fun->varargs_symbol = lisp_value_share(userdefined_fun->varargs_symbol);
+        partially_applied->value_userdefined_fun->body = lisp_value_share(userdefined_fun->body);
+        partially_applied->value_userdefined_fun->bytecode = lisp_bytecode_share(userdefined_fun->bytecode);
+        partially_applied->value_userdefined_fun->closure = lisp_closure_share(userdefined_fun->closure);
+        partially_applied->value_userdefined_fun->call_count = 0;
+        partially_applied->value_userdefined_fun->jit_code = NULL;
+        bool ok = partially_applied->value_userdefined_fun->formal_arguments != &null_lisp_value
+            && partially_applied->value_userdefined_fun->body != &null_lisp_value;
+        for (size_t i = min_size; ok && i < argument_symbols_count; i++) {
+            ok = append_lisp_value(partially_applied->value_userdefined_fun->formal_arguments, lisp_value_share(formal_arguments->values[i]));
         }
-
-        if (function->value_userdefined_fun->varargs_symbol != &null_lisp_value) {
-            lisp_value_t* varargs_qexpr = lisp_value_new(VAL_QEXPR);
-            while (value->count > 0) {
-                append_lisp_value(varargs_qexpr, lisp_value_pop_child(value, 0));
-            }
-            lisp_environment_set(function->value_userdefined_fun->local_env, function->value_userdefined_fun->varargs_symbol, varargs_qexpr);
+        if (!ok) {
+            lisp_value_delete(partially_applied);
+            return &null_lisp_environment;
         }
+        *result = partially_applied;
+        return &null_lisp_environment;
+    }
 
-        function->value_userdefined_fun->local_env->parent_environment = env;
+    if (userdefined_fun->varargs_symbol != &null_lisp_value) {
+        lisp_value_t* varargs_qexpr = lisp_value_new(VAL_QEXPR);
+        while (value->count > 0) {
+            append_lisp_value(varargs_qexpr, lisp_value_pop_child(value, 0));
+        }
+        lisp_environment_set_owned(frame, userdefined_fun->varargs_symbol, varargs_qexpr);
+    }
+    lisp_value_delete(value);
+    return frame;
+}
+
+/* A frame is shadowed by the next function if the frame of the next function binds every symbol that the frame binds,
+ * nothing can be looked up in the frame from the frame of the next function then */
+bool is_frame_shadowed_by_function(lisp_environment_t* frame, lisp_value_userdefined_fun_t* userdefined_fun) {
+    for (size_t i = 0; i < frame->count; i++) {
+        char* symbol = frame->symbols[i];
+        size_t position = 0;
+        bool is_bound = userdefined_fun->varargs_symbol != &null_lisp_value && userdefined_fun->varargs_symbol->value_symbol == symbol;
+        for (long j = 0; !is_bound && j < userdefined_fun->formal_arguments->count; j++) {
+            is_bound = userdefined_fun->formal_arguments->values[j]->value_symbol == symbol;
+        }
+        if (!is_bound && !lisp_environment_find_position(userdefined_fun->local_env, symbol, &position)) {
+            return false;
+        }
+    }
+    return true;
+}
 
-        lisp_value_t* container_of_body = lisp_value_new(VAL_QEXPR);
-        append_lisp_value(container_of_body, function->value_userdefined_fun->body);
-        lisp_value_t* result = builtin_eval(function->value_userdefined_fun->local_env, container_of_body);
-        // builtin_eval will destroy the body, so to ignore double free, we set the reference to &null_lisp_value
-        // if we don't want to do this, we could copy the body
-        function->value_userdefined_fun->body = &null_lisp_value;
-        lisp_value_delete(function);
+/* Calls the userdefined function with the arguments in the sexpr value(the function itself is not part of value)
+ * The function is not modified and not deleted, it can be shared with the environment.
+ * A new environment(frame) is created for every call that contains the arguments bound so far and the body is evaluated
+ * in it, so the cost of calling does not depend on the size of the environment the function is defined in.
+ * With the destructive engine the calls that the body makes to other userdefined functions are made by the virtual
+ * machine on its own stack(see lisp_vm_call), only the calls made by builtins(like eval or map) use native stack.
+ * The other engines evaluate the calls that are not in tail position recursively on the native stack, the calls made
+ * here are limited by the size of the native stack(see lisp_vm_enter_native_call), not by the evaluation stack budget.
+ */
+lisp_value_t* call_userdefined_function(lisp_environment_t* env, lisp_value_t* function, lisp_value_t* value) {
+    if (!lisp_vm_enter_native_call()) {
         lisp_value_delete(value);
-        return result;
+        return lisp_vm_stack_overflow_error_new();
+    }
+    lisp_value_t* result = NULL;
+    if (evaluation_engine == EVAL_ENGINE_NON_DESTRUCTIVE) {
+        result = call_userdefined_function_in_trampoline(env, function, value, evaluate_body_non_destructive);
+    } else if (evaluation_engine == EVAL_ENGINE_CLOSURE) {
+        result = call_userdefined_function_in_trampoline(env, function, value, evaluate_body_compiled);
+    } else {
+        result = lisp_vm_call(env, function, value);
+    }
+    lisp_vm_leave_native_call();
+    return result;
+}
+
+/* Assumes value is sexpr with at least two children where the first child is the evaluated operator
+ * If tail_call is not NULL, the call is in tail position: a call of a userdefined function is not made but returned
+ * in tail_call(the result is null_lisp_value then), if and eval pass tail_call to the evaluation they do */
+lisp_value_t* call_function_or_builtin_operation_in_tail_position(lisp_environment_t* env, lisp_value_t* value, lisp_tail_call_t* tail_call) {
+    lisp_value_t* operation = lisp_value_pop_child(value, 0);
+    lisp_value_t* result = &null_lisp_value;
+    if (operation->value_type == VAL_BUILTIN_FUN) {
+        if (tail_call != NULL && operation->value_builtin_fun == builtin_fun_if) {
+            result = builtin_if(env, value, tail_call);
+        } else if (tail_call != NULL && operation->value_builtin_fun == builtin_fun_eval) {
+            result = builtin_eval(env, value, tail_call);
+        } else {
+            result = builtin_operation(env, operation, value);
+        }
+    } else if (operation->value_type == VAL_USERDEFINED_FUN) {
+        if (tail_call != NULL) {
+            tail_call->function = operation;
+            tail_call->arguments = value;
+            return &null_lisp_value;
+        }
+        result = call_userdefined_function(env, operation, value);
     } else {
         lisp_value_delete(value);
-        return lisp_value_error_new(ERR_INVALID_OPERATOR_MESSAGE);
+        result = lisp_value_error_new(ERR_INVALID_OPERATOR_MESSAGE);
     }
+    lisp_value_delete(operation);
+    return result;
+}
+
+lisp_value_t* call_function_or_builtin_operation(lisp_environment_t* env, lisp_value_t* value) {
+    return call_function_or_builtin_operation_in_tail_position(env, value, NULL);
 }
 
+/* Ownership model of the destructive evaluation:
+ *  * the evaluated value is owned by the evaluation and is consumed by it, the result is owned by the caller
+ *  * values in the environment are shared with the evaluation(see lisp_environment_get), so the evaluation unshares
+ *    an expression before it replaces its children with the evaluated ones
+ */
 lisp_value_t* evaluate_lisp_value_destructive(lisp_environment_t *env, lisp_value_t* value) {
+    return evaluate_lisp_value_in_tail_position(env, value, NULL);
+}
+
+/* Same as evaluate_lisp_value_destructive, the call that the evaluation ends with is in tail position
+ * (see call_function_or_builtin_operation_in_tail_position) */
+lisp_value_t* evaluate_lisp_value_in_tail_position(lisp_environment_t* env, lisp_value_t* value, lisp_tail_call_t* tail_call) {
     if (value->value_type == VAL_SYMBOL) {
         lisp_value_t* result = lisp_environment_get(env, value);
         lisp_value_delete(value);
         return result;
     }
     if (value->value_type == VAL_SEXPR || value->value_type == VAL_ROOT) {
+        value = lisp_value_unshare(value);
+        if (value == &null_lisp_value) {
+            return &null_lisp_value;
+        }
         for (int i = 0; i < value->count; i++) {
-            lisp_value_set_child(value, i, evaluate_lisp_value_destructive(env, value->values[i]));
+            // the only child is in tail position, the value of the s-expression is the value of the child
+            lisp_tail_call_t* child_tail_call = value->count == 1 ? tail_call : NULL;
+            lisp_value_set_child(value, i, evaluate_lisp_value_in_tail_position(env, value->values[i], child_tail_call));
+            if (child_tail_call != NULL && child_tail_call->function != NULL) {
+                lisp_value_delete(value);
+                return &null_lisp_value;
+            }
             if (is_lisp_value_error(value->values[i]) && value->values[i]->is_error_user_defined_value == 0) {
                 lisp_value_t* error_value = lisp_value_error_new(value->values[i]->error_message);
                 lisp_value_delete(value);
@@ -1940,7 +2257,7 @@ lisp_value_t* evaluate_lisp_value_destructive(lisp_environment_t *env, lisp_valu
             lisp_value_delete(value);
             return evaluated_child;
         }
-        return call_function_or_builtin_operation(env, value);
+        return call_function_or_builtin_operation_in_tail_position(env, value, tail_call);
     }
 
     return value;
@@ -1965,15 +2282,74 @@ lisp_eval_result_t* evaluate_root_lisp_value_destructive(lisp_environment_t* env
 
 //// end evaluate destructive implementation
 
+void lisp_environment_insert_into_index(lisp_environment_t* env, size_t position) {
+    size_t mask = env->index_capacity - 1;
+    size_t slot = lisp_symbol_hash(env->symbols[position]) & mask;
+    while (env->index[slot] != 0) {
+        slot = (slot + 1) & mask;
+    }
+    env->index[slot] = position + 1;
+}
+
+/* If the index can not be allocated the environment is left without index and is searched linearly */
+void lisp_environment_rebuild_index(lisp_environment_t* env, size_t capacity) {
+    free(env->index);
+    env->index = calloc(capacity, sizeof(size_t));
+    env->index_capacity = env->index == NULL ? 0 : capacity;
+    if (env->index == NULL) {
+        return;
+    }
+    for (size_t i = 0; i < env->count; i++) {
+        lisp_environment_insert_into_index(env, i);
+    }
+}
+
+/* The index is kept at most half full */
+void lisp_environment_add_to_index(lisp_environment_t* env, size_t position) {
+    if (env->index == NULL) {
+        if (env->count > ENVIRONMENT_INDEX_MIN_COUNT) {
+            lisp_environment_rebuild_index(env, ENVIRONMENT_INDEX_INITIAL_CAPACITY);
+        }
+    } else if (env->count * 2 > env->index_capacity) {
+        lisp_environment_rebuild_index(env, env->index_capacity * 2);
+    } else {
+        lisp_environment_insert_into_index(env, position);
+    }
+}
+
+/* symbol must be interned, symbols are compared by pointer */
+bool lisp_environment_find_position(lisp_environment_t* env, char* symbol, size_t* position) {
+    if (env->index == NULL) {
+        for (size_t i = 0; i < env->count; i++) {
+            if (symbol == env->symbols[i]) {
+                *position = i;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    size_t mask = env->index_capacity - 1;
+    for (size_t slot = lisp_symbol_hash(symbol) & mask; env->index[slot] != 0; slot = (slot + 1) & mask) {
+        if (symbol == env->symbols[env->index[slot] - 1]) {
+            *position = env->index[slot] - 1;
+            return true;
+        }
+    }
+    return false;
+}
+
 lisp_environment_t * lisp_environment_new() {
-    lisp_environment_t* env = malloc(sizeof(lisp_environment_t));
+    lisp_environment_t* env = lisp_heap_allocate_environment();
     if (env == NULL) {
         return &null_lisp_environment;
     }
 
     env->count = 0;
-    env->symbols = malloc(sizeof(char*) * 10);
-    env->values = malloc(sizeof(lisp_value_t*) * 10);
+    env->index = NULL;
+    env->index_capacity = 0;
+    env->symbols = lisp_heap_allocate_pointer_array(0);
+    env->values = lisp_heap_allocate_pointer_array(0);
     if (env->symbols == NULL || env->values == NULL) {
         lisp_environment_delete(env);
         return &null_lisp_environment;
@@ -1997,39 +2373,36 @@ lisp_environment_t* lisp_environment_new_with_parent(lisp_environment_t* parent_
 }
 
 lisp_environment_t* lisp_environment_copy(lisp_environment_t* env) {
+    return lisp_environment_copy_with_capacity(env, 0);
+}
+
+/* Copies the environment with room for extra_capacity more bindings */
+lisp_environment_t* lisp_environment_copy_with_capacity(lisp_environment_t* env, size_t extra_capacity) {
     if (env == &null_lisp_environment) {
         return &null_lisp_environment;
     }
 
-    lisp_environment_t* copy = malloc(sizeof(lisp_environment_t));
+    lisp_environment_t* copy = lisp_heap_allocate_environment();
     if (copy == NULL) {
         return &null_lisp_environment;
     }
 
-    copy->count = env->count;
-    /**
-     * Set malloc size to the next larger value divisible by 10,
-     * for example, if count is 16, the next larger value divisible by 10 is 20
-     * This is in order to not break the implementation for appending a child to sexpr lisp_value_t*
-     */
-    copy->symbols = malloc(sizeof(char*) * (env->count + (10 - env->count % 10)));
-    copy->values = malloc(sizeof(lisp_value_t*) * (env->count + (10 - env->count % 10)));
+    copy->count = 0;
+    copy->index = NULL;
+    copy->index_capacity = 0;
+    copy->symbols = lisp_heap_allocate_pointer_array(env->count + extra_capacity);
+    copy->values = lisp_heap_allocate_pointer_array(env->count + extra_capacity);
     if (copy->symbols == NULL || copy->values == NULL) {
         lisp_environment_delete(copy);
         return &null_lisp_environment;
     }
     for (size_t i = 0; i < env->count; i++) {
-        copy->symbols[i] = malloc(strlen(env->symbols[i]) + 1);
-        if (copy->symbols[i] == NULL) {
-            lisp_environment_delete(copy);
-            return &null_lisp_environment;
-        }
-        strcpy(copy->symbols[i], env->symbols[i]);
-        copy->values[i] = lisp_value_copy(env->values[i]);
-        if (copy->values[i] == &null_lisp_value && env->values[i] != &null_lisp_value) {
-            lisp_environment_delete(copy);
-            return &null_lisp_environment;
-        }
+        copy->symbols[i] = env->symbols[i];
+        copy->values[i] = lisp_value_share(env->values[i]);
+        copy->count++;
+    }
+    if (env->index != NULL) {
+        lisp_environment_rebuild_index(copy, env->index_capacity);
     }
     copy->parent_environment = env->parent_environment;
     return copy;
@@ -2040,122 +2413,123 @@ void lisp_environment_delete(lisp_environment_t *env) {
         return;
     }
 
-    if (env->symbols != NULL) {
-        for (size_t i = 0; i < env->count; i++) {
-            free(env->symbols[i]);
-        }
-    }
-
     if (env->values != NULL) {
         for (size_t i = 0; i < env->count; i++) {
             lisp_value_delete(env->values[i]);
         }
     }
 
-    free(env->symbols);
-    free(env->values);
-    free(env);
+    free(env->index);
+    lisp_heap_free_pointer_array(env->symbols);
+    lisp_heap_free_pointer_array(env->values);
+    lisp_heap_free_environment(env);
 }
 
-bool lisp_environment_set(lisp_environment_t* env, lisp_value_t *symbol, lisp_value_t *value) {
-    if (env == &null_lisp_environment) {
-        return false;
-    }
-    if (symbol == &null_lisp_value) {
+/* Binds the value to the symbol, the environment takes ownership of the value.
+ * If binding fails, the value is deleted */
+bool lisp_environment_set_owned(lisp_environment_t* env, lisp_value_t *symbol, lisp_value_t *value) {
+    if (env == &null_lisp_environment || symbol == &null_lisp_value) {
+        lisp_value_delete(value);
         return false;
     }
 
-    for (size_t i = 0; i < env->count; i++) {
-        if (strcmp(symbol->value_symbol, env->symbols[i]) == 0) {
-            lisp_value_delete(env->values[i]);
-            env->values[i] = lisp_value_copy(value);
-            return true;
-        }
+    size_t position = 0;
+    if (lisp_environment_find_position(env, symbol->value_symbol, &position)) {
+        lisp_value_delete(env->values[position]);
+        env->values[position] = value;
+        return true;
     }
 
     bool ok = true;
-    char** symbols_new = env->symbols;
-    lisp_value_t** values_new = env->values;
-    if (env->count > 0 && env->count % 10 == 0) {
-        if (ok) {
-            symbols_new = realloc(env->symbols, sizeof(char*) * (env->count + 10));
-            if (symbols_new == NULL) {
-                ok = false;
-            }
+    if (env->count == lisp_heap_get_pointer_array_capacity(env->symbols)) {
+        char** symbols_new = lisp_heap_reserve_pointer_array(env->symbols, env->count + 1);
+        if (symbols_new == NULL) {
+            ok = false;
+        } else {
+            env->symbols = symbols_new;
         }
-
-        if (ok) {
-            values_new = realloc(env->values, sizeof(lisp_value_t*) * (env->count + 10));
-            if (values_new == NULL) {
-                ok = false;
-            }
+    }
+    if (ok && env->count == lisp_heap_get_pointer_array_capacity(env->values)) {
+        lisp_value_t** values_new = lisp_heap_reserve_pointer_array(env->values, env->count + 1);
+        if (values_new == NULL) {
+            ok = false;
+        } else {
+            env->values = values_new;
         }
     }
 
     if (ok) {
-        env->symbols = symbols_new;
-        env->values = values_new;
-
-        env->symbols[env->count] = malloc(strlen(symbol->value_symbol) + 1);
-        if (env->symbols[env->count] != NULL) {
-            strcpy(env->symbols[env->count], symbol->value_symbol);
-            env->values[env->count] = lisp_value_copy(value);
-            env->count++;
-            return true;
-        }
+        env->symbols[env->count] = symbol->value_symbol;
+        env->values[env->count] = value;
+        env->count++;
+        lisp_environment_add_to_index(env, env->count - 1);
+        return true;
     }
 
+    lisp_value_delete(value);
     return false;
 }
 
-lisp_value_t* lisp_environment_get(lisp_environment_t* env, lisp_value_t *symbol) {
-    if (env == &null_lisp_environment) {
-        return &null_lisp_value;
-    }
+/* Binds the value to the symbol, the value is shared between the caller and the environment */
+bool lisp_environment_set(lisp_environment_t* env, lisp_value_t *symbol, lisp_value_t *value) {
+    return lisp_environment_set_owned(env, symbol, lisp_value_share(value));
+}
+
+lisp_value_t* lisp_environment_get_borrowed(lisp_environment_t* env, lisp_value_t *symbol) {
     if (symbol == &null_lisp_value) {
         return &null_lisp_value;
     }
-    if (env == &lisp_environment_referenced_by_root_environment) {
-        return lisp_value_error_new(ERR_UNBOUND_SYMBOL_MESSAGE);
-    }
 
+    // the slot hint is checked only in the innermost environment, it is the frame of the function being evaluated
+    long slot = symbol->value_type == VAL_SYMBOL ? symbol->symbol_slot_hint : -1;
+    if (slot >= 0 && env != &null_lisp_environment && (size_t) slot < env->count && env->symbols[slot] == symbol->value_symbol) {
+        return env->values[slot];
+    }
 
-    lisp_value_t* result = &null_lisp_value;
-    for (size_t i = 0; i < env->count; i++) {
-        if (strcmp(symbol->value_symbol, env->symbols[i]) == 0) {
-            result = lisp_value_copy(env->values[i]);
-            break;
+    while (env != &null_lisp_environment && env != &lisp_environment_referenced_by_root_environment) {
+        size_t position = 0;
+        if (lisp_environment_find_position(env, symbol->value_symbol, &position)) {
+            return env->values[position];
         }
+        env = env->parent_environment;
+    }
+
+    return &null_lisp_value;
+}
+
+lisp_value_t* lisp_environment_get(lisp_environment_t* env, lisp_value_t *symbol) {
+    if (env == &null_lisp_environment) {
+        return &null_lisp_value;
+    }
+    if (symbol == &null_lisp_value) {
+        return &null_lisp_value;
     }
 
+    lisp_value_t* result = lisp_environment_get_borrowed(env, symbol);
     if (result == &null_lisp_value) {
-        return lisp_environment_get(env->parent_environment, symbol);
+        return lisp_value_error_new(ERR_UNBOUND_SYMBOL_MESSAGE);
     }
 
-    return result;
+    return lisp_value_share(result);
 }
 
 bool lisp_environment_exists(lisp_environment_t* env, char* symbol_str) {
     lisp_value_t* symbol = lisp_value_symbol_new(symbol_str);
-    lisp_value_t* result = lisp_environment_get(env, symbol);
+    lisp_value_t* result = lisp_environment_get_borrowed(env, symbol);
     lisp_value_delete(symbol);
-
-    if (result == &null_lisp_value) {
-        return false;
-    }
-    if (result->value_type == VAL_ERR && strcmp(result->error_message, ERR_UNBOUND_SYMBOL_MESSAGE) == 0) {
-        return false;
-    }
-    return true;
+    return result != &null_lisp_value;
 }
 
 bool is_lisp_environment_null(lisp_environment_t *env) {
     return env == &null_lisp_environment;
 }
 
-bool lisp_environment_setup_builtin_function(lisp_environment_t* env, char* symbol) {
-    lisp_value_t* symbol_lisp_value = lisp_value_symbol_new(symbol);
-    lisp_value_t* builtin_fun_lisp_value = lisp_value_builtin_fun_new(symbol);
+bool lisp_environment_register_builtin_function(lisp_environment_t* env, char* name, lisp_builtin_fun_t builtin_fun) {
+    if (env == &null_lisp_environment || builtin_fun == NULL) {
+        return false;
+    }
+    lisp_value_t* symbol_lisp_value = lisp_value_symbol_new(name);
+    lisp_value_t* builtin_fun_lisp_value = lisp_value_builtin_fun_new(name, builtin_fun);
     bool ok = lisp_environment_set(env, symbol_lisp_value, builtin_fun_lisp_value);
     lisp_value_delete(symbol_lisp_value);
     lisp_value_delete(builtin_fun_lisp_value);
@@ -2168,42 +2542,43 @@ bool lisp_environment_setup_builtin_functions(lisp_environment_t *env) {
     }
 
     bool ok = true;
-    ok = ok && lisp_environment_setup_builtin_function(env, BUILTIN_PLUS);
-    ok = ok && lisp_environment_setup_builtin_function(env, BUILTIN_MINUS);
-    ok = ok && lisp_environment_setup_builtin_function(env, BUILTIN_MULTIPLY);
-    ok = ok && lisp_environment_setup_builtin_function(env, BUILTIN_DIVIDE);
-    ok = ok && lisp_environment_setup_builtin_function(env, BUILTIN_MOD);
-    ok = ok && lisp_environment_setup_builtin_function(env, BUILTIN_POW);
-    ok = ok && lisp_environment_setup_builtin_function(env, BUILTIN_MIN);
-    ok = ok && lisp_environment_setup_builtin_function(env, BUILTIN_MAX);
-    ok = ok && lisp_environment_setup_builtin_function(env, BUILTIN_LIST);
-    ok = ok && lisp_environment_setup_builtin_function(env, BUILTIN_HEAD);
-    ok = ok && lisp_environment_setup_builtin_function(env, BUILTIN_TAIL);
-    ok = ok && lisp_environment_setup_builtin_function(env, BUILTIN_JOIN);
-    ok = ok && lisp_environment_setup_builtin_function(env, BUILTIN_EVAL);
-    ok = ok && lisp_environment_setup_builtin_function(env, BUILTIN_CONS);
-    ok = ok && lisp_environment_setup_builtin_function(env, BUILTIN_LEN);
-    ok = ok && lisp_environment_setup_builtin_function(env, BUILTIN_INIT);
-    ok = ok && lisp_environment_setup_builtin_function(env, BUILTIN_DEF);
-    ok = ok && lisp_environment_setup_builtin_function(env, BUILTIN_LOCAL_DEF);
-    ok = ok && lisp_environment_setup_builtin_function(env, BUILTIN_CREATE_FUNCTION);
-    ok = ok && lisp_environment_setup_builtin_function(env, BUILTIN_DEF_FUN);
-    ok = ok && lisp_environment_setup_builtin_function(env, BUILTIN_GT);
-    ok = ok && lisp_environment_setup_builtin_function(env, BUILTIN_GE);
-    ok = ok && lisp_environment_setup_builtin_function(env, BUILTIN_LT);
-    ok = ok && lisp_environment_setup_builtin_function(env, BUILTIN_LE);
-    ok = ok && lisp_environment_setup_builtin_function(env, BUILTIN_EQ);
-    ok = ok && lisp_environment_setup_builtin_function(env, BUILTIN_NE);
-    ok = ok && lisp_environment_setup_builtin_function(env, BUILTIN_IF);
-    ok = ok && lisp_environment_setup_builtin_function(env, BUILTIN_OR);
-    ok = ok && lisp_environment_setup_builtin_function(env, BUILTIN_OR_OR);
-    ok = ok && lisp_environment_setup_builtin_function(env, BUILTIN_AND);
-    ok = ok && lisp_environment_setup_builtin_function(env, BUILTIN_AND_AND);
-    ok = ok && lisp_environment_setup_builtin_function(env, BUILTIN_NOT);
-    ok = ok && lisp_environment_setup_builtin_function(env, BUILTIN_NOT_NOT);
-    ok = ok && lisp_environment_setup_builtin_function(env, BUILTIN_LOAD);
-    ok = ok && lisp_environment_setup_builtin_function(env, BUILTIN_PRINT);
-    ok = ok && lisp_environment_setup_builtin_function(env, BUILTIN_ERROR);
+    ok = ok && lisp_environment_register_builtin_function(env, BUILTIN_PLUS, builtin_fun_plus);
+    ok = ok && lisp_environment_register_builtin_function(env, BUILTIN_MINUS, builtin_fun_minus);
+    ok = ok && lisp_environment_register_builtin_function(env, BUILTIN_MULTIPLY, builtin_fun_multiply);
+    ok = ok && lisp_environment_register_builtin_function(env, BUILTIN_DIVIDE, builtin_fun_divide);
+    ok = ok && lisp_environment_register_builtin_function(env, BUILTIN_MOD, builtin_fun_mod);
+    ok = ok && lisp_environment_register_builtin_function(env, BUILTIN_POW, builtin_fun_pow);
+    ok = ok && lisp_environment_register_builtin_function(env, BUILTIN_MIN, builtin_fun_min);
+    ok = ok && lisp_environment_register_builtin_function(env, BUILTIN_MAX, builtin_fun_max);
+    ok = ok && lisp_environment_register_builtin_function(env, BUILTIN_LIST, builtin_fun_list);
+    ok = ok && lisp_environment_register_builtin_function(env, BUILTIN_HEAD, builtin_fun_head);
+    ok = ok && lisp_environment_register_builtin_function(env, BUILTIN_TAIL, builtin_fun_tail);
+    ok = ok && lisp_environment_register_builtin_function(env, BUILTIN_JOIN, builtin_fun_join);
+    ok = ok && lisp_environment_register_builtin_function(env, BUILTIN_EVAL, builtin_fun_eval);
+    ok = ok && lisp_environment_register_builtin_function(env, BUILTIN_CONS, builtin_fun_cons);
+    ok = ok && lisp_environment_register_builtin_function(env, BUILTIN_LEN, builtin_fun_len);
+    ok = ok && lisp_environment_register_builtin_function(env, BUILTIN_INIT, builtin_fun_init);
+    ok = ok && lisp_environment_register_builtin_function(env, BUILTIN_DEF, builtin_fun_def);
+    ok = ok && lisp_environment_register_builtin_function(env, BUILTIN_LOCAL_DEF, builtin_fun_local_def);
+    ok = ok && lisp_environment_register_builtin_function(env, BUILTIN_CREATE_FUNCTION, builtin_fun_create_function);
+    ok = ok && lisp_environment_register_builtin_function(env, BUILTIN_DEF_FUN, builtin_fun_def_fun);
+    ok = ok && lisp_environment_register_builtin_function(env, BUILTIN_GT, builtin_fun_gt);
+    ok = ok && lisp_environment_register_builtin_function(env, BUILTIN_GE, builtin_fun_ge);
+    ok = ok && lisp_environment_register_builtin_function(env, BUILTIN_LT, builtin_fun_lt);
+    ok = ok && lisp_environment_register_builtin_function(env, BUILTIN_LE, builtin_fun_le);
+    ok = ok && lisp_environment_register_builtin_function(env, BUILTIN_EQ, builtin_fun_eq);
+    ok = ok && lisp_environment_register_builtin_function(env, BUILTIN_NE, builtin_fun_ne);
+    ok = ok && lisp_environment_register_builtin_function(env, BUILTIN_IF, builtin_fun_if);
+    ok = ok && lisp_environment_register_builtin_function(env, BUILTIN_OR, builtin_fun_or);
+    ok = ok && lisp_environment_register_builtin_function(env, BUILTIN_OR_OR, builtin_fun_or);
+    ok = ok && lisp_environment_register_builtin_function(env, BUILTIN_AND, builtin_fun_and);
+    ok = ok && lisp_environment_register_builtin_function(env, BUILTIN_AND_AND, builtin_fun_and);
+    ok = ok && lisp_environment_register_builtin_function(env, BUILTIN_NOT, builtin_fun_not);
+    ok = ok && lisp_environment_register_builtin_function(env, BUILTIN_NOT_NOT, builtin_fun_not);
+    ok = ok && lisp_environment_register_builtin_function(env, BUILTIN_LOAD, builtin_fun_load);
+    ok = ok && lisp_environment_register_builtin_function(env, BUILTIN_PRINT, builtin_fun_print);
+    ok = ok && lisp_environment_register_builtin_function(env, BUILTIN_ERROR, builtin_fun_error);
+    ok = ok && lisp_environment_register_builtin_function(env, BUILTIN_HEAP_STATS, builtin_fun_heap_stats);
 
     return ok;
 }
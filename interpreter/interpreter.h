@@ -1,5 +1,5 @@
 #pragma once
-#include "parser.h"
+#include <stddef.h>
 
 typedef enum {
     VAL_ERR,
@@ -19,51 +19,116 @@ typedef enum {
 typedef struct lisp_value_t lisp_value_t;
 typedef struct lisp_environment_t lisp_environment_t;
 
+/* A builtin function gets the s-expression of its evaluated arguments and owns it(it must delete it),
+ * name is the symbol that the builtin is bound to, used in error messages */
+typedef lisp_value_t* (*lisp_builtin_fun_t)(lisp_environment_t* env, char* name, lisp_value_t* arguments);
+
 typedef struct lisp_value_userdefined_fun_t {
     lisp_value_t* formal_arguments;
     lisp_value_t* varargs_symbol;
     lisp_value_t* body;
     lisp_environment_t* local_env;
+    // the compiled body(see vm.h), NULL until the function is called for the first time
+    struct lisp_bytecode_t* bytecode;
+    // the compiled body for the closure engine(see closure.h), NULL until the function is called for the first time
+    struct lisp_closure_t* closure;
+    // the number of calls before the function is compiled to native code, and the code(see jit.h)
+    long call_count;
+    struct lisp_jit_code_t* jit_code;
 } lisp_value_userdefined_fun_t;
 
+/* lisp_value_t is reference counted, a value can be shared between multiple owners(for example the environment and the
+ * evaluated expression). Before mutating a value that the caller owns, lisp_value_unshare must be used to get a value
+ * that is not shared with other owners(copy-on-write)
+ * The payloads share storage, only the fields that belong to value_type can be used */
 typedef struct lisp_value_t {
     lisp_value_type_t value_type;
-    char* error_message;
-    long value_number;
-    double value_decimal;
-    char* value_symbol;
-    lisp_value_userdefined_fun_t* value_userdefined_fun;
-    char* value_string;
-    int is_error_user_defined_value;
-    long count;
-    struct lisp_value_t** values;
+    int reference_count;
+    union {
+        // VAL_ERR
+        struct {
+            char* error_message;
+            int is_error_user_defined_value;
+        };
+        // VAL_NUMBER and VAL_BOOLEAN
+        long value_number;
+        // VAL_DECIMAL
+        double value_decimal;
+        // VAL_SYMBOL and VAL_BUILTIN_FUN(value_builtin_fun is used only by VAL_BUILTIN_FUN)
+        // value_symbol is interned(see symbol.h), it is not owned by the value
+        // symbol_slot_hint is the position where the symbol is expected in the environment it is evaluated in, -1 if unknown
+        struct {
+            char* value_symbol;
+            union {
+                lisp_builtin_fun_t value_builtin_fun;
+                long symbol_slot_hint;
+            };
+        };
+        // VAL_USERDEFINED_FUN
+        lisp_value_userdefined_fun_t* value_userdefined_fun;
+        // VAL_STRING
+        char* value_string;
+        // VAL_SEXPR, VAL_ROOT and VAL_QEXPR
+        // the children are a slice of a heap array(the buffer) that can be shared by the slices of many values,
+        // values is values_offset children after the start of the buffer, the count is limited to INT_MAX children
+        struct {
+            struct lisp_value_t** values;
+            int count;
+            int values_offset;
+        };
+    };
 } lisp_value_t;
 
+/* A call in tail position that is returned to the caller instead of being made, see call_userdefined_function */
+typedef struct lisp_tail_call_t {
+    lisp_value_t* function;
+    lisp_value_t* arguments;
+} lisp_tail_call_t;
+
 typedef struct lsp_eval_result_t {
     char* error;
     lisp_value_t* value;
 } lisp_eval_result_t;
 
+/* symbols are interned names(see symbol.h), symbols and values keep the insertion order, index is an open addressing hash table of positions in symbols
+ * (position + 1, 0 is an empty slot). Small environments have no index and are searched linearly */
 typedef struct lisp_environment_t {
     size_t count;
     char** symbols;
     lisp_value_t** values;
+    size_t* index;
+    size_t index_capacity;
     lisp_environment_t* parent_environment;
 } lisp_environment_t;
 
-lisp_value_t* parse_lisp_value(mpc_ast_t* ast);
 lisp_value_t* lisp_value_number_new(long value);
 lisp_value_t* lisp_value_decimal_new(double value);
 lisp_value_t* lisp_value_symbol_new(char* value);
 lisp_value_t* lisp_value_sexpr_new();
 lisp_value_t* lisp_value_root_new();
 lisp_value_t* lisp_value_qexpr_new();
-lisp_value_t* lisp_value_builtin_fun_new(char* symbol);
+lisp_value_t* lisp_value_builtin_fun_new(char* symbol, lisp_builtin_fun_t builtin_fun);
 lisp_value_t* lisp_value_userdefined_fun_new(lisp_environment_t* environment, lisp_value_t* formal_arguments, lisp_value_t* body);
 lisp_value_t* lisp_value_boolean_new(long value);
+/**
+ * @param value a string literal as it is written in the source, with the quotes and the escapes
+ */
 lisp_value_t* lisp_value_string_new(const char* value);
+/**
+ * @param contents length characters of the string, without the quotes and the escapes of a string literal
+ */
+lisp_value_t* lisp_value_string_contents_new(const char* contents, size_t length);
 lisp_value_t* lisp_value_error_new(char* error_message_template, ...);
 lisp_value_t* lisp_value_copy(lisp_value_t* value);
+lisp_value_t* lisp_value_share(lisp_value_t* value);
+lisp_value_t* lisp_value_unshare(lisp_value_t* value);
+/**
+ * Makes a value of count children of value starting from the child at offset in constant time, the children are not copied,
+ * the slice shares the buffer of value until one of them is mutated(copy-on-write)
+ * @param value the caller owns it, it is taken by the slice
+ * @return the slice, null lisp value if out of memory
+ */
+lisp_value_t* lisp_value_slice(lisp_value_t* value, long offset, long count);
 int lisp_value_equals(lisp_value_t* first, lisp_value_t* second);
 lisp_value_t* get_null_lisp_value();
 lisp_value_t* get_lisp_value_error_bad_numeric_value();
@@ -72,6 +137,7 @@ void lisp_value_set_child(lisp_value_t* value, int index, lisp_value_t* child);
 lisp_value_t* lisp_value_pop_child(lisp_value_t * value, int index);
 void lisp_value_delete(lisp_value_t *lisp_value);
 
+char* get_value_type_string(lisp_value_type_t value_type);
 lisp_eval_result_t* lisp_eval_result_new(lisp_value_t* value);
 void lisp_eval_result_delete(lisp_eval_result_t* lisp_eval_result);
 
@@ -79,6 +145,10 @@ bool is_lisp_value_error(lisp_value_t* value);
 bool is_lisp_value_null(lisp_value_t* value);
 
 void print_lisp_value(lisp_value_t* value);
+/**
+ * @return the string escaped like a string literal(without the quotes), owned by the caller, NULL if out of memory
+ */
+char* lisp_string_escape(const char* string);
 void print_lisp_eval_result(lisp_eval_result_t* lisp_eval_result);
 
 lisp_value_t* add_lisp_values(lisp_value_t* value1, lisp_value_t* value2);
@@ -91,21 +161,68 @@ lisp_value_t* min_lisp_value(lisp_value_t* value1, lisp_value_t* value2);
 lisp_value_t* max_lisp_value(lisp_value_t* value1, lisp_value_t* value2);
 lisp_value_t* negate_lisp_value(lisp_value_t* value);
 
-lisp_eval_result_t* evaluate_root_lisp_value(lisp_value_t* value);
+/* The evaluation used for the loaded expressions, the bodies of functions, if and eval
+ * The destructive evaluation consumes the code it evaluates, so the code is copied before it is evaluated(bodies of
+ * functions are compiled to bytecode instead, see vm.h). The non-destructive evaluation reads the code and allocates
+ * only the results. The closure engine compiles the code to a tree of closures first(see closure.h), it evaluates
+ * eval like the non-destructive evaluation. */
+typedef enum {
+    EVAL_ENGINE_DESTRUCTIVE,
+    EVAL_ENGINE_NON_DESTRUCTIVE,
+    EVAL_ENGINE_CLOSURE
+} lisp_evaluation_engine_t;
+
+void lisp_set_evaluation_engine(lisp_evaluation_engine_t engine);
+lisp_evaluation_engine_t lisp_get_evaluation_engine();
+lisp_eval_result_t* evaluate_root_lisp_value(lisp_environment_t* env, lisp_value_t* value);
+lisp_value_t* evaluate_lisp_value(lisp_environment_t* env, lisp_value_t* value);
+lisp_value_t* evaluate_lisp_value_compiled(lisp_environment_t* env, lisp_value_t* value);
+lisp_value_t* evaluate_lisp_value_non_destructive(lisp_environment_t* env, lisp_value_t* value);
+lisp_value_t* evaluate_expression(lisp_environment_t* env, lisp_value_t* expression, lisp_tail_call_t* tail_call);
 lisp_eval_result_t* evaluate_root_lisp_value_destructive(lisp_environment_t *env, lisp_value_t* value);
 lisp_value_t* evaluate_lisp_value_destructive(lisp_environment_t* env, lisp_value_t* value);
+lisp_value_t* evaluate_lisp_value_in_tail_position(lisp_environment_t* env, lisp_value_t* value, lisp_tail_call_t* tail_call);
+lisp_value_t* call_function_or_builtin_operation(lisp_environment_t* env, lisp_value_t* value);
+lisp_value_t* call_function_or_builtin_operation_in_tail_position(lisp_environment_t* env, lisp_value_t* value, lisp_tail_call_t* tail_call);
+lisp_value_t* builtin_fun_if(lisp_environment_t* env, char* name, lisp_value_t* arguments);
+lisp_value_t* builtin_fun_head(lisp_environment_t* env, char* name, lisp_value_t* arguments);
+lisp_value_t* builtin_fun_tail(lisp_environment_t* env, char* name, lisp_value_t* arguments);
+lisp_value_t* builtin_fun_len(lisp_environment_t* env, char* name, lisp_value_t* arguments);
+lisp_value_t* builtin_fun_eval(lisp_environment_t* env, char* name, lisp_value_t* arguments);
+lisp_value_t* builtin_fun_eq(lisp_environment_t* env, char* name, lisp_value_t* arguments);
 
 lisp_environment_t* lisp_environment_new();
 lisp_environment_t* lisp_environment_new_root();
 lisp_environment_t* lisp_environment_new_with_parent(lisp_environment_t* env);
 lisp_environment_t* lisp_environment_copy(lisp_environment_t* env);
+lisp_environment_t* lisp_environment_copy_with_capacity(lisp_environment_t* env, size_t extra_capacity);
+/**
+ * Binds the arguments(consumed) to a new environment(frame) of the function
+ * @return the frame, null_lisp_environment if the function is partially applied or binding fails, result is set then
+ */
+lisp_environment_t* lisp_environment_new_frame(lisp_value_userdefined_fun_t* userdefined_fun, lisp_value_t* arguments, lisp_value_t** result);
+bool is_frame_shadowed_by_function(lisp_environment_t* frame, lisp_value_userdefined_fun_t* userdefined_fun);
 lisp_value_t* lisp_environment_put_variables(lisp_environment_t* env, lisp_value_t* arguments, char* function_name);
 void lisp_environment_delete(lisp_environment_t* env);
 bool lisp_environment_set(lisp_environment_t* env, lisp_value_t* symbol, lisp_value_t* value);
+bool lisp_environment_set_owned(lisp_environment_t* env, lisp_value_t* symbol, lisp_value_t* value);
 lisp_value_t* lisp_environment_get(lisp_environment_t* env, lisp_value_t* symbol);
+lisp_value_t* lisp_environment_get_borrowed(lisp_environment_t* env, lisp_value_t* symbol);
 bool lisp_environment_exists(lisp_environment_t* env, char* symbol_str);
+bool lisp_environment_find_position(lisp_environment_t* env, char* symbol, size_t* position);
 bool is_lisp_environment_null(lisp_environment_t* env);
 bool lisp_environment_setup_builtin_functions(lisp_environment_t* env);
+/**
+ * Binds a native builtin function to the name, the builtin is called directly through the function pointer
+ * and can not be redefined by def
+ */
+bool lisp_environment_register_builtin_function(lisp_environment_t* env, char* name, lisp_builtin_fun_t builtin_fun);
 void println_lisp_environment(lisp_environment_t* env);
 
 lisp_value_t* load_file(lisp_environment_t* env, const char* filename);
+/**
+ * Evaluates an expression of a loaded file with the selected engine, an error is printed
+ * @param root_env the root environment
+ * @param value consumed
+ */
+void evaluate_loaded_lisp_value(lisp_environment_t* root_env, lisp_value_t* value);
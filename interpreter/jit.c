@@ -0,0 +1,635 @@
+// MAP_ANONYMOUS is not declared in strict ISO C mode
+#define _DEFAULT_SOURCE
+
+#include "jit.h"
+#include "config.h"
+#include "vm.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_X86_64_JIT)
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+static bool is_jit_enabled = true;
+
+void lisp_jit_set_enabled(bool is_enabled) {
+    is_jit_enabled = is_enabled;
+}
+
+static constexpr long JIT_CALL_THRESHOLD = 100;
+static constexpr long JIT_MAX_ARGUMENTS = 8;
+// the native stack the recursion of a call can use at most, deeper calls are evaluated by the interpreter
+static constexpr size_t JIT_MAX_STACK_SIZE = 1024 * 1024;
+// the code of a function that bails out more often is not used anymore
+static constexpr long JIT_MAX_BAILOUTS = 100;
+
+typedef enum {
+    JIT_TYPE_NONE,
+    JIT_TYPE_NUMBER,
+    JIT_TYPE_BOOLEAN
+} jit_type_t;
+
+
+/* A symbol of the body that must be bound to the builtin with the name, or to the function itself(name is NULL) */
+typedef struct jit_guard_t {
+    lisp_value_t* symbol;
+    char* builtin_name;
+} jit_guard_t;
+
+typedef struct lisp_jit_code_t {
+    void* memory;
+    size_t memory_size;
+    lisp_jit_native_function_t entry;
+    long arguments_count;
+    jit_type_t result_type;
+    jit_guard_t* guards;
+    size_t guards_count;
+    long bailouts_count;
+    // the code was compiled by my_own_lisp_aot, the guards own their symbols and there is no memory to unmap
+    bool is_compiled_ahead_of_time;
+} lisp_jit_code_t;
+
+// the code of a function that can not be compiled, the function is not compiled again
+static lisp_jit_code_t not_compilable_code = {0};
+
+// a partially applied function has arguments bound in its local environment
+static bool has_bound_arguments(lisp_value_userdefined_fun_t* userdefined_fun) {
+    return !is_lisp_environment_null(userdefined_fun->local_env) && userdefined_fun->local_env->count > 0;
+}
+
+#if defined(_X86_64_JIT)
+
+typedef enum {
+    JIT_OP_ADD,
+    JIT_OP_SUBTRACT,
+    JIT_OP_MULTIPLY,
+    JIT_OP_DIVIDE,
+    JIT_OP_MOD,
+    JIT_OP_EQ,
+    JIT_OP_NE,
+    JIT_OP_GT,
+    JIT_OP_GE,
+    JIT_OP_LT,
+    JIT_OP_LE,
+    JIT_OP_IF
+} jit_operation_t;
+
+static const struct {
+    char* name;
+    jit_operation_t operation;
+} JIT_OPERATIONS[] = {
+    {"+", JIT_OP_ADD},
+    {"-", JIT_OP_SUBTRACT},
+    {"*", JIT_OP_MULTIPLY},
+    {"/", JIT_OP_DIVIDE},
+    {"%", JIT_OP_MOD},
+    {"==", JIT_OP_EQ},
+    {"!=", JIT_OP_NE},
+    {">", JIT_OP_GT},
+    {">=", JIT_OP_GE},
+    {"<", JIT_OP_LT},
+    {"<=", JIT_OP_LE},
+    {"if", JIT_OP_IF},
+};
+
+
+typedef struct jit_compiler_t {
+    unsigned char* bytes;
+    size_t count;
+    size_t capacity;
+    bool ok;
+    lisp_environment_t* env;
+    lisp_value_t* function;
+    lisp_value_t* formal_arguments;
+    jit_type_t result_type;
+    size_t bail_address;
+    size_t function_address;
+    size_t body_address;
+    jit_guard_t* guards;
+    size_t guards_count;
+    size_t guards_capacity;
+} jit_compiler_t;
+
+static void emit(jit_compiler_t* compiler, const unsigned char* bytes, size_t count) {
+    if (!compiler->ok) {
+        return;
+    }
+    if (compiler->count + count > compiler->capacity) {
+        size_t capacity = compiler->capacity == 0 ? 256 : compiler->capacity * 2;
+        while (capacity < compiler->count + count) {
+            capacity *= 2;
+        }
+        unsigned char* grown = realloc(compiler->bytes, capacity);
+        if (grown == NULL) {
+            compiler->ok = false;
+            return;
+        }
+        compiler->bytes = grown;
+        compiler->capacity = capacity;
+    }
+    memcpy(compiler->bytes + compiler->count, bytes, count);
+    compiler->count += count;
+}
+
+#define EMIT(compiler, ...) do {\
+        const unsigned char bytes[] = {__VA_ARGS__};\
+        emit(compiler, bytes, sizeof(bytes));\
+    } while (0)
+
+static void emit_int32(jit_compiler_t* compiler, int32_t value) {
+    emit(compiler, (const unsigned char*) &value, sizeof(value));
+}
+
+static void emit_int64(jit_compiler_t* compiler, int64_t value) {
+    emit(compiler, (const unsigned char*) &value, sizeof(value));
+}
+
+/* Emits the opcode of a jump or call with a 32-bit displacement to target, returns the address of the displacement */
+static size_t emit_jump(jit_compiler_t* compiler, const unsigned char* opcode, size_t opcode_size, size_t target) {
+    emit(compiler, opcode, opcode_size);
+    size_t address = compiler->count;
+    emit_int32(compiler, (int32_t) (target - (address + 4)));
+    return address;
+}
+
+static void patch_jump(jit_compiler_t* compiler, size_t address, size_t target) {
+    if (compiler->ok) {
+        int32_t displacement = (int32_t) (target - (address + 4));
+        memcpy(compiler->bytes + address, &displacement, sizeof(displacement));
+    }
+}
+
+static const unsigned char OPCODE_JMP[] = {0xE9};
+static const unsigned char OPCODE_CALL[] = {0xE8};
+static const unsigned char OPCODE_JE[] = {0x0F, 0x84};
+static const unsigned char OPCODE_JO[] = {0x0F, 0x80};
+static const unsigned char OPCODE_JBE[] = {0x0F, 0x86};
+
+static void emit_bail_if_overflow(jit_compiler_t* compiler) {
+    emit_jump(compiler, OPCODE_JO, sizeof(OPCODE_JO), compiler->bail_address);
+}
+
+static void add_guard(jit_compiler_t* compiler, lisp_value_t* symbol, char* builtin_name) {
+    if (!compiler->ok) {
+        return;
+    }
+    if (compiler->guards_count == compiler->guards_capacity) {
+        size_t capacity = compiler->guards_capacity == 0 ? 8 : compiler->guards_capacity * 2;
+        jit_guard_t* guards = realloc(compiler->guards, sizeof(jit_guard_t) * capacity);
+        if (guards == NULL) {
+            compiler->ok = false;
+            return;
+        }
+        compiler->guards = guards;
+        compiler->guards_capacity = capacity;
+    }
+    compiler->guards[compiler->guards_count++] = (jit_guard_t) {.symbol = symbol, .builtin_name = builtin_name};
+}
+
+static long get_formal_argument_index(jit_compiler_t* compiler, char* symbol) {
+    for (long i = 0; i < compiler->formal_arguments->count; i++) {
+        if (compiler->formal_arguments->values[i]->value_symbol == symbol) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static int32_t get_argument_offset(long index) {
+    return (int32_t) (-8 * (index + 1));
+}
+
+static jit_type_t compile_expression(jit_compiler_t* compiler, lisp_value_t* expression, bool is_tail);
+
+/* Compiles value, its result is in rax */
+static jit_type_t compile_value(jit_compiler_t* compiler, lisp_value_t* value, bool is_tail) {
+    if (value->value_type == VAL_NUMBER) {
+        // mov rax, imm64
+        EMIT(compiler, 0x48, 0xB8);
+        emit_int64(compiler, value->value_number);
+        return JIT_TYPE_NUMBER;
+    }
+    if (value->value_type == VAL_SYMBOL) {
+        long index = get_formal_argument_index(compiler, value->value_symbol);
+        if (index < 0) {
+            return JIT_TYPE_NONE;
+        }
+        // mov rax, [rbp + offset]
+        EMIT(compiler, 0x48, 0x8B, 0x85);
+        emit_int32(compiler, get_argument_offset(index));
+        return JIT_TYPE_NUMBER;
+    }
+    if (value->value_type == VAL_SEXPR) {
+        return compile_expression(compiler, value, is_tail);
+    }
+    return JIT_TYPE_NONE;
+}
+
+/* The arguments are pushed in reverse order, so the stack is the array of the arguments of the call */
+static bool compile_pushed_arguments(jit_compiler_t* compiler, lisp_value_t* expression) {
+    for (long i = expression->count - 1; i >= 1; i--) {
+        if (compile_value(compiler, expression->values[i], false) != JIT_TYPE_NUMBER) {
+            return false;
+        }
+        // push rax
+        EMIT(compiler, 0x50);
+    }
+    return true;
+}
+
+static jit_type_t compile_self_call(jit_compiler_t* compiler, lisp_value_t* expression, bool is_tail) {
+    long arguments_count = expression->count - 1;
+    if (arguments_count != compiler->formal_arguments->count || !compile_pushed_arguments(compiler, expression)) {
+        return JIT_TYPE_NONE;
+    }
+    if (is_tail) {
+        // the arguments replace the arguments of the current call and the body starts again
+        for (long i = 0; i < arguments_count; i++) {
+            // pop rax; mov [rbp + offset], rax
+            EMIT(compiler, 0x58, 0x48, 0x89, 0x85);
+            emit_int32(compiler, get_argument_offset(i));
+        }
+        emit_jump(compiler, OPCODE_JMP, sizeof(OPCODE_JMP), compiler->body_address);
+        return compiler->result_type;
+    }
+    // mov rdi, rsp; call function; add rsp, 8 * arguments_count
+    EMIT(compiler, 0x48, 0x89, 0xE7);
+    emit_jump(compiler, OPCODE_CALL, sizeof(OPCODE_CALL), compiler->function_address);
+    EMIT(compiler, 0x48, 0x81, 0xC4);
+    emit_int32(compiler, (int32_t) (8 * arguments_count));
+    return compiler->result_type;
+}
+
+/* The first operand is in rax, the next operand is computed in rcx */
+static bool compile_next_operand(jit_compiler_t* compiler, lisp_value_t* operand) {
+    // push rax
+    EMIT(compiler, 0x50);
+    if (compile_value(compiler, operand, false) != JIT_TYPE_NUMBER) {
+        return false;
+    }
+    // mov rcx, rax; pop rax
+    EMIT(compiler, 0x48, 0x89, 0xC1, 0x58);
+    return true;
+}
+
+static jit_type_t compile_arithmetic(jit_compiler_t* compiler, jit_operation_t operation, lisp_value_t* expression) {
+    if (compile_value(compiler, expression->values[1], false) != JIT_TYPE_NUMBER) {
+        return JIT_TYPE_NONE;
+    }
+    if (expression->count == 2 && operation == JIT_OP_SUBTRACT) {
+        // neg rax
+        EMIT(compiler, 0x48, 0xF7, 0xD8);
+        emit_bail_if_overflow(compiler);
+    }
+    for (long i = 2; i < expression->count; i++) {
+        if (!compile_next_operand(compiler, expression->values[i])) {
+            return JIT_TYPE_NONE;
+        }
+        switch (operation) {
+            case JIT_OP_ADD:
+                // add rax, rcx
+                EMIT(compiler, 0x48, 0x01, 0xC8);
+                emit_bail_if_overflow(compiler);
+                break;
+            case JIT_OP_SUBTRACT:
+                // sub rax, rcx
+                EMIT(compiler, 0x48, 0x29, 0xC8);
+                emit_bail_if_overflow(compiler);
+                break;
+            case JIT_OP_MULTIPLY:
+                // imul rax, rcx
+                EMIT(compiler, 0x48, 0x0F, 0xAF, 0xC1);
+                emit_bail_if_overflow(compiler);
+                break;
+            default:
+                // division by zero is an error and division by -1 can overflow, the interpreter handles both
+                // test rcx, rcx; je bail; cmp rcx, -1; je bail; cqo; idiv rcx
+                EMIT(compiler, 0x48, 0x85, 0xC9);
+                emit_jump(compiler, OPCODE_JE, sizeof(OPCODE_JE), compiler->bail_address);
+                EMIT(compiler, 0x48, 0x83, 0xF9, 0xFF);
+                emit_jump(compiler, OPCODE_JE, sizeof(OPCODE_JE), compiler->bail_address);
+                EMIT(compiler, 0x48, 0x99, 0x48, 0xF7, 0xF9);
+                if (operation == JIT_OP_MOD) {
+                    // mov rax, rdx
+                    EMIT(compiler, 0x48, 0x89, 0xD0);
+                }
+                break;
+        }
+    }
+    return JIT_TYPE_NUMBER;
+}
+
+static jit_type_t compile_comparison(jit_compiler_t* compiler, jit_operation_t operation, lisp_value_t* expression) {
+    if (expression->count != 3
+        || compile_value(compiler, expression->values[1], false) != JIT_TYPE_NUMBER
+        || !compile_next_operand(compiler, expression->values[2])) {
+        return JIT_TYPE_NONE;
+    }
+    unsigned char setcc = 0;
+    switch (operation) {
+        case JIT_OP_EQ: setcc = 0x94; break;
+        case JIT_OP_NE: setcc = 0x95; break;
+        case JIT_OP_GT: setcc = 0x9F; break;
+        case JIT_OP_GE: setcc = 0x9D; break;
+        case JIT_OP_LT: setcc = 0x9C; break;
+        default: setcc = 0x9E; break;
+    }
+    // cmp rax, rcx; setcc al; movzx eax, al
+    EMIT(compiler, 0x48, 0x39, 0xC8, 0x0F, setcc, 0xC0, 0x0F, 0xB6, 0xC0);
+    // == and != evaluate to booleans, the orderings evaluate to numbers
+    return operation == JIT_OP_EQ || operation == JIT_OP_NE ? JIT_TYPE_BOOLEAN : JIT_TYPE_NUMBER;
+}
+
+static jit_type_t compile_if(jit_compiler_t* compiler, lisp_value_t* expression, bool is_tail) {
+    if (expression->count != 4
+        || expression->values[2]->value_type != VAL_QEXPR
+        || expression->values[3]->value_type != VAL_QEXPR
+        || compile_value(compiler, expression->values[1], false) == JIT_TYPE_NONE) {
+        return JIT_TYPE_NONE;
+    }
+    // test rax, rax; je false branch
+    EMIT(compiler, 0x48, 0x85, 0xC0);
+    size_t false_jump = emit_jump(compiler, OPCODE_JE, sizeof(OPCODE_JE), 0);
+    jit_type_t true_type = compile_expression(compiler, expression->values[2], is_tail);
+    size_t end_jump = emit_jump(compiler, OPCODE_JMP, sizeof(OPCODE_JMP), 0);
+    patch_jump(compiler, false_jump, compiler->count);
+    jit_type_t false_type = compile_expression(compiler, expression->values[3], is_tail);
+    patch_jump(compiler, end_jump, compiler->count);
+    return true_type == false_type ? true_type : JIT_TYPE_NONE;
+}
+
+/* Compiles the evaluation of expression(a s-expression, or a q-expression of a branch or the body) */
+static jit_type_t compile_expression(jit_compiler_t* compiler, lisp_value_t* expression, bool is_tail) {
+    if (expression->count == 1) {
+        return compile_value(compiler, expression->values[0], is_tail);
+    }
+    lisp_value_t* operator = expression->count >= 2 ? expression->values[0] : NULL;
+    if (operator == NULL || operator->value_type != VAL_SYMBOL || get_formal_argument_index(compiler, operator->value_symbol) >= 0) {
+        return JIT_TYPE_NONE;
+    }
+
+    lisp_value_t* bound = lisp_environment_get_borrowed(compiler->env, operator);
+    if (bound == compiler->function) {
+        add_guard(compiler, operator, NULL);
+        return compile_self_call(compiler, expression, is_tail);
+    }
+    if (bound->value_type != VAL_BUILTIN_FUN) {
+        return JIT_TYPE_NONE;
+    }
+    for (size_t i = 0; i < sizeof(JIT_OPERATIONS) / sizeof(JIT_OPERATIONS[0]); i++) {
+        if (strcmp(bound->value_symbol, JIT_OPERATIONS[i].name) != 0) {
+            continue;
+        }
+        add_guard(compiler, operator, bound->value_symbol);
+        jit_operation_t operation = JIT_OPERATIONS[i].operation;
+        if (operation == JIT_OP_IF) {
+            return compile_if(compiler, expression, is_tail);
+        }
+        if (operation >= JIT_OP_EQ) {
+            return compile_comparison(compiler, operation, expression);
+        }
+        return compile_arithmetic(compiler, operation, expression);
+    }
+    return JIT_TYPE_NONE;
+}
+
+/* Layout of the code:
+ * entry(arguments in rdi, result in rsi, stack end in rdx): saves the registers, rsp(r12) for bailing out and the
+ *   stack end(r13), calls the function and stores its result
+ * bail: restores rsp and returns 0
+ * function: copies the arguments from the array in rdi to its frame, evaluates the body, the result is in rax
+ */
+static jit_type_t compile_function(jit_compiler_t* compiler, jit_type_t result_type) {
+    compiler->count = 0;
+    compiler->guards_count = 0;
+    compiler->result_type = result_type;
+    long arguments_count = compiler->formal_arguments->count;
+
+    // push rbx; push rbp; push r12; push r13; mov rbx, rsi; mov r12, rsp; mov r13, rdx
+    EMIT(compiler, 0x53, 0x55, 0x41, 0x54, 0x41, 0x55, 0x48, 0x89, 0xF3, 0x49, 0x89, 0xE4, 0x49, 0x89, 0xD5);
+    size_t call_function = emit_jump(compiler, OPCODE_CALL, sizeof(OPCODE_CALL), 0);
+    // mov [rbx], rax; mov eax, 1; pop r13; pop r12; pop rbp; pop rbx; ret
+    EMIT(compiler, 0x48, 0x89, 0x03, 0xB8, 0x01, 0x00, 0x00, 0x00, 0x41, 0x5D, 0x41, 0x5C, 0x5D, 0x5B, 0xC3);
+
+    compiler->bail_address = compiler->count;
+    // mov rsp, r12; xor eax, eax; pop r13; pop r12; pop rbp; pop rbx; ret
+    EMIT(compiler, 0x4C, 0x89, 0xE4, 0x31, 0xC0, 0x41, 0x5D, 0x41, 0x5C, 0x5D, 0x5B, 0xC3);
+
+    compiler->function_address = compiler->count;
+    patch_jump(compiler, call_function, compiler->function_address);
+    // push rbp; mov rbp, rsp; sub rsp, 8 * arguments_count; cmp rsp, r13; jbe bail
+    EMIT(compiler, 0x55, 0x48, 0x89, 0xE5, 0x48, 0x81, 0xEC);
+    emit_int32(compiler, (int32_t) (8 * arguments_count));
+    EMIT(compiler, 0x4C, 0x39, 0xEC);
+    emit_jump(compiler, OPCODE_JBE, sizeof(OPCODE_JBE), compiler->bail_address);
+    for (long i = 0; i < arguments_count; i++) {
+        // mov rax, [rdi + 8 * i]; mov [rbp + offset], rax
+        EMIT(compiler, 0x48, 0x8B, 0x87);
+        emit_int32(compiler, (int32_t) (8 * i));
+        EMIT(compiler, 0x48, 0x89, 0x85);
+        emit_int32(compiler, get_argument_offset(i));
+    }
+
+    compiler->body_address = compiler->count;
+    lisp_value_t* body = compiler->function->value_userdefined_fun->body;
+    jit_type_t type = body->count > 0 ? compile_expression(compiler, body, true) : JIT_TYPE_NONE;
+    // leave; ret
+    EMIT(compiler, 0xC9, 0xC3);
+    return compiler->ok ? type : JIT_TYPE_NONE;
+}
+
+static bool is_compilable_function(lisp_value_userdefined_fun_t* userdefined_fun) {
+    return is_lisp_value_null(userdefined_fun->varargs_symbol)
+        && !has_bound_arguments(userdefined_fun)
+        && userdefined_fun->formal_arguments->count <= JIT_MAX_ARGUMENTS
+        && userdefined_fun->body->value_type == VAL_QEXPR;
+}
+
+static lisp_jit_code_t* compile(lisp_environment_t* env, lisp_value_t* function) {
+    lisp_value_userdefined_fun_t* userdefined_fun = function->value_userdefined_fun;
+    if (!is_compilable_function(userdefined_fun)) {
+        return &not_compilable_code;
+    }
+    jit_compiler_t compiler = {
+        .ok = true,
+        .env = env,
+        .function = function,
+        .formal_arguments = userdefined_fun->formal_arguments
+    };
+    // the type of the result of the recursive calls is assumed, the assumption must match the type of the body
+    jit_type_t result_type = compile_function(&compiler, JIT_TYPE_NUMBER);
+    if (result_type == JIT_TYPE_BOOLEAN) {
+        result_type = compile_function(&compiler, JIT_TYPE_BOOLEAN) == JIT_TYPE_BOOLEAN ? JIT_TYPE_BOOLEAN : JIT_TYPE_NONE;
+    }
+
+    lisp_jit_code_t* code = result_type != JIT_TYPE_NONE ? malloc(sizeof(lisp_jit_code_t)) : NULL;
+    size_t page_size = (size_t) sysconf(_SC_PAGESIZE);
+    size_t memory_size = (compiler.count + page_size - 1) / page_size * page_size;
+    void* memory = code != NULL ? mmap(NULL, memory_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0) : MAP_FAILED;
+    if (memory == MAP_FAILED) {
+        free(code);
+        free(compiler.bytes);
+        free(compiler.guards);
+        return &not_compilable_code;
+    }
+    memcpy(memory, compiler.bytes, compiler.count);
+    free(compiler.bytes);
+    if (mprotect(memory, memory_size, PROT_READ | PROT_EXEC) != 0) {
+        munmap(memory, memory_size);
+        free(code);
+        free(compiler.guards);
+        return &not_compilable_code;
+    }
+    code->memory = memory;
+    code->memory_size = memory_size;
+    // ISO C has no conversion from an object pointer to a function pointer, the address is copied instead
+    memcpy(&code->entry, &memory, sizeof(code->entry));
+    code->arguments_count = userdefined_fun->formal_arguments->count;
+    code->result_type = result_type;
+    code->guards = compiler.guards;
+    code->guards_count = compiler.guards_count;
+    code->bailouts_count = 0;
+    code->is_compiled_ahead_of_time = false;
+    return code;
+}
+
+#else
+
+static lisp_jit_code_t* compile([[maybe_unused]] lisp_environment_t* env, [[maybe_unused]] lisp_value_t* function) {
+    return &not_compilable_code;
+}
+
+#endif
+
+static bool are_guards_satisfied(lisp_jit_code_t* code, lisp_environment_t* env, lisp_value_t* function) {
+    for (size_t i = 0; i < code->guards_count; i++) {
+        jit_guard_t* guard = &code->guards[i];
+        lisp_value_t* bound = lisp_environment_get_borrowed(env, guard->symbol);
+        if (guard->builtin_name == NULL) {
+            if (bound != function) {
+                return false;
+            }
+        } else if (bound->value_type != VAL_BUILTIN_FUN || bound->value_symbol != guard->builtin_name) {
+            return false;
+        }
+    }
+    return true;
+}
+
+lisp_value_t* lisp_jit_try_call(lisp_environment_t* env, lisp_value_t* function, lisp_value_t* arguments) {
+    lisp_value_userdefined_fun_t* userdefined_fun = function->value_userdefined_fun;
+    if (userdefined_fun->jit_code == NULL) {
+        userdefined_fun->call_count++;
+        if (userdefined_fun->call_count < JIT_CALL_THRESHOLD || !is_jit_enabled) {
+            return NULL;
+        }
+        userdefined_fun->jit_code = compile(env, function);
+    }
+
+    lisp_jit_code_t* code = userdefined_fun->jit_code;
+    if (!is_jit_enabled || code == &not_compilable_code || code->bailouts_count >= JIT_MAX_BAILOUTS
+        || arguments->count != code->arguments_count || has_bound_arguments(userdefined_fun)) {
+        return NULL;
+    }
+    long argument_values[JIT_MAX_ARGUMENTS];
+    for (long i = 0; i < arguments->count; i++) {
+        if (arguments->values[i]->value_type != VAL_NUMBER) {
+            return NULL;
+        }
+        argument_values[i] = arguments->values[i]->value_number;
+    }
+    long result = 0;
+    if (!are_guards_satisfied(code, env, function)) {
+        return NULL;
+    }
+    // the stack grows down on the supported platforms
+    char marker;
+    size_t stack_size = lisp_vm_get_native_stack_available();
+    stack_size = stack_size < JIT_MAX_STACK_SIZE ? stack_size : JIT_MAX_STACK_SIZE;
+    if (!code->entry(argument_values, &result, (uintptr_t) &marker - stack_size)) {
+        code->bailouts_count++;
+        return NULL;
+    }
+
+    lisp_value_delete(arguments);
+    return code->result_type == JIT_TYPE_BOOLEAN ? lisp_value_boolean_new(result) : lisp_value_number_new(result);
+}
+
+bool lisp_jit_set_native_function(lisp_environment_t* env, char* name, lisp_value_t* formal_arguments,
+                                  lisp_value_t* body, bool is_result_boolean, lisp_jit_native_function_t native_function,
+                                  char** guard_names) {
+    lisp_value_t* symbol = lisp_value_symbol_new(name);
+    lisp_value_t* function = lisp_environment_get_borrowed(env, symbol);
+    lisp_value_delete(symbol);
+    // the definition could have failed, the function has to be the one that was compiled
+    bool is_compiled_function = function->value_type == VAL_USERDEFINED_FUN
+        && is_lisp_value_null(function->value_userdefined_fun->varargs_symbol)
+        && !has_bound_arguments(function->value_userdefined_fun)
+        && function->value_userdefined_fun->formal_arguments->count <= JIT_MAX_ARGUMENTS
+        && lisp_value_equals(function->value_userdefined_fun->formal_arguments, formal_arguments)
+        && lisp_value_equals(function->value_userdefined_fun->body, body);
+    long arguments_count = is_lisp_value_null(formal_arguments) ? 0 : formal_arguments->count;
+    lisp_value_delete(formal_arguments);
+    lisp_value_delete(body);
+    if (!is_compiled_function) {
+        return false;
+    }
+
+    size_t guards_count = 0;
+    while (guard_names[guards_count] != NULL) {
+        guards_count++;
+    }
+    lisp_jit_code_t* code = malloc(sizeof(lisp_jit_code_t));
+    jit_guard_t* guards = malloc(sizeof(jit_guard_t) * (guards_count > 0 ? guards_count : 1));
+    if (code == NULL || guards == NULL) {
+        free(code);
+        free(guards);
+        return false;
+    }
+    *code = (lisp_jit_code_t) {
+        .entry = native_function,
+        .arguments_count = arguments_count,
+        .result_type = is_result_boolean ? JIT_TYPE_BOOLEAN : JIT_TYPE_NUMBER,
+        .guards = guards,
+        .is_compiled_ahead_of_time = true
+    };
+    for (size_t i = 0; i < guards_count; i++) {
+        lisp_value_t* guard_symbol = lisp_value_symbol_new(guard_names[i]);
+        if (is_lisp_value_null(guard_symbol)) {
+            lisp_jit_code_delete(code);
+            return false;
+        }
+        // the name of the function itself is guarded to be bound to the function, the others to the builtins
+        bool is_function_name = strcmp(guard_names[i], name) == 0;
+        guards[code->guards_count++] = (jit_guard_t) {
+            .symbol = guard_symbol,
+            .builtin_name = is_function_name ? NULL : guard_symbol->value_symbol
+        };
+    }
+
+    lisp_jit_code_delete(function->value_userdefined_fun->jit_code);
+    function->value_userdefined_fun->jit_code = code;
+    return true;
+}
+
+void lisp_jit_code_delete(lisp_jit_code_t* code) {
+    if (code == NULL || code == &not_compilable_code) {
+        return;
+    }
+    if (code->is_compiled_ahead_of_time) {
+        for (size_t i = 0; i < code->guards_count; i++) {
+            lisp_value_delete(code->guards[i].symbol);
+        }
+    }
+#if defined(_X86_64_JIT)
+    if (code->memory != NULL) {
+        munmap(code->memory, code->memory_size);
+    }
+#endif
+    free(code->guards);
+    free(code);
+}
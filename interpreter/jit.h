@@ -0,0 +1,55 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "interpreter.h"
+
+/* The native code compiler for numeric user defined functions(x86-64 on unix-style os, see config.h)
+ * The calls of every user defined function are counted, after JIT_CALL_THRESHOLD calls the body is compiled to
+ * machine code if it uses only integer literals, the arguments, + - * / %, comparisons, if and calls of the function
+ * itself. The code is specialized for arguments that are numbers.
+ * Before the code is called the arguments and the bindings of the symbols the body uses(the builtins and the function
+ * itself) are checked(guards), when a guard fails or the code can not continue(overflow, division by zero, recursion
+ * too deep for the native stack) the call is evaluated by the interpreter.
+ * The compiler is enabled by default, it can be disabled(the --no-jit option of the interpreter) to compare the engines
+ * without it.
+ * The same functions can be compiled ahead of time to C by my_own_lisp_aot, the compiled program sets the C functions
+ * as the native code of the functions it defines, which is called under the same guards on every platform.
+ */
+
+typedef struct lisp_jit_code_t lisp_jit_code_t;
+
+/**
+ * The native code of a function, the arguments are numbers
+ * @param stack_end the calls of the code do not use the native stack below this address
+ * @return 1 and the result(a number, or 0 or 1 for a boolean), 0 if the call could not be completed natively(overflow,
+ * division by zero or recursion too deep), the call is evaluated by the interpreter then
+ */
+typedef int (*lisp_jit_native_function_t)(const long* arguments, long* result, uintptr_t stack_end);
+
+/**
+ * Enables or disables the compilation and the native calls of the functions, the functions are only counted while
+ * the compiler is disabled
+ */
+void lisp_jit_set_enabled(bool is_enabled);
+
+/**
+ * @param env the environment the function is called in(the parent of its frame)
+ * @param function user defined function, not consumed
+ * @param arguments consumed only when the call is made natively
+ * @return the value of the call, NULL if the call was not made natively
+ */
+lisp_value_t* lisp_jit_try_call(lisp_environment_t* env, lisp_value_t* function, lisp_value_t* arguments);
+/**
+ * Sets native_function, compiled ahead of time, as the native code of the function bound to name in env
+ * @param formal_arguments the formal arguments(consumed) that the function was compiled for
+ * @param body the body(consumed) that the function was compiled for
+ * @param guard_names the names of the symbols the body uses(terminated by NULL), name has to be bound to the function
+ * and the other names to the builtins of the same names when the code is called
+ * @return false if the function bound to name is not the function that was compiled(for example its definition
+ * failed) or out of memory, the function is interpreted then
+ */
+bool lisp_jit_set_native_function(lisp_environment_t* env, char* name, lisp_value_t* formal_arguments,
+                                  lisp_value_t* body, bool is_result_boolean, lisp_jit_native_function_t native_function,
+                                  char** guard_names);
+void lisp_jit_code_delete(lisp_jit_code_t* code);
@@ -0,0 +1,583 @@
+#include "list.h"
+
+#include <stdlib.h>
+
+static char* ERR_INCOMPATIBLE_TYPES_MESSAGE_TEMPLATE = "Incompatible type for argument %d of %s: expected %s, got %s";
+static char* ERR_INVALID_NUMBER_OF_ARGUMENTS_MESSAGE_TEMPLATE = "Invalid number of arguments for %s: expected: %d, got %d";
+static char* ERR_NO_ELEMENT_FOUND_MESSAGE = "No Element Found";
+static char* SYMBOL_NIL = "nil";
+
+static char* BUILTIN_HEAD = "head";
+static char* BUILTIN_TAIL = "tail";
+static char* BUILTIN_LEN = "len";
+static char* BUILTIN_EVAL = "eval";
+static char* BUILTIN_EQ = "==";
+static char* BUILTIN_IF = "if";
+
+static char* BUILTIN_NTH = "nth";
+static char* BUILTIN_LAST = "last";
+static char* BUILTIN_MAP = "map";
+static char* BUILTIN_FILTER = "filter";
+static char* BUILTIN_REVERSE = "reverse";
+static char* BUILTIN_FOLDL = "foldl";
+static char* BUILTIN_FOLDR = "foldr";
+static char* BUILTIN_TAKE = "take";
+static char* BUILTIN_DROP = "drop";
+static char* BUILTIN_ELEM = "elem";
+static char* BUILTIN_LOOKUP = "lookup";
+static char* BUILTIN_ZIP = "zip";
+static char* BUILTIN_UNZIP = "unzip";
+
+// the formal arguments of the prelude functions
+static char* FORMALS_N_L[] = {"n", "l"};
+static char* FORMALS_L[] = {"l"};
+static char* FORMALS_F_L[] = {"f", "l"};
+static char* FORMALS_F_Z_L[] = {"f", "z", "l"};
+static char* FORMALS_X_L[] = {"x", "l"};
+static char* FORMALS_X_Y[] = {"x", "y"};
+
+static bool is_evaluation_aborted_by(lisp_value_t* value) {
+    return is_lisp_value_null(value) || (is_lisp_value_error(value) && value->is_error_user_defined_value == 0);
+}
+
+static bool is_empty_qexpr(lisp_value_t* value) {
+    return value->value_type == VAL_QEXPR && value->count == 0;
+}
+
+/* Appends a shared item, false if out of memory */
+static bool append_item(lisp_value_t* list, lisp_value_t* item) {
+    if (!append_lisp_value(list, lisp_value_share(item))) {
+        lisp_value_delete(item);
+        return false;
+    }
+    return true;
+}
+
+/* Calls (builtin values...), used to get the error of the builtin that the prelude function fails in */
+static lisp_value_t* call_builtin(lisp_environment_t* env, lisp_builtin_fun_t builtin_fun, char* name, long count, lisp_value_t** values) {
+    lisp_value_t* arguments = lisp_value_sexpr_new();
+    if (is_lisp_value_null(arguments)) {
+        return arguments;
+    }
+    for (long i = 0; i < count; i++) {
+        if (!append_item(arguments, values[i])) {
+            lisp_value_delete(arguments);
+            return get_null_lisp_value();
+        }
+    }
+    return builtin_fun(env, name, arguments);
+}
+
+static lisp_value_t* call_builtin_with_value(lisp_environment_t* env, lisp_builtin_fun_t builtin_fun, char* name, lisp_value_t* value) {
+    return call_builtin(env, builtin_fun, name, 1, &value);
+}
+
+static lisp_value_t* error_not_a_number(char* name, int position, lisp_value_t* value) {
+    return lisp_value_error_new(ERR_INCOMPATIBLE_TYPES_MESSAGE_TEMPLATE, position, name, get_value_type_string(VAL_NUMBER), get_value_type_string(value->value_type));
+}
+
+/* The value of (fst l) when item is the first item of l: eval of the q-expression {item} */
+static lisp_value_t* evaluate_item(lisp_environment_t* env, lisp_value_t* item) {
+    switch (item->value_type) {
+        case VAL_NUMBER:
+        case VAL_DECIMAL:
+        case VAL_BOOLEAN:
+        case VAL_STRING:
+        case VAL_QEXPR:
+            return lisp_value_share(item);
+        default:
+            break;
+    }
+    lisp_value_t* qexpr = lisp_value_qexpr_new();
+    if (is_lisp_value_null(qexpr) || !append_item(qexpr, item)) {
+        lisp_value_delete(qexpr);
+        return get_null_lisp_value();
+    }
+    lisp_value_t* result = call_builtin_with_value(env, builtin_fun_eval, BUILTIN_EVAL, qexpr);
+    lisp_value_delete(qexpr);
+    return result;
+}
+
+/* The value of (fst l) when l is the q-expression from the index of list, eval of {} if it is empty */
+static lisp_value_t* evaluate_item_at(lisp_environment_t* env, lisp_value_t* list, long index) {
+    if (index >= 0 && index < list->count) {
+        return evaluate_item(env, list->values[index]);
+    }
+    lisp_value_t* empty = lisp_value_qexpr_new();
+    if (is_lisp_value_null(empty)) {
+        return empty;
+    }
+    lisp_value_t* result = call_builtin_with_value(env, builtin_fun_eval, BUILTIN_EVAL, empty);
+    lisp_value_delete(empty);
+    return result;
+}
+
+/* Calls (function first second), second can be NULL, the arguments are consumed */
+static lisp_value_t* apply(lisp_environment_t* env, lisp_value_t* function, lisp_value_t* first, lisp_value_t* second) {
+    lisp_value_t* call = lisp_value_sexpr_new();
+    lisp_value_t* values[] = {lisp_value_share(function), first, second};
+    long count = second == NULL ? 2 : 3;
+    bool ok = !is_lisp_value_null(call);
+    for (long i = 0; i < count; i++) {
+        if (!ok || !append_lisp_value(call, values[i])) {
+            ok = false;
+            lisp_value_delete(values[i]);
+        }
+    }
+    if (!ok) {
+        lisp_value_delete(call);
+        return get_null_lisp_value();
+    }
+    return call_function_or_builtin_operation(env, call);
+}
+
+static bool is_true(lisp_value_t* value) {
+    return (value->value_type == VAL_NUMBER || value->value_type == VAL_BOOLEAN) && value->value_number != 0;
+}
+
+/* (== first second) of the prelude functions, result is set to the error if the comparison fails */
+static bool are_equal(lisp_environment_t* env, lisp_value_t* first, lisp_value_t* second, lisp_value_t** result) {
+    lisp_value_t* values[] = {first, second};
+    lisp_value_t* equal = call_builtin(env, builtin_fun_eq, BUILTIN_EQ, 2, values);
+    if (is_evaluation_aborted_by(equal)) {
+        *result = equal;
+        return false;
+    }
+    bool is_equal = is_true(equal);
+    lisp_value_delete(equal);
+    return is_equal;
+}
+
+/* Finishes a builtin: the arguments are deleted */
+static lisp_value_t* finish(lisp_value_t* arguments, lisp_value_t* result) {
+    lisp_value_delete(arguments);
+    return result;
+}
+
+/* The function that a call with fewer arguments than formals evaluates to, like a partially applied prelude function:
+ * (\ {formals} {builtin formals}) with the arguments(consumed) bound to the first formals. The builtin itself is in
+ * the body, so the name can not be shadowed by the frames the function is called from */
+static lisp_value_t* partially_applied_builtin_new(lisp_environment_t* env, lisp_builtin_fun_t builtin_fun, char* name, char** formals, long formals_count, lisp_value_t* arguments) {
+    lisp_value_t* formal_arguments = lisp_value_qexpr_new();
+    lisp_value_t* body = lisp_value_qexpr_new();
+    bool ok = !is_lisp_value_null(formal_arguments) && !is_lisp_value_null(body)
+        && append_lisp_value(body, lisp_value_builtin_fun_new(name, builtin_fun));
+    for (long i = 0; ok && i < formals_count; i++) {
+        ok = append_lisp_value(formal_arguments, lisp_value_symbol_new(formals[i]))
+            && append_lisp_value(body, lisp_value_symbol_new(formals[i]));
+    }
+    if (!ok) {
+        lisp_value_delete(formal_arguments);
+        lisp_value_delete(body);
+        return finish(arguments, get_null_lisp_value());
+    }
+    lisp_value_t* function = lisp_value_userdefined_fun_new(env, formal_arguments, body);
+    if (is_lisp_value_null(function) || is_lisp_value_error(function)) {
+        return finish(arguments, function);
+    }
+    lisp_value_t* result = get_null_lisp_value();
+    lisp_environment_new_frame(function->value_userdefined_fun, arguments, &result);
+    lisp_value_delete(function);
+    return result;
+}
+
+/* A call with fewer arguments than the prelude function has is partially applied, a call with more is an error */
+#define CHECK_ARGUMENTS_COUNT(env, builtin_fun, name, formals, arguments) \
+    do {\
+        long formals_count = sizeof(formals) / sizeof(formals[0]);\
+        if (arguments->count < formals_count) {\
+            return partially_applied_builtin_new(env, builtin_fun, name, formals, formals_count, arguments);\
+        }\
+        if (arguments->count > formals_count) {\
+            return finish(arguments, lisp_value_error_new(ERR_INVALID_NUMBER_OF_ARGUMENTS_MESSAGE_TEMPLATE, name, (int) formals_count, arguments->count));\
+        }\
+    } while (0)
+
+/* A negative count of nth, take or drop never reaches 0 in the prelude: nth and drop(and last of {}) loop forever in
+ * tail position, they are handled as a count past the end here(nth evaluates to () and drop to {}), take recurses
+ * until the evaluation stack overflows, it evaluates to {} here like drop */
+
+static lisp_value_t* builtin_fun_nth(lisp_environment_t* env, char* name, lisp_value_t* arguments) {
+    CHECK_ARGUMENTS_COUNT(env, builtin_fun_nth, name, FORMALS_N_L, arguments);
+    lisp_value_t* n = arguments->values[0];
+    lisp_value_t* list = arguments->values[1];
+    if (n->value_type != VAL_NUMBER) {
+        return finish(arguments, error_not_a_number(name, 1, n));
+    }
+    if (list->value_type != VAL_QEXPR) {
+        bool is_first = n->value_number == 0;
+        return finish(arguments, call_builtin_with_value(env, is_first ? builtin_fun_head : builtin_fun_tail, is_first ? BUILTIN_HEAD : BUILTIN_TAIL, list));
+    }
+    long index = n->value_number >= 0 ? n->value_number : list->count;
+    return finish(arguments, evaluate_item_at(env, list, index));
+}
+
+static lisp_value_t* builtin_fun_last(lisp_environment_t* env, char* name, lisp_value_t* arguments) {
+    CHECK_ARGUMENTS_COUNT(env, builtin_fun_last, name, FORMALS_L, arguments);
+    lisp_value_t* list = arguments->values[0];
+    if (list->value_type != VAL_QEXPR) {
+        return finish(arguments, call_builtin_with_value(env, builtin_fun_len, BUILTIN_LEN, list));
+    }
+    return finish(arguments, evaluate_item_at(env, list, list->count > 0 ? list->count - 1 : 0));
+}
+
+static lisp_value_t* builtin_fun_map(lisp_environment_t* env, char* name, lisp_value_t* arguments) {
+    CHECK_ARGUMENTS_COUNT(env, builtin_fun_map, name, FORMALS_F_L, arguments);
+    lisp_value_t* function = arguments->values[0];
+    lisp_value_t* list = arguments->values[1];
+    if (list->value_type != VAL_QEXPR) {
+        return finish(arguments, call_builtin_with_value(env, builtin_fun_head, BUILTIN_HEAD, list));
+    }
+    lisp_value_t* result = lisp_value_qexpr_new();
+    for (long i = 0; !is_lisp_value_null(result) && i < list->count; i++) {
+        lisp_value_t* item = evaluate_item(env, list->values[i]);
+        if (!is_evaluation_aborted_by(item)) {
+            item = apply(env, function, item, NULL);
+        }
+        if (is_evaluation_aborted_by(item)) {
+            lisp_value_delete(result);
+            return finish(arguments, item);
+        }
+        if (!append_lisp_value(result, item)) {
+            lisp_value_delete(item);
+            lisp_value_delete(result);
+            result = get_null_lisp_value();
+        }
+    }
+    return finish(arguments, result);
+}
+
+static lisp_value_t* builtin_fun_filter(lisp_environment_t* env, char* name, lisp_value_t* arguments) {
+    CHECK_ARGUMENTS_COUNT(env, builtin_fun_filter, name, FORMALS_F_L, arguments);
+    lisp_value_t* function = arguments->values[0];
+    lisp_value_t* list = arguments->values[1];
+    if (list->value_type != VAL_QEXPR) {
+        return finish(arguments, call_builtin_with_value(env, builtin_fun_head, BUILTIN_HEAD, list));
+    }
+    lisp_value_t* result = lisp_value_qexpr_new();
+    for (long i = 0; !is_lisp_value_null(result) && i < list->count; i++) {
+        lisp_value_t* condition = evaluate_item(env, list->values[i]);
+        if (!is_evaluation_aborted_by(condition)) {
+            condition = apply(env, function, condition, NULL);
+        }
+        if (!is_evaluation_aborted_by(condition) && condition->value_type != VAL_NUMBER && condition->value_type != VAL_BOOLEAN) {
+            // the error of if, its condition is checked before the branches
+            lisp_value_t* values[] = {condition, result, result};
+            lisp_value_t* error = call_builtin(env, builtin_fun_if, BUILTIN_IF, 3, values);
+            lisp_value_delete(condition);
+            condition = error;
+        }
+        if (is_evaluation_aborted_by(condition)) {
+            lisp_value_delete(result);
+            return finish(arguments, condition);
+        }
+        bool is_kept = condition->value_number != 0;
+        lisp_value_delete(condition);
+        if (is_kept && !append_item(result, list->values[i])) {
+            lisp_value_delete(result);
+            result = get_null_lisp_value();
+        }
+    }
+    return finish(arguments, result);
+}
+
+static lisp_value_t* builtin_fun_reverse(lisp_environment_t* env, char* name, lisp_value_t* arguments) {
+    CHECK_ARGUMENTS_COUNT(env, builtin_fun_reverse, name, FORMALS_L, arguments);
+    lisp_value_t* list = arguments->values[0];
+    if (list->value_type != VAL_QEXPR) {
+        return finish(arguments, call_builtin_with_value(env, builtin_fun_tail, BUILTIN_TAIL, list));
+    }
+    lisp_value_t* result = lisp_value_qexpr_new();
+    for (long i = list->count - 1; !is_lisp_value_null(result) && i >= 0; i--) {
+        if (!append_item(result, list->values[i])) {
+            lisp_value_delete(result);
+            result = get_null_lisp_value();
+        }
+    }
+    return finish(arguments, result);
+}
+
+static lisp_value_t* builtin_fun_foldl(lisp_environment_t* env, char* name, lisp_value_t* arguments) {
+    CHECK_ARGUMENTS_COUNT(env, builtin_fun_foldl, name, FORMALS_F_Z_L, arguments);
+    lisp_value_t* function = arguments->values[0];
+    lisp_value_t* list = arguments->values[2];
+    if (list->value_type != VAL_QEXPR) {
+        return finish(arguments, call_builtin_with_value(env, builtin_fun_head, BUILTIN_HEAD, list));
+    }
+    lisp_value_t* result = lisp_value_share(arguments->values[1]);
+    for (long i = 0; i < list->count; i++) {
+        lisp_value_t* item = evaluate_item(env, list->values[i]);
+        if (is_evaluation_aborted_by(item)) {
+            lisp_value_delete(result);
+            return finish(arguments, item);
+        }
+        result = apply(env, function, result, item);
+        if (is_evaluation_aborted_by(result)) {
+            break;
+        }
+    }
+    return finish(arguments, result);
+}
+
+/* The items are evaluated first and the function is applied from the last item, as in the recursion of the prelude */
+static lisp_value_t* builtin_fun_foldr(lisp_environment_t* env, char* name, lisp_value_t* arguments) {
+    CHECK_ARGUMENTS_COUNT(env, builtin_fun_foldr, name, FORMALS_F_Z_L, arguments);
+    lisp_value_t* function = arguments->values[0];
+    lisp_value_t* list = arguments->values[2];
+    if (list->value_type != VAL_QEXPR) {
+        return finish(arguments, call_builtin_with_value(env, builtin_fun_head, BUILTIN_HEAD, list));
+    }
+    lisp_value_t** items = list->count > 0 ? malloc(sizeof(lisp_value_t*) * list->count) : NULL;
+    if (list->count > 0 && items == NULL) {
+        return finish(arguments, get_null_lisp_value());
+    }
+    long items_count = 0;
+    lisp_value_t* result = lisp_value_share(arguments->values[1]);
+    while (items_count < list->count) {
+        lisp_value_t* item = evaluate_item(env, list->values[items_count]);
+        if (is_evaluation_aborted_by(item)) {
+            lisp_value_delete(result);
+            result = item;
+            break;
+        }
+        items[items_count++] = item;
+    }
+    if (items_count == list->count) {
+        while (items_count > 0 && !is_evaluation_aborted_by(result)) {
+            items_count--;
+            result = apply(env, function, items[items_count], result);
+        }
+    }
+    for (long i = 0; i < items_count; i++) {
+        lisp_value_delete(items[i]);
+    }
+    free(items);
+    return finish(arguments, result);
+}
+
+static lisp_value_t* builtin_fun_take(lisp_environment_t* env, char* name, lisp_value_t* arguments) {
+    CHECK_ARGUMENTS_COUNT(env, builtin_fun_take, name, FORMALS_N_L, arguments);
+    lisp_value_t* n = arguments->values[0];
+    lisp_value_t* list = arguments->values[1];
+    if (n->value_type != VAL_NUMBER) {
+        return finish(arguments, error_not_a_number(name, 1, n));
+    }
+    if (n->value_number == 0) {
+        return finish(arguments, lisp_value_qexpr_new());
+    }
+    if (list->value_type != VAL_QEXPR) {
+        return finish(arguments, call_builtin_with_value(env, builtin_fun_head, BUILTIN_HEAD, list));
+    }
+    long count = n->value_number < list->count ? n->value_number : list->count;
+    if (count < 0) {
+        count = 0;
+    }
+    return finish(arguments, lisp_value_slice(lisp_value_share(list), 0, count));
+}
+
+static lisp_value_t* builtin_fun_drop(lisp_environment_t* env, char* name, lisp_value_t* arguments) {
+    CHECK_ARGUMENTS_COUNT(env, builtin_fun_drop, name, FORMALS_N_L, arguments);
+    lisp_value_t* n = arguments->values[0];
+    lisp_value_t* list = arguments->values[1];
+    if (n->value_type != VAL_NUMBER) {
+        return finish(arguments, error_not_a_number(name, 1, n));
+    }
+    if (n->value_number == 0) {
+        return finish(arguments, lisp_value_share(list));
+    }
+    if (list->value_type != VAL_QEXPR) {
+        return finish(arguments, call_builtin_with_value(env, builtin_fun_tail, BUILTIN_TAIL, list));
+    }
+    long start = n->value_number > 0 && n->value_number < list->count ? n->value_number : list->count;
+    return finish(arguments, lisp_value_slice(lisp_value_share(list), start, list->count - start));
+}
+
+static lisp_value_t* builtin_fun_elem(lisp_environment_t* env, char* name, lisp_value_t* arguments) {
+    CHECK_ARGUMENTS_COUNT(env, builtin_fun_elem, name, FORMALS_X_L, arguments);
+    lisp_value_t* x = arguments->values[0];
+    lisp_value_t* list = arguments->values[1];
+    if (list->value_type != VAL_QEXPR) {
+        return finish(arguments, call_builtin_with_value(env, builtin_fun_head, BUILTIN_HEAD, list));
+    }
+    for (long i = 0; i < list->count; i++) {
+        lisp_value_t* item = evaluate_item(env, list->values[i]);
+        if (is_evaluation_aborted_by(item)) {
+            return finish(arguments, item);
+        }
+        lisp_value_t* error = NULL;
+        bool is_equal = are_equal(env, x, item, &error);
+        lisp_value_delete(item);
+        if (error != NULL) {
+            return finish(arguments, error);
+        }
+        if (is_equal) {
+            return finish(arguments, lisp_value_boolean_new(1));
+        }
+    }
+    return finish(arguments, lisp_value_boolean_new(0));
+}
+
+static lisp_value_t* builtin_fun_lookup(lisp_environment_t* env, char* name, lisp_value_t* arguments) {
+    CHECK_ARGUMENTS_COUNT(env, builtin_fun_lookup, name, FORMALS_X_L, arguments);
+    lisp_value_t* x = arguments->values[0];
+    lisp_value_t* list = arguments->values[1];
+    if (list->value_type != VAL_QEXPR) {
+        return finish(arguments, call_builtin_with_value(env, builtin_fun_head, BUILTIN_HEAD, list));
+    }
+    for (long i = 0; i < list->count; i++) {
+        lisp_value_t* pair = evaluate_item(env, list->values[i]);
+        if (is_evaluation_aborted_by(pair)) {
+            return finish(arguments, pair);
+        }
+        if (pair->value_type != VAL_QEXPR) {
+            lisp_value_t* error = call_builtin_with_value(env, builtin_fun_head, BUILTIN_HEAD, pair);
+            lisp_value_delete(pair);
+            return finish(arguments, error);
+        }
+        lisp_value_t* key = evaluate_item_at(env, pair, 0);
+        if (is_evaluation_aborted_by(key)) {
+            lisp_value_delete(pair);
+            return finish(arguments, key);
+        }
+        lisp_value_t* value = evaluate_item_at(env, pair, 1);
+        lisp_value_delete(pair);
+        if (is_evaluation_aborted_by(value)) {
+            lisp_value_delete(key);
+            return finish(arguments, value);
+        }
+        lisp_value_t* error = NULL;
+        bool is_equal = are_equal(env, key, x, &error);
+        lisp_value_delete(key);
+        if (error != NULL) {
+            lisp_value_delete(value);
+            return finish(arguments, error);
+        }
+        if (is_equal) {
+            return finish(arguments, value);
+        }
+        lisp_value_delete(value);
+    }
+    lisp_value_t* error = lisp_value_error_new(ERR_NO_ELEMENT_FOUND_MESSAGE);
+    if (is_lisp_value_error(error)) {
+        // the error of the builtin error is a value
+        error->is_error_user_defined_value = 1;
+    }
+    return finish(arguments, error);
+}
+
+static lisp_value_t* builtin_fun_zip(lisp_environment_t* env, char* name, lisp_value_t* arguments) {
+    CHECK_ARGUMENTS_COUNT(env, builtin_fun_zip, name, FORMALS_X_Y, arguments);
+    lisp_value_t* x = arguments->values[0];
+    lisp_value_t* y = arguments->values[1];
+    if (is_empty_qexpr(x) || is_empty_qexpr(y)) {
+        return finish(arguments, lisp_value_qexpr_new());
+    }
+    if (x->value_type != VAL_QEXPR || y->value_type != VAL_QEXPR) {
+        lisp_value_t* list = x->value_type != VAL_QEXPR ? x : y;
+        return finish(arguments, call_builtin_with_value(env, builtin_fun_head, BUILTIN_HEAD, list));
+    }
+    long count = x->count < y->count ? x->count : y->count;
+    lisp_value_t* result = lisp_value_qexpr_new();
+    for (long i = 0; !is_lisp_value_null(result) && i < count; i++) {
+        lisp_value_t* pair = lisp_value_qexpr_new();
+        if (is_lisp_value_null(pair) || !append_item(pair, x->values[i]) || !append_item(pair, y->values[i])
+            || !append_lisp_value(result, pair)) {
+            lisp_value_delete(pair);
+            lisp_value_delete(result);
+            result = get_null_lisp_value();
+        }
+    }
+    return finish(arguments, result);
+}
+
+/* The prelude returns {nil nil} for an empty list, its recursion evaluates the symbols to {} */
+static lisp_value_t* builtin_fun_unzip(lisp_environment_t* env, char* name, lisp_value_t* arguments) {
+    CHECK_ARGUMENTS_COUNT(env, builtin_fun_unzip, name, FORMALS_L, arguments);
+    lisp_value_t* list = arguments->values[0];
+    if (is_empty_qexpr(list)) {
+        lisp_value_t* result = lisp_value_qexpr_new();
+        bool ok = !is_lisp_value_null(result)
+            && append_lisp_value(result, lisp_value_symbol_new(SYMBOL_NIL))
+            && append_lisp_value(result, lisp_value_symbol_new(SYMBOL_NIL));
+        if (!ok) {
+            lisp_value_delete(result);
+            result = get_null_lisp_value();
+        }
+        return finish(arguments, result);
+    }
+    if (list->value_type != VAL_QEXPR) {
+        return finish(arguments, call_builtin_with_value(env, builtin_fun_head, BUILTIN_HEAD, list));
+    }
+
+    // the pairs are evaluated first, the deepest recursion(the last pair) is joined first
+    lisp_value_t* pairs = lisp_value_qexpr_new();
+    for (long i = 0; !is_lisp_value_null(pairs) && i < list->count; i++) {
+        lisp_value_t* pair = evaluate_item(env, list->values[i]);
+        if (is_evaluation_aborted_by(pair)) {
+            lisp_value_delete(pairs);
+            return finish(arguments, pair);
+        }
+        if (!append_lisp_value(pairs, pair)) {
+            lisp_value_delete(pair);
+            lisp_value_delete(pairs);
+            pairs = get_null_lisp_value();
+        }
+    }
+    if (is_lisp_value_null(pairs)) {
+        return finish(arguments, pairs);
+    }
+    for (long i = pairs->count - 1; i >= 0; i--) {
+        if (pairs->values[i]->value_type != VAL_QEXPR) {
+            lisp_value_t* error = call_builtin_with_value(env, builtin_fun_head, BUILTIN_HEAD, pairs->values[i]);
+            lisp_value_delete(pairs);
+            return finish(arguments, error);
+        }
+    }
+
+    lisp_value_t* firsts = lisp_value_qexpr_new();
+    lisp_value_t* rests = lisp_value_qexpr_new();
+    lisp_value_t* result = lisp_value_qexpr_new();
+    bool ok = !is_lisp_value_null(firsts) && !is_lisp_value_null(rests) && !is_lisp_value_null(result);
+    for (long i = 0; ok && i < pairs->count; i++) {
+        lisp_value_t* pair = pairs->values[i];
+        for (long j = 0; ok && j < pair->count; j++) {
+            ok = append_lisp_value(j == 0 ? firsts : rests, lisp_value_share(pair->values[j]));
+            if (!ok) {
+                lisp_value_delete(pair->values[j]);
+            }
+        }
+    }
+    lisp_value_delete(pairs);
+    if (ok && append_lisp_value(result, firsts)) {
+        firsts = get_null_lisp_value();
+        ok = append_lisp_value(result, rests);
+        rests = ok ? get_null_lisp_value() : rests;
+    } else {
+        ok = false;
+    }
+    if (!ok) {
+        lisp_value_delete(firsts);
+        lisp_value_delete(rests);
+        lisp_value_delete(result);
+        result = get_null_lisp_value();
+    }
+    return finish(arguments, result);
+}
+
+bool lisp_environment_setup_list_functions(lisp_environment_t* env) {
+    bool ok = true;
+    ok = ok && lisp_environment_register_builtin_function(env, BUILTIN_NTH, builtin_fun_nth);
+    ok = ok && lisp_environment_register_builtin_function(env, BUILTIN_LAST, builtin_fun_last);
+    ok = ok && lisp_environment_register_builtin_function(env, BUILTIN_MAP, builtin_fun_map);
+    ok = ok && lisp_environment_register_builtin_function(env, BUILTIN_FILTER, builtin_fun_filter);
+    ok = ok && lisp_environment_register_builtin_function(env, BUILTIN_REVERSE, builtin_fun_reverse);
+    ok = ok && lisp_environment_register_builtin_function(env, BUILTIN_FOLDL, builtin_fun_foldl);
+    ok = ok && lisp_environment_register_builtin_function(env, BUILTIN_FOLDR, builtin_fun_foldr);
+    ok = ok && lisp_environment_register_builtin_function(env, BUILTIN_TAKE, builtin_fun_take);
+    ok = ok && lisp_environment_register_builtin_function(env, BUILTIN_DROP, builtin_fun_drop);
+    ok = ok && lisp_environment_register_builtin_function(env, BUILTIN_ELEM, builtin_fun_elem);
+    ok = ok && lisp_environment_register_builtin_function(env, BUILTIN_LOOKUP, builtin_fun_lookup);
+    ok = ok && lisp_environment_register_builtin_function(env, BUILTIN_ZIP, builtin_fun_zip);
+    ok = ok && lisp_environment_register_builtin_function(env, BUILTIN_UNZIP, builtin_fun_unzip);
+    return ok;
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include "interpreter.h"
+
+/* The native list library, the list functions of prelude.mlisp implemented as builtins that run in linear time:
+ * nth, last, map, filter, reverse, foldl, foldr, take, drop, elem, lookup, zip and unzip(len and init are builtins).
+ * The results and the errors are the ones of the prelude functions: the items are evaluated like fst does(eval of
+ * {item}), the functions are called in the same order, a wrong argument fails in the builtin the prelude function
+ * fails in(for example head), and a call with fewer arguments is partially applied.
+ * The library is optional, it is registered after the prelude is loaded and replaces the prelude functions of the same
+ * names, later definitions of the names are rejected like the definitions of other builtins.
+ * The deviations from the prelude functions:
+ *  * the functions themselves are builtins, they are printed as builtins, a partially applied function is printed as
+ *    (\ {l} {builtin: map f l})
+ *  * a call with more arguments than the prelude function has is an error of invalid number of arguments
+ *  * the frames of the prelude functions are not created, so a function passed to the library can not see their
+ *    arguments(for example l of map) through dynamic scoping
+ *  * the recursion of the prelude functions is limited by the evaluation stack budget, the library has no limit
+ *  * nth with a negative index and last of {} evaluate to (), drop and take with a negative count to {}, the prelude
+ *    functions never return
+ */
+
+/**
+ * Binds the native list library as builtins in env, the functions bound to the same names(the prelude functions) are
+ * replaced, so it is called after the prelude is loaded
+ * @return false if out of memory
+ */
+bool lisp_environment_setup_list_functions(lisp_environment_t* env);
@@ -0,0 +1,612 @@
+// fileno and madvise are not declared in strict ISO C mode
+#define _DEFAULT_SOURCE
+
+#include "reader.h"
+#include "config.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_UNIX_STYLE_OS)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "cache.h"
+#include "heap.h"
+#include "scan.h"
+
+static char* ERR_EXPECTED_MESSAGE_TEMPLATE = "%s:%ld:%ld: error: expected %s at %s\n";
+static char* ERR_UNABLE_TO_OPEN_FILE_MESSAGE_TEMPLATE = "%s: error: Unable to open file!\n";
+static char* ERR_UNABLE_TO_READ_FILE_MESSAGE_TEMPLATE = "%s: error: Unable to read file!\n";
+
+static char* EXPECTED_IN_ROOT = "expression or end of input";
+static char* EXPECTED_IN_SEXPR = "expression or ')'";
+static char* EXPECTED_IN_QEXPR = "expression or '}'";
+static char* EXPECTED_END_OF_STRING = "'\"'";
+static char* EXPECTED_DIGIT = "digit";
+
+static char* LITERAL_TRUE = "true";
+static char* LITERAL_FALSE = "false";
+
+// tokens that fit are copied to the stack to be terminated
+static constexpr size_t TOKEN_BUFFER_SIZE = 64;
+// the buffer of a file grows only for a token that does not fit
+static constexpr size_t FILE_BUFFER_INITIAL_SIZE = 65536;
+
+typedef struct lisp_reader_t {
+    char* filename;
+    // NULL when the whole source is in the buffer
+    FILE* file;
+    bool is_at_end_of_file;
+    bool is_read_failed;
+    bool is_out_of_memory;
+    // the part of the source that is not read yet is current..end, file_buffer is the buffer that the file is read into
+    const char* buffer;
+    const char* current;
+    const char* end;
+    char* file_buffer;
+    size_t file_buffer_capacity;
+    // the mapping of a regular file, the buffer is the whole mapping and the file is closed
+    void* mapping;
+    size_t mapping_length;
+    long long modification_time;
+    // the cache of a mapped file, NULL if the cache is not enabled
+    lisp_cache_t* cache;
+    // positions are counted from the start of the source
+    size_t buffer_position;
+    long line;
+    size_t line_start_position;
+    // the expressions that are not closed yet, the first one is a Root-expression that holds the top level expression
+    // that is read, the others are owned by it
+    lisp_value_t** open;
+    long open_count;
+    lisp_value_t* error;
+} lisp_reader_t;
+
+static size_t get_position(lisp_reader_t* reader, const char* c) {
+    return reader->buffer_position + (c - reader->buffer);
+}
+
+/* Reads more of the file after the part of the buffer that is not read yet, the pointers to the buffer are moved.
+ * On unix style systems a single read returns what is available, so an expression that is written to a pipe is read
+ * without waiting for the buffer to be filled
+ * @return false at the end of the file, or if out of memory(is_out_of_memory is set) or the read failed
+ * (is_read_failed is set) */
+static bool read_more(lisp_reader_t* reader) {
+    if (reader->file == NULL || reader->is_at_end_of_file || reader->is_read_failed) {
+        return false;
+    }
+    size_t unread = reader->end - reader->current;
+    if (unread == reader->file_buffer_capacity) {
+        char* file_buffer = realloc(reader->file_buffer, reader->file_buffer_capacity * 2);
+        if (file_buffer == NULL) {
+            reader->is_out_of_memory = true;
+            return false;
+        }
+        reader->buffer_position += reader->current - reader->buffer;
+        reader->file_buffer = file_buffer;
+        reader->file_buffer_capacity *= 2;
+    } else {
+        reader->buffer_position += reader->current - reader->buffer;
+        memmove(reader->file_buffer, reader->current, unread);
+    }
+    char* free_space = reader->file_buffer + unread;
+    size_t free_space_size = reader->file_buffer_capacity - unread;
+#if defined(_UNIX_STYLE_OS)
+    // the stdio buffer of the file is not used, so read does not skip anything
+    long count = 0;
+    do {
+        count = read(fileno(reader->file), free_space, free_space_size);
+    } while (count == -1 && errno == EINTR);
+#else
+    long count = (long) fread(free_space, 1, free_space_size, reader->file);
+    if (count == 0 && ferror(reader->file)) {
+        count = -1;
+    }
+#endif
+    reader->buffer = reader->file_buffer;
+    reader->current = reader->file_buffer;
+    reader->end = reader->file_buffer + unread + (count > 0 ? count : 0);
+    if (count == 0) {
+        reader->is_at_end_of_file = true;
+    } else if (count == -1) {
+        reader->is_read_failed = true;
+    }
+    return count > 0;
+}
+
+/* Moves to the end of a string or whitespace, the only tokens that can span lines, the reader moves to the end of the
+ * other tokens directly */
+static void advance(lisp_reader_t* reader, const char* token_end) {
+    const char* last_newline = NULL;
+    long newlines = lisp_scan_count_newlines(reader->current, token_end, &last_newline);
+    if (newlines > 0) {
+        reader->line += newlines;
+        reader->line_start_position = get_position(reader, last_newline) + 1;
+    }
+    reader->current = token_end;
+}
+
+static void skip_whitespace(lisp_reader_t* reader) {
+    do {
+        advance(reader, lisp_scan_skip_whitespace(reader->current, reader->end));
+    } while (reader->current == reader->end && read_more(reader));
+}
+
+/* The character that could not be read, the way the errors of the mpc parser(used before the reader) described it */
+static const char* describe_received(lisp_reader_t* reader, char buffer[4]) {
+    if (reader->current == reader->end) {
+        return "end of input";
+    }
+    switch (*reader->current) {
+        case '\a': return "bell";
+        case '\b': return "backspace";
+        case '\f': return "formfeed";
+        case '\r': return "carriage return";
+        case '\v': return "vertical tab";
+        case '\0': return "end of input";
+        case '\n': return "newline";
+        case '\t': return "tab";
+        case ' ': return "space";
+        default:
+            buffer[0] = '\'';
+            buffer[1] = *reader->current;
+            buffer[2] = '\'';
+            buffer[3] = '\0';
+            return buffer;
+    }
+}
+
+static lisp_value_t* error_expected(lisp_reader_t* reader, char* expected) {
+    char received_buffer[4];
+    long column = (long) (get_position(reader, reader->current) - reader->line_start_position) + 1;
+    return lisp_value_error_new(ERR_EXPECTED_MESSAGE_TEMPLATE, reader->filename, reader->line, column, expected, describe_received(reader, received_buffer));
+}
+
+// the matchers return the end of the token that starts at start, NULL if the token does not start there
+
+/* -?[0-9]*\.[0-9]+ */
+static const char* match_decimal(const char* start, const char* end) {
+    const char* c = start;
+    if (c < end && *c == '-') {
+        c++;
+    }
+    c = lisp_scan_skip_digits(c, end);
+    if (c == end || *c != '.') {
+        return NULL;
+    }
+    const char* fraction = c + 1;
+    c = lisp_scan_skip_digits(fraction, end);
+    return c == fraction ? NULL : c;
+}
+
+/* -?[0-9]+ */
+static const char* match_number(const char* start, const char* end) {
+    const char* c = start;
+    if (c < end && *c == '-') {
+        c++;
+    }
+    const char* digits = c;
+    c = lisp_scan_skip_digits(digits, end);
+    return c == digits ? NULL : c;
+}
+
+static const char* match_literal(const char* start, const char* end, const char* literal) {
+    size_t length = strlen(literal);
+    if ((size_t) (end - start) < length || memcmp(start, literal, length) != 0) {
+        return NULL;
+    }
+    return start + length;
+}
+
+/* "(\\.|[^"])*" where . is any character except a newline */
+static const char* match_string(const char* start, const char* end) {
+    const char* c = start + 1;
+    while ((c = lisp_scan_find_quote_or_escape(c, end)) < end) {
+        if (*c == '"') {
+            return c + 1;
+        }
+        // the escaped character is skipped, unless it is a newline
+        c += c + 1 < end && c[1] != '\n' ? 2 : 1;
+    }
+    return NULL;
+}
+
+/* ;[^\r\n]* */
+static const char* match_comment(const char* start, const char* end) {
+    return lisp_scan_find_line_end(start + 1, end);
+}
+
+static const char* match_symbol(const char* start, const char* end) {
+    const char* c = lisp_scan_skip_symbol_characters(start, end);
+    return c == start ? NULL : c;
+}
+
+/* Calls make with the token copied to a terminated string */
+static lisp_value_t* make_from_token(const char* start, const char* end, lisp_value_t* (*make)(char* token)) {
+    size_t length = end - start;
+    char buffer[TOKEN_BUFFER_SIZE];
+    char* token = length < TOKEN_BUFFER_SIZE ? buffer : malloc(length + 1);
+    if (token == NULL) {
+        return get_null_lisp_value();
+    }
+    memcpy(token, start, length);
+    token[length] = '\0';
+    lisp_value_t* value = make(token);
+    if (token != buffer) {
+        free(token);
+    }
+    return value;
+}
+
+static lisp_value_t* make_decimal(char* token) {
+    errno = 0;
+    double number_decimal = strtod(token, NULL);
+    if (errno != 0) {
+        return get_lisp_value_error_bad_numeric_value();
+    }
+    return lisp_value_decimal_new(number_decimal);
+}
+
+static lisp_value_t* make_string(char* token) {
+    return lisp_value_string_new(token);
+}
+
+static lisp_value_t* make_symbol(char* token) {
+    return lisp_value_symbol_new(token);
+}
+
+/* The number of -?[0-9]+, an error if it is out of the range of long(like strtol) */
+static lisp_value_t* read_number(const char* start, const char* end) {
+    bool is_negative = *start == '-';
+    // accumulated as a negative number, which has the larger range
+    long number = 0;
+    for (const char* c = is_negative ? start + 1 : start; c < end; c++) {
+        int digit = *c - '0';
+        if (number < (LONG_MIN + digit) / 10) {
+            return get_lisp_value_error_bad_numeric_value();
+        }
+        number = number * 10 - digit;
+    }
+    if (!is_negative) {
+        if (number == LONG_MIN) {
+            return get_lisp_value_error_bad_numeric_value();
+        }
+        number = -number;
+    }
+    return lisp_value_number_new(number);
+}
+
+/* A token is complete when the characters after it are in the buffer, or the file is read to the end */
+static bool is_token_complete(lisp_reader_t* reader) {
+    if (reader->file == NULL || reader->is_at_end_of_file) {
+        return true;
+    }
+    const char* start = reader->current;
+    const char* end = reader->end;
+    switch (*start) {
+        case '(':
+        case ')':
+        case '{':
+        case '}':
+            return true;
+        case '"':
+            return match_string(start, end) != NULL;
+        case ';':
+            return match_comment(start, end) < end;
+        default: {
+            // decimals, numbers, booleans and symbols end before the first character that can not be in any of them
+            const char* c = lisp_scan_skip_symbol_characters(start, end);
+            while (c < end && *c == '.') {
+                c = lisp_scan_skip_symbol_characters(c + 1, end);
+            }
+            return c < end;
+        }
+    }
+}
+
+static bool open_expression(lisp_reader_t* reader, lisp_value_t* expression) {
+    lisp_value_t** open = lisp_heap_reserve_pointer_array(reader->open, reader->open_count + 1);
+    if (open == NULL) {
+        return false;
+    }
+    reader->open = open;
+    reader->open[reader->open_count] = expression;
+    reader->open_count++;
+    return true;
+}
+
+static char* get_expected(lisp_value_t* expression) {
+    switch (expression->value_type) {
+        case VAL_SEXPR:
+            return EXPECTED_IN_SEXPR;
+        case VAL_QEXPR:
+            return EXPECTED_IN_QEXPR;
+        default:
+            return EXPECTED_IN_ROOT;
+    }
+}
+
+/* Reads the next token into the innermost open expression
+ * @return NULL if the token is read, otherwise the value the reading ends with(an error or null lisp value) */
+static lisp_value_t* read_token(lisp_reader_t* reader) {
+    while (!is_token_complete(reader) && read_more(reader)) {
+    }
+    if (reader->is_out_of_memory) {
+        return get_null_lisp_value();
+    }
+    if (reader->is_read_failed) {
+        return lisp_value_error_new(ERR_UNABLE_TO_READ_FILE_MESSAGE_TEMPLATE, reader->filename);
+    }
+
+    lisp_value_t* expression = reader->open[reader->open_count - 1];
+    const char* start = reader->current;
+    const char* end = reader->end;
+    char c = *start;
+
+    if ((c == ')' && expression->value_type == VAL_SEXPR) || (c == '}' && expression->value_type == VAL_QEXPR)) {
+        reader->open_count--;
+        reader->current = start + 1;
+        return NULL;
+    }
+    if (c == '(' || c == '{') {
+        lisp_value_t* child = c == '(' ? lisp_value_sexpr_new() : lisp_value_qexpr_new();
+        if (is_lisp_value_null(child)) {
+            return child;
+        }
+        if (!append_lisp_value(expression, child)) {
+            lisp_value_delete(child);
+            return get_null_lisp_value();
+        }
+        if (!open_expression(reader, child)) {
+            return get_null_lisp_value();
+        }
+        reader->current = start + 1;
+        return NULL;
+    }
+    if (c == ';') {
+        reader->current = match_comment(start, end);
+        return NULL;
+    }
+
+    const char* token_end = NULL;
+    lisp_value_t* child = NULL;
+    if ((token_end = match_decimal(start, end)) != NULL) {
+        child = make_from_token(start, token_end, make_decimal);
+    } else if ((token_end = match_number(start, end)) != NULL) {
+        child = read_number(start, token_end);
+    } else if ((token_end = match_literal(start, end, LITERAL_TRUE)) != NULL) {
+        child = lisp_value_boolean_new(1);
+    } else if ((token_end = match_literal(start, end, LITERAL_FALSE)) != NULL) {
+        child = lisp_value_boolean_new(0);
+    } else if (c == '"') {
+        token_end = match_string(start, end);
+        if (token_end == NULL) {
+            advance(reader, end);
+            return error_expected(reader, EXPECTED_END_OF_STRING);
+        }
+        child = make_from_token(start, token_end, make_string);
+    } else if ((token_end = match_symbol(start, end)) != NULL) {
+        child = make_from_token(start, token_end, make_symbol);
+    } else if (c == '.') {
+        // the decimal that starts with . is the alternative that gets the furthest
+        reader->current++;
+        return error_expected(reader, EXPECTED_DIGIT);
+    } else {
+        return error_expected(reader, get_expected(expression));
+    }
+
+    if (is_lisp_value_null(child)) {
+        return child;
+    }
+    if (!append_lisp_value(expression, child)) {
+        lisp_value_delete(child);
+        return get_null_lisp_value();
+    }
+    if (c == '"') {
+        advance(reader, token_end);
+    } else {
+        reader->current = token_end;
+    }
+    return NULL;
+}
+
+/* Stops the reading with the error, unless it is null lisp value(out of memory)
+ * @return NULL, or null lisp value */
+static lisp_value_t* stop(lisp_reader_t* reader, lisp_value_t* error) {
+    if (is_lisp_value_null(error)) {
+        return error;
+    }
+    reader->error = error;
+    return NULL;
+}
+
+static lisp_reader_t* reader_new(const char* filename) {
+    lisp_reader_t* reader = calloc(1, sizeof(lisp_reader_t));
+    if (reader == NULL) {
+        return NULL;
+    }
+    reader->line = 1;
+    reader->filename = malloc(strlen(filename) + 1);
+    lisp_value_t* root = lisp_value_root_new();
+    if (reader->filename == NULL || is_lisp_value_null(root) || !open_expression(reader, root)) {
+        lisp_value_delete(root);
+        lisp_reader_delete(reader);
+        return NULL;
+    }
+    strcpy(reader->filename, filename);
+    return reader;
+}
+
+lisp_reader_t* lisp_reader_new(const char* filename, const char* source, size_t length) {
+    lisp_reader_t* reader = reader_new(filename);
+    if (reader == NULL) {
+        return NULL;
+    }
+    reader->buffer = source;
+    reader->current = source;
+    reader->end = source + length;
+    return reader;
+}
+
+/* Reads a regular file from a read-only mapping of it, without copying it to a buffer, repeated loads of a file are
+ * served by the page cache
+ * @return false if the file is not mapped(it is not a regular file, it is empty or mmap fails), then it is read in
+ * blocks */
+static bool map_file(lisp_reader_t* reader) {
+#if defined(_UNIX_STYLE_OS)
+    struct stat file_status;
+    if (fstat(fileno(reader->file), &file_status) == -1 || !S_ISREG(file_status.st_mode) || file_status.st_size <= 0
+        || (unsigned long long) file_status.st_size > SIZE_MAX) {
+        return false;
+    }
+    size_t length = file_status.st_size;
+    void* mapping = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fileno(reader->file), 0);
+    if (mapping == MAP_FAILED) {
+        return false;
+    }
+    madvise(mapping, length, MADV_SEQUENTIAL);
+    fclose(reader->file);
+    reader->file = NULL;
+    reader->mapping = mapping;
+    reader->mapping_length = length;
+    reader->modification_time = file_status.st_mtime;
+    reader->buffer = mapping;
+    reader->current = mapping;
+    reader->end = reader->buffer + length;
+    return true;
+#else
+    (void) reader;
+    return false;
+#endif
+}
+
+lisp_reader_t* lisp_reader_new_file(const char* filename) {
+    lisp_reader_t* reader = reader_new(filename);
+    if (reader == NULL) {
+        return NULL;
+    }
+    reader->file = fopen(filename, "rb");
+    if (reader->file == NULL) {
+        if (stop(reader, lisp_value_error_new(ERR_UNABLE_TO_OPEN_FILE_MESSAGE_TEMPLATE, filename)) != NULL) {
+            lisp_reader_delete(reader);
+            return NULL;
+        }
+        return reader;
+    }
+    if (map_file(reader)) {
+        reader->cache = lisp_cache_open(filename, reader->buffer, reader->end - reader->buffer, reader->modification_time);
+        return reader;
+    }
+    reader->file_buffer = malloc(FILE_BUFFER_INITIAL_SIZE);
+    if (reader->file_buffer == NULL) {
+        lisp_reader_delete(reader);
+        return NULL;
+    }
+    reader->file_buffer_capacity = FILE_BUFFER_INITIAL_SIZE;
+    reader->buffer = reader->file_buffer;
+    reader->current = reader->file_buffer;
+    reader->end = reader->file_buffer;
+    return reader;
+}
+
+lisp_value_t* lisp_reader_next(lisp_reader_t* reader) {
+    if (reader->error != NULL) {
+        return NULL;
+    }
+    if (reader->cache != NULL && lisp_cache_is_valid(reader->cache)) {
+        return lisp_cache_next(reader->cache);
+    }
+    lisp_value_t* root = reader->open[0];
+    while (root->count == 0 || reader->open_count > 1) {
+        skip_whitespace(reader);
+        if (reader->is_out_of_memory) {
+            return get_null_lisp_value();
+        }
+        if (reader->is_read_failed) {
+            return stop(reader, lisp_value_error_new(ERR_UNABLE_TO_READ_FILE_MESSAGE_TEMPLATE, reader->filename));
+        }
+        if (reader->current == reader->end) {
+            if (reader->open_count == 1) {
+                if (reader->cache != NULL) {
+                    lisp_cache_commit(reader->cache);
+                }
+                return NULL;
+            }
+            return stop(reader, error_expected(reader, get_expected(reader->open[reader->open_count - 1])));
+        }
+        lisp_value_t* result = read_token(reader);
+        if (result != NULL) {
+            return stop(reader, result);
+        }
+    }
+    lisp_value_t* expression = lisp_value_pop_child(root, 0);
+    if (reader->cache != NULL) {
+        lisp_cache_add(reader->cache, expression);
+    }
+    return expression;
+}
+
+lisp_value_t* lisp_reader_get_error(lisp_reader_t* reader) {
+    return reader->error;
+}
+
+void lisp_reader_delete(lisp_reader_t* reader) {
+    if (reader->open != NULL) {
+        lisp_value_delete(reader->open[0]);
+    }
+    lisp_heap_free_pointer_array(reader->open);
+    if (reader->error != NULL) {
+        lisp_value_delete(reader->error);
+    }
+    if (reader->file != NULL) {
+        fclose(reader->file);
+    }
+#if defined(_UNIX_STYLE_OS)
+    if (reader->mapping != NULL) {
+        munmap(reader->mapping, reader->mapping_length);
+    }
+#endif
+    if (reader->cache != NULL) {
+        lisp_cache_delete(reader->cache);
+    }
+    free(reader->file_buffer);
+    free(reader->filename);
+    free(reader);
+}
+
+/* Reads the expressions to a Root-expression, the reader is deleted */
+static lisp_value_t* read_all(lisp_reader_t* reader) {
+    if (reader == NULL) {
+        return get_null_lisp_value();
+    }
+    lisp_value_t* root = lisp_value_root_new();
+    lisp_value_t* expression = NULL;
+    while (!is_lisp_value_null(root) && (expression = lisp_reader_next(reader)) != NULL) {
+        if (is_lisp_value_null(expression) || !append_lisp_value(root, expression)) {
+            lisp_value_delete(expression);
+            lisp_value_delete(root);
+            root = get_null_lisp_value();
+        }
+    }
+    if (!is_lisp_value_null(root) && reader->error != NULL) {
+        lisp_value_delete(root);
+        root = lisp_value_share(reader->error);
+    }
+    lisp_reader_delete(reader);
+    return root;
+}
+
+lisp_value_t* lisp_read(const char* filename, const char* source, size_t length) {
+    return read_all(lisp_reader_new(filename, source, length));
+}
+
+lisp_value_t* lisp_read_file(const char* filename) {
+    return read_all(lisp_reader_new_file(filename));
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <stddef.h>
+
+#include "interpreter.h"
+
+/* The reader of the language, it reads the source in a single pass and makes the values directly. The grammar:
+ *   number      : /-?[0-9]+/
+ *   decimal     : /-?[0-9]*\.[0-9]+/
+ *   boolean     : "true" | "false"
+ *   string      : /"(\\.|[^"])*"/
+ *   comment     : /;[^\r\n]* /
+ *   symbol      : /[a-zA-Z0-9_+\-*\/\\=<>!&%^|]+/
+ *   sexpr       : '(' <expr>* ')'
+ *   qexpr       : '{' <expr>* '}'
+ *   expr        : <decimal> | <number> | <boolean> | <string> | <comment> | <symbol> | <sexpr> | <qexpr>
+ *   my_own_lisp : /^/ <expr>* /$/
+ * The expressions are matched in the order of the grammar: decimal, number, boolean, string, comment, symbol, sexpr
+ * and qexpr, every token takes the longest run of characters its regex matches, and whitespace is skipped after
+ * every token, so the reader accepts the programs the grammar accepts and splits them into the same values
+ * (for example 1-2 is the numbers 1 and -2, and truex is the boolean true and the symbol x).
+ * A program that is not accepted is reported with the line and the column of the character that can not be read.
+ * A regular file is read from a read-only mapping of it, other files are read in blocks, an expression is returned as
+ * soon as it is read, so the memory of reading a file is bounded by its largest top level expression.
+ * When the parse cache is enabled(see cache.h) the expressions of a mapped file are read from its cache file if it is
+ * valid, otherwise the cache file is written while the file is read.
+ */
+
+typedef struct lisp_reader_t lisp_reader_t;
+
+/**
+ * @param filename the name used in the error messages
+ * @param source length characters, source does not have to be terminated, it is used until the reader is deleted
+ * @return NULL if out of memory
+ */
+lisp_reader_t* lisp_reader_new(const char* filename, const char* source, size_t length);
+/**
+ * @return NULL if out of memory, a reader that stops with an Error if the file can not be opened
+ */
+lisp_reader_t* lisp_reader_new_file(const char* filename);
+/**
+ * Reads the next top level expression, the comments are skipped
+ * @return the expression, NULL at the end of the source or when the reading stops with an error(see
+ * lisp_reader_get_error), null lisp value if out of memory
+ */
+lisp_value_t* lisp_reader_next(lisp_reader_t* reader);
+/**
+ * @return the Error "filename:line:column: error: ..." that the reading stopped with, NULL if there is none,
+ * the error is owned by the reader
+ */
+lisp_value_t* lisp_reader_get_error(lisp_reader_t* reader);
+void lisp_reader_delete(lisp_reader_t* reader);
+
+/**
+ * Reads all of the expressions of source
+ * @param filename the name used in the error message
+ * @param source length characters, source does not have to be terminated
+ * @return Root-expression of the expressions(the comments are skipped), Error "filename:line:column: error: ..." if
+ * source is not a program, null lisp value if out of memory
+ */
+lisp_value_t* lisp_read(const char* filename, const char* source, size_t length);
+/**
+ * Reads all of the expressions of the file
+ * @return like lisp_read, Error if the file can not be read
+ */
+lisp_value_t* lisp_read_file(const char* filename);
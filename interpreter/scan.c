@@ -0,0 +1,341 @@
+#include "scan.h"
+#include "config.h"
+
+#include <stddef.h>
+
+#if defined(_X86_64_SIMD_SCAN)
+#include <immintrin.h>
+#endif
+
+typedef enum {
+    SCAN_WHITESPACE,
+    SCAN_DIGITS,
+    SCAN_SYMBOL_CHARACTERS,
+    SCAN_LINE_END,
+    SCAN_QUOTE_OR_ESCAPE
+} scan_kind_t;
+
+typedef struct scan_kernels_t {
+    const char* (*skip_whitespace)(const char* start, const char* end);
+    const char* (*skip_digits)(const char* start, const char* end);
+    const char* (*skip_symbol_characters)(const char* start, const char* end);
+    const char* (*find_line_end)(const char* start, const char* end);
+    const char* (*find_quote_or_escape)(const char* start, const char* end);
+    long (*count_newlines)(const char* start, const char* end, const char** last_newline);
+} scan_kernels_t;
+
+/* The characters of the regex of symbol */
+static bool is_symbol_character(char c) {
+    if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9')) {
+        return true;
+    }
+    switch (c) {
+        case '_': case '+': case '-': case '*': case '/': case '\\': case '=':
+        case '<': case '>': case '!': case '&': case '%': case '^': case '|':
+            return true;
+        default:
+            return false;
+    }
+}
+
+/* Whether c ends the run of kind */
+static inline bool is_stop(scan_kind_t kind, char c) {
+    switch (kind) {
+        case SCAN_WHITESPACE:
+            return !(c == ' ' || (c >= '\t' && c <= '\r'));
+        case SCAN_DIGITS:
+            return !(c >= '0' && c <= '9');
+        case SCAN_SYMBOL_CHARACTERS:
+            return !is_symbol_character(c);
+        case SCAN_LINE_END:
+            return c == '\r' || c == '\n';
+        case SCAN_QUOTE_OR_ESCAPE:
+            return c == '"' || c == '\\';
+    }
+    return true;
+}
+
+static inline const char* scalar_scan(scan_kind_t kind, const char* start, const char* end) {
+    const char* c = start;
+    while (c < end && !is_stop(kind, *c)) {
+        c++;
+    }
+    return c;
+}
+
+static long scalar_count_newlines(const char* start, const char* end, const char** last_newline) {
+    long count = 0;
+    for (const char* c = start; c < end; c++) {
+        if (*c == '\n') {
+            count++;
+            *last_newline = c;
+        }
+    }
+    return count;
+}
+
+#if !defined(_X86_64_SIMD_SCAN)
+
+static const char* scalar_skip_whitespace(const char* start, const char* end) {
+    return scalar_scan(SCAN_WHITESPACE, start, end);
+}
+
+static const char* scalar_skip_digits(const char* start, const char* end) {
+    return scalar_scan(SCAN_DIGITS, start, end);
+}
+
+static const char* scalar_skip_symbol_characters(const char* start, const char* end) {
+    return scalar_scan(SCAN_SYMBOL_CHARACTERS, start, end);
+}
+
+static const char* scalar_find_line_end(const char* start, const char* end) {
+    return scalar_scan(SCAN_LINE_END, start, end);
+}
+
+static const char* scalar_find_quote_or_escape(const char* start, const char* end) {
+    return scalar_scan(SCAN_QUOTE_OR_ESCAPE, start, end);
+}
+
+static const scan_kernels_t SCALAR_KERNELS = {
+    scalar_skip_whitespace,
+    scalar_skip_digits,
+    scalar_skip_symbol_characters,
+    scalar_find_line_end,
+    scalar_find_quote_or_escape,
+    scalar_count_newlines
+};
+
+#else
+
+/* SSE2 is a part of x86-64, the kernels work on every x86-64 cpu */
+
+/* The characters of the block that are in low..high(unsigned) */
+static inline __m128i sse2_in_range(__m128i block, char low, char high) {
+    __m128i offset = _mm_sub_epi8(block, _mm_set1_epi8(low));
+    return _mm_cmpeq_epi8(_mm_min_epu8(offset, _mm_set1_epi8((char) (high - low))), offset);
+}
+
+static inline __m128i sse2_equal(__m128i block, char c) {
+    return _mm_cmpeq_epi8(block, _mm_set1_epi8(c));
+}
+
+/* A bit for every character of the block that ends the run of kind */
+static inline unsigned sse2_stop_mask(scan_kind_t kind, __m128i block) {
+    __m128i in_run;
+    switch (kind) {
+        case SCAN_WHITESPACE:
+            in_run = _mm_or_si128(sse2_in_range(block, '\t', '\r'), sse2_equal(block, ' '));
+            break;
+        case SCAN_DIGITS:
+            in_run = sse2_in_range(block, '0', '9');
+            break;
+        case SCAN_SYMBOL_CHARACTERS: {
+            // the letters differ from the upper case ones only by 0x20, the other characters are grouped by ranges
+            __m128i letters = sse2_in_range(_mm_or_si128(block, _mm_set1_epi8(0x20)), 'a', 'z');
+            __m128i digits_and_comparisons = _mm_or_si128(sse2_in_range(block, '0', '9'), sse2_in_range(block, '<', '>'));
+            __m128i operators = _mm_or_si128(
+                _mm_or_si128(sse2_in_range(block, '%', '&'), sse2_in_range(block, '*', '+')),
+                _mm_or_si128(_mm_or_si128(sse2_equal(block, '!'), sse2_equal(block, '-')), sse2_equal(block, '/')));
+            __m128i others = _mm_or_si128(
+                _mm_or_si128(sse2_equal(block, '\\'), sse2_in_range(block, '^', '_')), sse2_equal(block, '|'));
+            in_run = _mm_or_si128(_mm_or_si128(letters, digits_and_comparisons), _mm_or_si128(operators, others));
+            break;
+        }
+        case SCAN_LINE_END:
+            return (unsigned) _mm_movemask_epi8(_mm_or_si128(sse2_equal(block, '\r'), sse2_equal(block, '\n')));
+        case SCAN_QUOTE_OR_ESCAPE:
+            return (unsigned) _mm_movemask_epi8(_mm_or_si128(sse2_equal(block, '"'), sse2_equal(block, '\\')));
+    }
+    return ~(unsigned) _mm_movemask_epi8(in_run) & 0xFFFF;
+}
+
+static inline const char* sse2_scan(scan_kind_t kind, const char* start, const char* end) {
+    const char* c = start;
+    for (; end - c >= 16; c += 16) {
+        unsigned mask = sse2_stop_mask(kind, _mm_loadu_si128((const __m128i*) c));
+        if (mask != 0) {
+            return c + __builtin_ctz(mask);
+        }
+    }
+    return scalar_scan(kind, c, end);
+}
+
+static const char* sse2_skip_whitespace(const char* start, const char* end) {
+    return sse2_scan(SCAN_WHITESPACE, start, end);
+}
+
+static const char* sse2_skip_digits(const char* start, const char* end) {
+    return sse2_scan(SCAN_DIGITS, start, end);
+}
+
+static const char* sse2_skip_symbol_characters(const char* start, const char* end) {
+    return sse2_scan(SCAN_SYMBOL_CHARACTERS, start, end);
+}
+
+static const char* sse2_find_line_end(const char* start, const char* end) {
+    return sse2_scan(SCAN_LINE_END, start, end);
+}
+
+static const char* sse2_find_quote_or_escape(const char* start, const char* end) {
+    return sse2_scan(SCAN_QUOTE_OR_ESCAPE, start, end);
+}
+
+static long sse2_count_newlines(const char* start, const char* end, const char** last_newline) {
+    long count = 0;
+    const char* c = start;
+    for (; end - c >= 16; c += 16) {
+        unsigned mask = (unsigned) _mm_movemask_epi8(sse2_equal(_mm_loadu_si128((const __m128i*) c), '\n'));
+        if (mask != 0) {
+            count += __builtin_popcount(mask);
+            *last_newline = c + 31 - __builtin_clz(mask);
+        }
+    }
+    return count + scalar_count_newlines(c, end, last_newline);
+}
+
+static const scan_kernels_t SSE2_KERNELS = {
+    sse2_skip_whitespace,
+    sse2_skip_digits,
+    sse2_skip_symbol_characters,
+    sse2_find_line_end,
+    sse2_find_quote_or_escape,
+    sse2_count_newlines
+};
+
+#define AVX2 __attribute__((target("avx2")))
+
+AVX2 static inline __m256i avx2_in_range(__m256i block, char low, char high) {
+    __m256i offset = _mm256_sub_epi8(block, _mm256_set1_epi8(low));
+    return _mm256_cmpeq_epi8(_mm256_min_epu8(offset, _mm256_set1_epi8((char) (high - low))), offset);
+}
+
+AVX2 static inline __m256i avx2_equal(__m256i block, char c) {
+    return _mm256_cmpeq_epi8(block, _mm256_set1_epi8(c));
+}
+
+/* The character set of symbol is looked up by the nibbles of the characters: the table of the high nibble has a bit
+ * for every row 0x20..0x70 of the ascii table, the table of the low nibble has the bits of the rows that have a
+ * character of the set in that column, so a character is in the set when the bits of its nibbles intersect */
+AVX2 static inline __m256i avx2_is_symbol_character(__m256i block) {
+    const __m256i low_nibble_table = _mm256_broadcastsi128_si256(_mm_setr_epi8(
+        0x2A, 0x3F, 0x3E, 0x3E, 0x3E, 0x3F, 0x3F, 0x3E, 0x3E, 0x3E, 0x3D, 0x15, 0x3E, 0x17, 0x1E, 0x1D));
+    const __m256i high_nibble_table = _mm256_broadcastsi128_si256(_mm_setr_epi8(
+        0x00, 0x00, 0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00));
+    const __m256i nibble_mask = _mm256_set1_epi8(0x0F);
+    __m256i low_bits = _mm256_shuffle_epi8(low_nibble_table, _mm256_and_si256(block, nibble_mask));
+    __m256i high_bits = _mm256_shuffle_epi8(high_nibble_table, _mm256_and_si256(_mm256_srli_epi16(block, 4), nibble_mask));
+    return _mm256_xor_si256(_mm256_cmpeq_epi8(_mm256_and_si256(low_bits, high_bits), _mm256_setzero_si256()), _mm256_set1_epi8(-1));
+}
+
+AVX2 static inline unsigned avx2_stop_mask(scan_kind_t kind, __m256i block) {
+    __m256i in_run;
+    switch (kind) {
+        case SCAN_WHITESPACE:
+            in_run = _mm256_or_si256(avx2_in_range(block, '\t', '\r'), avx2_equal(block, ' '));
+            break;
+        case SCAN_DIGITS:
+            in_run = avx2_in_range(block, '0', '9');
+            break;
+        case SCAN_SYMBOL_CHARACTERS:
+            in_run = avx2_is_symbol_character(block);
+            break;
+        case SCAN_LINE_END:
+            return (unsigned) _mm256_movemask_epi8(_mm256_or_si256(avx2_equal(block, '\r'), avx2_equal(block, '\n')));
+        case SCAN_QUOTE_OR_ESCAPE:
+            return (unsigned) _mm256_movemask_epi8(_mm256_or_si256(avx2_equal(block, '"'), avx2_equal(block, '\\')));
+    }
+    return ~(unsigned) _mm256_movemask_epi8(in_run);
+}
+
+AVX2 static inline const char* avx2_scan(scan_kind_t kind, const char* start, const char* end) {
+    const char* c = start;
+    for (; end - c >= 32; c += 32) {
+        unsigned mask = avx2_stop_mask(kind, _mm256_loadu_si256((const __m256i*) c));
+        if (mask != 0) {
+            return c + __builtin_ctz(mask);
+        }
+    }
+    return sse2_scan(kind, c, end);
+}
+
+AVX2 static const char* avx2_skip_whitespace(const char* start, const char* end) {
+    return avx2_scan(SCAN_WHITESPACE, start, end);
+}
+
+AVX2 static const char* avx2_skip_digits(const char* start, const char* end) {
+    return avx2_scan(SCAN_DIGITS, start, end);
+}
+
+AVX2 static const char* avx2_skip_symbol_characters(const char* start, const char* end) {
+    return avx2_scan(SCAN_SYMBOL_CHARACTERS, start, end);
+}
+
+AVX2 static const char* avx2_find_line_end(const char* start, const char* end) {
+    return avx2_scan(SCAN_LINE_END, start, end);
+}
+
+AVX2 static const char* avx2_find_quote_or_escape(const char* start, const char* end) {
+    return avx2_scan(SCAN_QUOTE_OR_ESCAPE, start, end);
+}
+
+AVX2 static long avx2_count_newlines(const char* start, const char* end, const char** last_newline) {
+    long count = 0;
+    const char* c = start;
+    for (; end - c >= 32; c += 32) {
+        unsigned mask = (unsigned) _mm256_movemask_epi8(avx2_equal(_mm256_loadu_si256((const __m256i*) c), '\n'));
+        if (mask != 0) {
+            count += __builtin_popcount(mask);
+            *last_newline = c + 31 - __builtin_clz(mask);
+        }
+    }
+    return count + sse2_count_newlines(c, end, last_newline);
+}
+
+static const scan_kernels_t AVX2_KERNELS = {
+    avx2_skip_whitespace,
+    avx2_skip_digits,
+    avx2_skip_symbol_characters,
+    avx2_find_line_end,
+    avx2_find_quote_or_escape,
+    avx2_count_newlines
+};
+
+#endif
+
+static thread_local const scan_kernels_t* kernels = NULL;
+
+static const scan_kernels_t* get_kernels() {
+    if (kernels == NULL) {
+#if defined(_X86_64_SIMD_SCAN)
+        __builtin_cpu_init();
+        kernels = __builtin_cpu_supports("avx2") ? &AVX2_KERNELS : &SSE2_KERNELS;
+#else
+        kernels = &SCALAR_KERNELS;
+#endif
+    }
+    return kernels;
+}
+
+const char* lisp_scan_skip_whitespace(const char* start, const char* end) {
+    return get_kernels()->skip_whitespace(start, end);
+}
+
+const char* lisp_scan_skip_digits(const char* start, const char* end) {
+    return get_kernels()->skip_digits(start, end);
+}
+
+const char* lisp_scan_skip_symbol_characters(const char* start, const char* end) {
+    return get_kernels()->skip_symbol_characters(start, end);
+}
+
+const char* lisp_scan_find_line_end(const char* start, const char* end) {
+    return get_kernels()->find_line_end(start, end);
+}
+
+const char* lisp_scan_find_quote_or_escape(const char* start, const char* end) {
+    return get_kernels()->find_quote_or_escape(start, end);
+}
+
+long lisp_scan_count_newlines(const char* start, const char* end, const char** last_newline) {
+    return get_kernels()->count_newlines(start, end, last_newline);
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+/* The scanning of the reader, every function returns the first character in start..end that ends the run it scans,
+ * end if the run goes to the end.
+ * The runs are scanned 32(AVX2) or 16(SSE2) characters at a time on x86-64(see config.h), the kernel is chosen by the
+ * features of the cpu when it is first used, on other systems and at the end of the source the characters are scanned
+ * one at a time.
+ */
+
+/**
+ * @return the first character that is not whitespace(' ', '\t', '\n', '\v', '\f' or '\r')
+ */
+const char* lisp_scan_skip_whitespace(const char* start, const char* end);
+/**
+ * @return the first character that is not a digit
+ */
+const char* lisp_scan_skip_digits(const char* start, const char* end);
+/**
+ * @return the first character that is not in the character set of the regex of symbol([a-zA-Z0-9_+\-*\/\\=<>!&%^|])
+ */
+const char* lisp_scan_skip_symbol_characters(const char* start, const char* end);
+/**
+ * @return the first '\r' or '\n', the end of a comment
+ */
+const char* lisp_scan_find_line_end(const char* start, const char* end);
+/**
+ * @return the first '"' or '\\', the end or an escape of a string
+ */
+const char* lisp_scan_find_quote_or_escape(const char* start, const char* end);
+/**
+ * @param last_newline set to the last '\n', unchanged if there is none
+ * @return the number of '\n' in start..end
+ */
+long lisp_scan_count_newlines(const char* start, const char* end, const char** last_newline);
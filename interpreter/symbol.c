@@ -0,0 +1,84 @@
+#include "symbol.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct lisp_symbol_entry_t {
+    size_t hash;
+    char name[];
+} lisp_symbol_entry_t;
+
+static constexpr size_t SYMBOL_TABLE_INITIAL_CAPACITY = 256;
+
+// open addressing table that is kept at most half full
+static lisp_symbol_entry_t** symbol_table = NULL;
+static size_t symbol_table_capacity = 0;
+static size_t symbol_table_count = 0;
+
+static size_t hash_name(const char* name) {
+    // FNV-1a
+    size_t hash = 14695981039346656037ULL;
+    for (const unsigned char* c = (const unsigned char*) name; *c != '\0'; c++) {
+        hash ^= *c;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static void insert_entry(lisp_symbol_entry_t** table, size_t capacity, lisp_symbol_entry_t* entry) {
+    size_t mask = capacity - 1;
+    size_t slot = entry->hash & mask;
+    while (table[slot] != NULL) {
+        slot = (slot + 1) & mask;
+    }
+    table[slot] = entry;
+}
+
+static bool grow_symbol_table() {
+    size_t capacity = symbol_table_capacity == 0 ? SYMBOL_TABLE_INITIAL_CAPACITY : symbol_table_capacity * 2;
+    lisp_symbol_entry_t** table = calloc(capacity, sizeof(lisp_symbol_entry_t*));
+    if (table == NULL) {
+        return false;
+    }
+    for (size_t i = 0; i < symbol_table_capacity; i++) {
+        if (symbol_table[i] != NULL) {
+            insert_entry(table, capacity, symbol_table[i]);
+        }
+    }
+    free(symbol_table);
+    symbol_table = table;
+    symbol_table_capacity = capacity;
+    return true;
+}
+
+char* lisp_symbol_intern(const char* name) {
+    size_t hash = hash_name(name);
+    if (symbol_table_capacity > 0) {
+        size_t mask = symbol_table_capacity - 1;
+        for (size_t slot = hash & mask; symbol_table[slot] != NULL; slot = (slot + 1) & mask) {
+            if (symbol_table[slot]->hash == hash && strcmp(symbol_table[slot]->name, name) == 0) {
+                return symbol_table[slot]->name;
+            }
+        }
+    }
+
+    if ((symbol_table_count + 1) * 2 > symbol_table_capacity && !grow_symbol_table()) {
+        return NULL;
+    }
+
+    size_t name_size = strlen(name) + 1;
+    lisp_symbol_entry_t* entry = malloc(sizeof(lisp_symbol_entry_t) + name_size);
+    if (entry == NULL) {
+        return NULL;
+    }
+    entry->hash = hash;
+    memcpy(entry->name, name, name_size);
+    insert_entry(symbol_table, symbol_table_capacity, entry);
+    symbol_table_count++;
+    return entry->name;
+}
+
+size_t lisp_symbol_hash(const char* interned_name) {
+    const lisp_symbol_entry_t* entry = (const lisp_symbol_entry_t*) (interned_name - offsetof(lisp_symbol_entry_t, name));
+    return entry->hash;
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <stddef.h>
+
+/* The table of interned symbol names
+ * Every symbol name is stored once for the lifetime of the process, so two symbols are equal exactly when their
+ * interned names are the same pointer. The hash of an interned name is computed once when it is interned.
+ * The table is not synchronized, symbols must be interned by one thread at a time.
+ */
+
+/**
+ * @return the unique interned copy of name, NULL if out of memory
+ */
+char* lisp_symbol_intern(const char* name);
+/**
+ * @param interned_name name returned by lisp_symbol_intern
+ */
+size_t lisp_symbol_hash(const char* interned_name);
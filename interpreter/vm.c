@@ -0,0 +1,608 @@
+// getrlimit is not declared in strict ISO C mode
+#define _DEFAULT_SOURCE
+
+#include "vm.h"
+#include "heap.h"
+#include "symbol.h"
+#include "jit.h"
+#include "config.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#if defined(_UNIX_STYLE_OS)
+#include <sys/resource.h>
+#endif
+
+static char* BUILTIN_IF = "if";
+static char* ERR_EVALUATION_STACK_OVERFLOW_MESSAGE = "Evaluation stack overflow";
+
+typedef struct lisp_compiler_t {
+    lisp_instruction_t* instructions;
+    size_t instructions_count;
+    size_t instructions_capacity;
+    lisp_value_t** constants;
+    size_t constants_count;
+    size_t constants_capacity;
+    size_t stack_size;
+    size_t max_stack_size;
+    char* if_symbol;
+    bool ok;
+} lisp_compiler_t;
+
+static int emit(lisp_compiler_t* compiler, lisp_opcode_t opcode, int operand1, int operand2) {
+    if (!compiler->ok) {
+        return 0;
+    }
+    if (compiler->instructions_count == compiler->instructions_capacity) {
+        size_t capacity = compiler->instructions_capacity == 0 ? 16 : compiler->instructions_capacity * 2;
+        lisp_instruction_t* instructions = realloc(compiler->instructions, sizeof(lisp_instruction_t) * capacity);
+        if (instructions == NULL) {
+            compiler->ok = false;
+            return 0;
+        }
+        compiler->instructions = instructions;
+        compiler->instructions_capacity = capacity;
+    }
+    compiler->instructions[compiler->instructions_count] = (lisp_instruction_t) {
+        .opcode = opcode,
+        .operand1 = operand1,
+        .operand2 = operand2
+    };
+    return (int) compiler->instructions_count++;
+}
+
+static int current_address(lisp_compiler_t* compiler) {
+    return (int) compiler->instructions_count;
+}
+
+static int add_constant(lisp_compiler_t* compiler, lisp_value_t* value) {
+    if (!compiler->ok) {
+        return 0;
+    }
+    if (compiler->constants_count == compiler->constants_capacity) {
+        size_t capacity = compiler->constants_capacity == 0 ? 8 : compiler->constants_capacity * 2;
+        lisp_value_t** constants = realloc(compiler->constants, sizeof(lisp_value_t*) * capacity);
+        if (constants == NULL) {
+            compiler->ok = false;
+            return 0;
+        }
+        compiler->constants = constants;
+        compiler->constants_capacity = capacity;
+    }
+    compiler->constants[compiler->constants_count] = lisp_value_share(value);
+    return (int) compiler->constants_count++;
+}
+
+static void push(lisp_compiler_t* compiler, size_t count) {
+    compiler->stack_size += count;
+    if (compiler->stack_size > compiler->max_stack_size) {
+        compiler->max_stack_size = compiler->stack_size;
+    }
+}
+
+/* The checks of one s-expression are chained through operand2 until the end of the s-expression is known */
+static void patch_checks(lisp_compiler_t* compiler, int checks_chain, int target) {
+    while (compiler->ok && checks_chain != -1) {
+        int next = compiler->instructions[checks_chain].operand2;
+        compiler->instructions[checks_chain].operand2 = target;
+        checks_chain = next;
+    }
+}
+
+static void compile_sexpr(lisp_compiler_t* compiler, lisp_value_t* sexpr, bool is_tail);
+
+/* Compiles the evaluation of a child of a s-expression, the value of the child is pushed */
+static void compile_child(lisp_compiler_t* compiler, lisp_value_t* child, size_t base, int* checks_chain, bool is_tail) {
+    if (child->value_type == VAL_SYMBOL) {
+        emit(compiler, OP_LOAD, add_constant(compiler, child), 0);
+        push(compiler, 1);
+    } else if (child->value_type == VAL_SEXPR) {
+        compile_sexpr(compiler, child, is_tail);
+    } else {
+        emit(compiler, OP_CONST, add_constant(compiler, child), 0);
+        push(compiler, 1);
+        if (child->value_type != VAL_ERR) {
+            return;
+        }
+    }
+    *checks_chain = emit(compiler, OP_CHECK, (int) base, *checks_chain);
+}
+
+static bool is_inlinable_if(lisp_compiler_t* compiler, lisp_value_t* sexpr) {
+    return sexpr->count == 4
+        && sexpr->values[0]->value_type == VAL_SYMBOL
+        && sexpr->values[0]->value_symbol == compiler->if_symbol
+        && sexpr->values[2]->value_type == VAL_QEXPR
+        && sexpr->values[3]->value_type == VAL_QEXPR;
+}
+
+/* (if condition {true branch} {false branch}), the branches are evaluated like builtin_eval evaluates them */
+static void compile_if(lisp_compiler_t* compiler, lisp_value_t* sexpr, size_t base, int* checks_chain, bool is_tail) {
+    compile_child(compiler, sexpr->values[0], base, checks_chain, false);
+    compile_child(compiler, sexpr->values[1], base, checks_chain, false);
+    int if_address = emit(compiler, OP_IF, 0, 0);
+
+    compiler->stack_size = base;
+    compile_sexpr(compiler, sexpr->values[2], is_tail);
+    int true_jump_address = emit(compiler, OP_JUMP, 0, 0);
+
+    compiler->stack_size = base;
+    int false_address = current_address(compiler);
+    compile_sexpr(compiler, sexpr->values[3], is_tail);
+    int false_jump_address = emit(compiler, OP_JUMP, 0, 0);
+
+    // the symbol if is not bound to the builtin if, or the condition is invalid, if is called as a function
+    compiler->stack_size = base + 2;
+    int call_address = current_address(compiler);
+    emit(compiler, OP_CONST, add_constant(compiler, sexpr->values[2]), 0);
+    emit(compiler, OP_CONST, add_constant(compiler, sexpr->values[3]), 0);
+    push(compiler, 2);
+    emit(compiler, is_tail ? OP_TAIL_CALL : OP_CALL, 4, 0);
+    compiler->stack_size -= 3;
+
+    int end_address = current_address(compiler);
+    if (compiler->ok) {
+        compiler->instructions[if_address].operand1 = false_address;
+        compiler->instructions[if_address].operand2 = call_address;
+        compiler->instructions[true_jump_address].operand1 = end_address;
+        compiler->instructions[false_jump_address].operand1 = end_address;
+    }
+}
+
+/* Compiles the evaluation of the children of sexpr(a s-expression, or a q-expression that is evaluated as a
+ * s-expression), the value of the s-expression is pushed
+ * The call that ends the evaluation of a s-expression in tail position(is_tail) is a tail call */
+static void compile_sexpr(lisp_compiler_t* compiler, lisp_value_t* sexpr, bool is_tail) {
+    size_t base = compiler->stack_size;
+    int checks_chain = -1;
+
+    if (is_inlinable_if(compiler, sexpr)) {
+        compile_if(compiler, sexpr, base, &checks_chain, is_tail);
+    } else {
+        for (long i = 0; i < sexpr->count; i++) {
+            compile_child(compiler, sexpr->values[i], base, &checks_chain, is_tail && sexpr->count == 1);
+        }
+        if (sexpr->count == 0) {
+            emit(compiler, OP_NEW_SEXPR, 0, 0);
+            push(compiler, 1);
+        } else if (sexpr->count > 1) {
+            emit(compiler, is_tail ? OP_TAIL_CALL : OP_CALL, (int) sexpr->count, 0);
+            compiler->stack_size -= sexpr->count - 1;
+        }
+    }
+
+    patch_checks(compiler, checks_chain, current_address(compiler));
+}
+
+lisp_bytecode_t* lisp_bytecode_compile(lisp_value_t* body) {
+    if (body->value_type != VAL_QEXPR) {
+        return NULL;
+    }
+
+    lisp_compiler_t compiler = {
+        .if_symbol = lisp_symbol_intern(BUILTIN_IF),
+        .ok = true
+    };
+    compiler.ok = compiler.if_symbol != NULL;
+    compile_sexpr(&compiler, body, true);
+
+    lisp_bytecode_t* bytecode = compiler.ok ? malloc(sizeof(lisp_bytecode_t)) : NULL;
+    if (bytecode == NULL) {
+        for (size_t i = 0; i < compiler.constants_count; i++) {
+            lisp_value_delete(compiler.constants[i]);
+        }
+        free(compiler.constants);
+        free(compiler.instructions);
+        return NULL;
+    }
+    bytecode->reference_count = 1;
+    bytecode->instructions = compiler.instructions;
+    bytecode->instructions_count = compiler.instructions_count;
+    bytecode->constants = compiler.constants;
+    bytecode->constants_count = compiler.constants_count;
+    bytecode->max_stack_size = compiler.max_stack_size;
+    return bytecode;
+}
+
+lisp_bytecode_t* lisp_bytecode_share(lisp_bytecode_t* bytecode) {
+    if (bytecode != NULL) {
+        bytecode->reference_count++;
+    }
+    return bytecode;
+}
+
+void lisp_bytecode_delete(lisp_bytecode_t* bytecode) {
+    if (bytecode == NULL) {
+        return;
+    }
+    bytecode->reference_count--;
+    if (bytecode->reference_count > 0) {
+        return;
+    }
+    for (size_t i = 0; i < bytecode->constants_count; i++) {
+        lisp_value_delete(bytecode->constants[i]);
+    }
+    free(bytecode->constants);
+    free(bytecode->instructions);
+    free(bytecode);
+}
+
+static bool is_evaluation_aborted_by(lisp_value_t* value) {
+    return is_lisp_value_null(value) || (is_lisp_value_error(value) && value->is_error_user_defined_value == 0);
+}
+
+/* A call of a function whose body is executed, its values are on the stack above base */
+typedef struct lisp_vm_activation_t {
+    // shared with the activation, keeps the bytecode alive
+    lisp_value_t* function;
+    lisp_bytecode_t* bytecode;
+    size_t pc;
+    size_t base;
+    lisp_environment_t* env;
+    // the environment the function was called in, env and the frames kept for tail calls are above it
+    lisp_environment_t* caller_env;
+} lisp_vm_activation_t;
+
+typedef struct lisp_vm_t {
+    lisp_value_t** stack;
+    size_t top;
+    lisp_vm_activation_t* activations;
+    size_t activations_count;
+    size_t activations_capacity;
+} lisp_vm_t;
+
+// bytes used by the stacks of all virtual machines of the thread(builtins like eval can start a nested one)
+static thread_local size_t evaluation_stack_used = 0;
+
+// the calls evaluated on the native stack(see lisp_vm_enter_native_call) and the address of the stack at the first one
+static thread_local size_t native_calls_count = 0;
+static thread_local uintptr_t native_stack_base = 0;
+static thread_local size_t native_stack_limit = 0;
+
+// the default size of the stack of the main thread on windows
+static constexpr size_t DEFAULT_NATIVE_STACK_SIZE = 1024 * 1024;
+
+static size_t get_native_stack_used(void) {
+    if (native_calls_count == 0) {
+        return 0;
+    }
+    char marker;
+    uintptr_t address = (uintptr_t) &marker;
+    return native_stack_base > address ? native_stack_base - address : address - native_stack_base;
+}
+
+/* The part of the native stack the calls can use, the frames below the first call and the builtins that the deepest
+ * call makes need the rest */
+static size_t get_native_stack_limit(void) {
+    size_t size = DEFAULT_NATIVE_STACK_SIZE;
+#if defined(_UNIX_STYLE_OS)
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_STACK, &limit) == 0) {
+        if (limit.rlim_cur == RLIM_INFINITY) {
+            return SIZE_MAX;
+        }
+        size = (size_t) limit.rlim_cur;
+    }
+#endif
+    return size / 4 * 3;
+}
+
+static size_t get_vm_size(size_t stack_capacity, size_t activations_capacity) {
+    return stack_capacity * sizeof(lisp_value_t*) + activations_capacity * sizeof(lisp_vm_activation_t);
+}
+
+/* Makes room for one more activation and stack_size more values, false if that does not fit in the budget */
+static bool reserve(lisp_vm_t* vm, size_t stack_size) {
+    size_t stack_capacity = lisp_heap_get_pointer_array_capacity(vm->stack);
+    size_t required_stack_capacity = vm->top + stack_size;
+    size_t activations_capacity = vm->activations_capacity;
+    if (required_stack_capacity <= stack_capacity && vm->activations_count < activations_capacity) {
+        return true;
+    }
+
+    // only the stacks of the virtual machines count towards the budget, the native stack has its own limit
+    size_t budget = lisp_heap_get_settings().evaluation_stack_budget;
+    size_t used_by_others = evaluation_stack_used - get_vm_size(stack_capacity, activations_capacity);
+    size_t new_stack_capacity = stack_capacity;
+    size_t new_activations_capacity = activations_capacity;
+    if (required_stack_capacity > stack_capacity) {
+        new_stack_capacity = stack_capacity * 2 > required_stack_capacity ? stack_capacity * 2 : required_stack_capacity;
+    }
+    if (vm->activations_count == activations_capacity) {
+        new_activations_capacity = activations_capacity == 0 ? 16 : activations_capacity * 2;
+    }
+    if (used_by_others + get_vm_size(new_stack_capacity, new_activations_capacity) > budget) {
+        // the last growth is limited to what is required
+        new_stack_capacity = required_stack_capacity > stack_capacity ? required_stack_capacity : stack_capacity;
+        new_activations_capacity = vm->activations_count < activations_capacity ? activations_capacity : vm->activations_count + 1;
+        if (used_by_others + get_vm_size(new_stack_capacity, new_activations_capacity) > budget) {
+            return false;
+        }
+    }
+
+    if (new_stack_capacity != stack_capacity) {
+        lisp_value_t** stack = vm->stack == NULL
+            ? lisp_heap_allocate_pointer_array(new_stack_capacity)
+            : lisp_heap_reallocate_pointer_array(vm->stack, new_stack_capacity);
+        if (stack == NULL) {
+            return false;
+        }
+        vm->stack = stack;
+        new_stack_capacity = lisp_heap_get_pointer_array_capacity(stack);
+    }
+    if (new_activations_capacity != activations_capacity) {
+        lisp_vm_activation_t* activations = realloc(vm->activations, sizeof(lisp_vm_activation_t) * new_activations_capacity);
+        if (activations == NULL) {
+            return false;
+        }
+        vm->activations = activations;
+        vm->activations_capacity = new_activations_capacity;
+    }
+    evaluation_stack_used = used_by_others + get_vm_size(new_stack_capacity, vm->activations_capacity);
+    return true;
+}
+
+static void release(lisp_vm_t* vm) {
+    evaluation_stack_used -= get_vm_size(lisp_heap_get_pointer_array_capacity(vm->stack), vm->activations_capacity);
+    lisp_heap_free_pointer_array(vm->stack);
+    free(vm->activations);
+}
+
+bool lisp_vm_enter_native_call(void) {
+    if (native_calls_count == 0) {
+        char marker;
+        native_stack_base = (uintptr_t) &marker;
+    }
+    if (native_stack_limit == 0) {
+        native_stack_limit = get_native_stack_limit();
+    }
+    if (get_native_stack_used() > native_stack_limit) {
+        return false;
+    }
+    native_calls_count++;
+    return true;
+}
+
+void lisp_vm_leave_native_call(void) {
+    native_calls_count--;
+}
+
+size_t lisp_vm_get_native_stack_available(void) {
+    if (native_stack_limit == 0) {
+        native_stack_limit = get_native_stack_limit();
+    }
+    size_t native_stack_used = get_native_stack_used();
+    return native_stack_limit > native_stack_used ? native_stack_limit - native_stack_used : 0;
+}
+
+lisp_value_t* lisp_vm_stack_overflow_error_new(void) {
+    return lisp_value_error_new(ERR_EVALUATION_STACK_OVERFLOW_MESSAGE);
+}
+
+/* The body of a function that could not be compiled is evaluated like builtin_eval evaluates it, on the native stack */
+static lisp_value_t* evaluate_body(lisp_environment_t* frame, lisp_value_userdefined_fun_t* userdefined_fun) {
+    lisp_value_t* body = lisp_value_unshare(lisp_value_share(userdefined_fun->body));
+    if (is_lisp_value_null(body)) {
+        return body;
+    }
+    body->value_type = VAL_SEXPR;
+    return evaluate_lisp_value_destructive(frame, body);
+}
+
+/* Ends the current activation with the result, the result is pushed to the stack of the caller */
+static void leave(lisp_vm_t* vm, lisp_value_t* result) {
+    lisp_vm_activation_t* activation = &vm->activations[--vm->activations_count];
+    while (vm->top > activation->base) {
+        lisp_value_delete(vm->stack[--vm->top]);
+    }
+    // the frames that were kept for the lookups of the callees of tail calls
+    while (activation->env != activation->caller_env) {
+        lisp_environment_t* kept_frame = activation->env;
+        activation->env = kept_frame->parent_environment;
+        lisp_environment_delete(kept_frame);
+    }
+    lisp_value_delete(activation->function);
+    vm->stack[vm->top++] = result;
+}
+
+/* Starts an activation of the function(consumed) with the arguments(consumed) called in env,
+ * the result is pushed instead if the body is not executed by the virtual machine */
+static void enter(lisp_vm_t* vm, lisp_environment_t* env, lisp_value_t* function, lisp_value_t* arguments) {
+    lisp_value_userdefined_fun_t* userdefined_fun = function->value_userdefined_fun;
+    lisp_value_t* result = lisp_jit_try_call(env, function, arguments);
+    if (result != NULL) {
+        lisp_value_delete(function);
+        vm->stack[vm->top++] = result;
+        return;
+    }
+    result = get_null_lisp_value();
+    lisp_environment_t* frame = lisp_environment_new_frame(userdefined_fun, arguments, &result);
+    if (is_lisp_environment_null(frame)) {
+        lisp_value_delete(function);
+        vm->stack[vm->top++] = result;
+        return;
+    }
+    frame->parent_environment = env;
+
+    if (userdefined_fun->bytecode == NULL) {
+        userdefined_fun->bytecode = lisp_bytecode_compile(userdefined_fun->body);
+    }
+    if (userdefined_fun->bytecode == NULL) {
+        result = evaluate_body(frame, userdefined_fun);
+    } else if (!reserve(vm, userdefined_fun->bytecode->max_stack_size)) {
+        result = lisp_value_error_new(ERR_EVALUATION_STACK_OVERFLOW_MESSAGE);
+    } else {
+        vm->activations[vm->activations_count++] = (lisp_vm_activation_t) {
+            .function = function,
+            .bytecode = userdefined_fun->bytecode,
+            .pc = 0,
+            .base = vm->top,
+            .env = frame,
+            .caller_env = env
+        };
+        return;
+    }
+    lisp_environment_delete(frame);
+    lisp_value_delete(function);
+    vm->stack[vm->top++] = result;
+}
+
+/* Replaces the current activation with an activation of the function(consumed) with the arguments(consumed),
+ * the frame of the current activation is the parent of the new frame, it is dropped if the new frame shadows it */
+static void enter_tail_call(lisp_vm_t* vm, lisp_value_t* function, lisp_value_t* arguments) {
+    lisp_vm_activation_t* activation = &vm->activations[vm->activations_count - 1];
+    lisp_value_userdefined_fun_t* userdefined_fun = function->value_userdefined_fun;
+    lisp_value_t* result = lisp_jit_try_call(activation->env, function, arguments);
+    if (result != NULL) {
+        lisp_value_delete(function);
+        leave(vm, result);
+        return;
+    }
+    result = get_null_lisp_value();
+    lisp_environment_t* frame = lisp_environment_new_frame(userdefined_fun, arguments, &result);
+    if (is_lisp_environment_null(frame)) {
+        lisp_value_delete(function);
+        leave(vm, result);
+        return;
+    }
+    if (is_frame_shadowed_by_function(activation->env, userdefined_fun)) {
+        frame->parent_environment = activation->env->parent_environment;
+        lisp_environment_delete(activation->env);
+    } else {
+        frame->parent_environment = activation->env;
+    }
+    activation->env = frame;
+    lisp_value_delete(activation->function);
+    activation->function = function;
+
+    if (userdefined_fun->bytecode == NULL) {
+        userdefined_fun->bytecode = lisp_bytecode_compile(userdefined_fun->body);
+    }
+    if (userdefined_fun->bytecode == NULL) {
+        leave(vm, evaluate_body(frame, userdefined_fun));
+        return;
+    }
+    // the stack of the activation is empty, the activation itself is reused
+    vm->activations_count--;
+    bool is_reserved = reserve(vm, userdefined_fun->bytecode->max_stack_size);
+    vm->activations_count++;
+    if (!is_reserved) {
+        leave(vm, lisp_value_error_new(ERR_EVALUATION_STACK_OVERFLOW_MESSAGE));
+        return;
+    }
+    activation = &vm->activations[vm->activations_count - 1];
+    activation->bytecode = userdefined_fun->bytecode;
+    activation->pc = 0;
+}
+
+/* The top count values of the stack are the operator and the arguments of a call */
+static void call(lisp_vm_t* vm, size_t count, bool is_tail) {
+    lisp_environment_t* env = vm->activations[vm->activations_count - 1].env;
+    lisp_value_t* arguments = lisp_value_sexpr_new();
+    for (size_t i = vm->top - count; i < vm->top; i++) {
+        if (!append_lisp_value(arguments, vm->stack[i])) {
+            lisp_value_delete(vm->stack[i]);
+        }
+    }
+    vm->top -= count;
+
+    if (arguments->count > 0 && arguments->values[0]->value_type == VAL_USERDEFINED_FUN) {
+        lisp_value_t* function = lisp_value_pop_child(arguments, 0);
+        if (is_tail) {
+            enter_tail_call(vm, function, arguments);
+        } else {
+            enter(vm, env, function, arguments);
+        }
+        return;
+    }
+    if (!is_tail) {
+        vm->stack[vm->top++] = call_function_or_builtin_operation(env, arguments);
+        return;
+    }
+    // if and eval evaluate the branch or the expression in tail position
+    lisp_tail_call_t tail_call = {.function = NULL, .arguments = NULL};
+    lisp_value_t* result = call_function_or_builtin_operation_in_tail_position(env, arguments, &tail_call);
+    if (tail_call.function != NULL) {
+        enter_tail_call(vm, tail_call.function, tail_call.arguments);
+    } else {
+        vm->stack[vm->top++] = result;
+    }
+}
+
+lisp_value_t* lisp_vm_call(lisp_environment_t* env, lisp_value_t* function, lisp_value_t* arguments) {
+    lisp_vm_t vm = {0};
+    if (!reserve(&vm, 1)) {
+        release(&vm);
+        lisp_value_delete(arguments);
+        return lisp_value_error_new(ERR_EVALUATION_STACK_OVERFLOW_MESSAGE);
+    }
+    enter(&vm, env, lisp_value_share(function), arguments);
+
+    // the activations are in the array of the virtual machine, so the calls between bodies are executed in this loop(only
+    // the calls made by builtins start a nested virtual machine)
+    while (vm.activations_count > 0) {
+        lisp_vm_activation_t* activation = &vm.activations[vm.activations_count - 1];
+        lisp_bytecode_t* bytecode = activation->bytecode;
+        if (activation->pc == bytecode->instructions_count) {
+            leave(&vm, vm.top > activation->base ? vm.stack[--vm.top] : get_null_lisp_value());
+            continue;
+        }
+
+        lisp_value_t** stack = vm.stack;
+        lisp_instruction_t* instruction = &bytecode->instructions[activation->pc++];
+        switch (instruction->opcode) {
+            case OP_CONST:
+                stack[vm.top++] = lisp_value_share(bytecode->constants[instruction->operand1]);
+                break;
+            case OP_LOAD:
+                stack[vm.top++] = lisp_environment_get(activation->env, bytecode->constants[instruction->operand1]);
+                break;
+            case OP_NEW_SEXPR:
+                stack[vm.top++] = lisp_value_sexpr_new();
+                break;
+            case OP_CHECK: {
+                lisp_value_t* value = stack[vm.top - 1];
+                if (!is_evaluation_aborted_by(value)) {
+                    break;
+                }
+                // same as the destructive evaluation, the error is recreated in every enclosing s-expression
+                lisp_value_t* result = is_lisp_value_null(value) ? value : lisp_value_error_new(value->error_message);
+                size_t base = activation->base + instruction->operand1;
+                while (vm.top > base) {
+                    lisp_value_delete(stack[--vm.top]);
+                }
+                stack[vm.top++] = result;
+                activation->pc = instruction->operand2;
+                break;
+            }
+            case OP_CALL:
+            case OP_TAIL_CALL:
+                call(&vm, instruction->operand1, instruction->opcode == OP_TAIL_CALL);
+                break;
+            case OP_IF: {
+                lisp_value_t* condition = stack[vm.top - 1];
+                lisp_value_t* if_value = stack[vm.top - 2];
+                bool is_builtin_if = if_value->value_type == VAL_BUILTIN_FUN && if_value->value_builtin_fun == builtin_fun_if;
+                if (!is_builtin_if || (condition->value_type != VAL_NUMBER && condition->value_type != VAL_BOOLEAN)) {
+                    activation->pc = instruction->operand2;
+                    break;
+                }
+                if (condition->value_number == 0) {
+                    activation->pc = instruction->operand1;
+                }
+                lisp_value_delete(condition);
+                lisp_value_delete(if_value);
+                vm.top -= 2;
+                break;
+            }
+            case OP_JUMP:
+                activation->pc = instruction->operand1;
+                break;
+        }
+    }
+
+    lisp_value_t* result = vm.stack[0];
+    release(&vm);
+    return result;
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include "interpreter.h"
+
+/* The bytecode compiler and the virtual machine for the bodies of user defined functions
+ * A body is compiled once(on the first call of the function) to instructions of a stack machine. Executing the
+ * instructions evaluates the body the same way the destructive evaluation does(same order of evaluation, same errors),
+ * but the body is not copied on every call.
+ * Calls to if with literal q-expression branches are compiled inline, they are checked at runtime to still refer to
+ * the builtin if, otherwise if is called like any other function.
+ */
+
+typedef enum {
+    // push the constant operand1
+    OP_CONST,
+    // push the value bound to the symbol constant operand1
+    OP_LOAD,
+    // push an empty s-expression
+    OP_NEW_SEXPR,
+    /* if the top is an error(that is not user defined) or null, the values of the current s-expression(above height
+     * operand1 of the stack of the activation) are replaced by the error and execution continues at operand2, the end
+     * of the current s-expression */
+    OP_CHECK,
+    // call the operator with the arguments, the top operand1 values of the stack
+    OP_CALL,
+    /* same as OP_CALL, the call is the last thing the body evaluates, a call of a user defined function replaces the
+     * activation of the body */
+    OP_TAIL_CALL,
+    /* the top is the condition and below it is the value of the symbol if, if it is the builtin if and the condition is
+     * valid, both are popped and execution continues at the next instruction for true, at operand1 for false,
+     * otherwise execution continues at operand2 */
+    OP_IF,
+    // continue at operand1
+    OP_JUMP,
+} lisp_opcode_t;
+
+typedef struct lisp_instruction_t {
+    lisp_opcode_t opcode;
+    int operand1;
+    int operand2;
+} lisp_instruction_t;
+
+typedef struct lisp_bytecode_t {
+    long reference_count;
+    lisp_instruction_t* instructions;
+    size_t instructions_count;
+    lisp_value_t** constants;
+    size_t constants_count;
+    size_t max_stack_size;
+} lisp_bytecode_t;
+
+/**
+ * @param body q-expression of the body of a function, the body is shared with the bytecode
+ * @return compiled body, NULL if the body could not be compiled
+ */
+lisp_bytecode_t* lisp_bytecode_compile(lisp_value_t* body);
+lisp_bytecode_t* lisp_bytecode_share(lisp_bytecode_t* bytecode);
+void lisp_bytecode_delete(lisp_bytecode_t* bytecode);
+/**
+ * Calls the user defined function(not consumed) with the arguments(consumed) in env
+ * The bodies of the function and of the user defined functions it calls are executed in one loop, the calls are
+ * activations on a stack allocated on the heap instead of the native stack, so the depth of recursion is limited by
+ * the evaluation stack budget(see lisp_heap_settings_t), a call that does not fit evaluates to an error.
+ * @return the value of the call, owned by the caller
+ */
+lisp_value_t* lisp_vm_call(lisp_environment_t* env, lisp_value_t* function, lisp_value_t* arguments);
+/**
+ * Enters a call of a user defined function that is made on the native stack(every call of the engines other than the
+ * virtual machine, and the calls that builtins make), the calls are limited to three quarters of the size of the
+ * native stack, the evaluation stack budget does not apply to them.
+ * @return false if the call does not fit, it should evaluate to an error then, otherwise lisp_vm_leave_native_call
+ * has to be called when the call returns
+ */
+bool lisp_vm_enter_native_call(void);
+void lisp_vm_leave_native_call(void);
+/**
+ * @return the number of bytes of the native stack that the calls made at this point can still use(see
+ * lisp_vm_enter_native_call), the native code of the JIT does not recurse deeper
+ */
+size_t lisp_vm_get_native_stack_available(void);
+/**
+ * @return the error that a call that does not fit in the evaluation stack budget or in the native stack evaluates to
+ */
+lisp_value_t* lisp_vm_stack_overflow_error_new(void);
@@ -1,9 +1,14 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
-#include "parser.h"
 #include "tui/input_reader.h"
 #include "interpreter/interpreter.h"
+#include "interpreter/cache.h"
+#include "interpreter/heap.h"
+#include "interpreter/jit.h"
+#include "interpreter/list.h"
+#include "interpreter/reader.h"
 
 /* constexpr(keyword since C23) used so that we don't get variably modified at scope compiler error
  * while using variable to store the buffer size
@@ -15,19 +20,91 @@ static char *prompt = "my-own-lisp> ";
 static char* REPL_COMMAND_EXIT = "exit";
 static char* REPL_COMMAND_PRINT_LISP_ENVIRONMENT = "print_lisp_environment";
 
+static char* OPTION_ENGINE = "--engine=";
+static char* ENGINE_DESTRUCTIVE = "destructive";
+static char* ENGINE_NON_DESTRUCTIVE = "non-destructive";
+static char* ENGINE_CLOSURE = "closure";
+static char* OPTION_NATIVE_LIST_LIBRARY = "--native-list-library";
+static char* OPTION_PARSE_CACHE = "--parse-cache";
+static char* OPTION_NO_JIT = "--no-jit";
+
+static bool is_option(char* arg) {
+    return strncmp(arg, OPTION_ENGINE, strlen(OPTION_ENGINE)) == 0 || strcmp(arg, OPTION_NATIVE_LIST_LIBRARY) == 0
+        || strncmp(arg, OPTION_PARSE_CACHE, strlen(OPTION_PARSE_CACHE)) == 0 || strcmp(arg, OPTION_NO_JIT) == 0;
+}
+
+/* Sets the evaluation engine from the option --engine=destructive|non-destructive|closure, false if the engine is unknown
+ * Only the destructive engine calls the user defined functions on the evaluation stack, which is limited by
+ * MY_OWN_LISP_HEAP_EVALUATION_STACK_BUDGET, the other engines recurse on the native stack and are limited by its size.
+ */
+static bool set_evaluation_engine_from_option(char* arg) {
+    char* engine = arg + strlen(OPTION_ENGINE);
+    if (strcmp(engine, ENGINE_DESTRUCTIVE) == 0) {
+        lisp_set_evaluation_engine(EVAL_ENGINE_DESTRUCTIVE);
+        return true;
+    }
+    if (strcmp(engine, ENGINE_NON_DESTRUCTIVE) == 0) {
+        lisp_set_evaluation_engine(EVAL_ENGINE_NON_DESTRUCTIVE);
+        return true;
+    }
+    if (strcmp(engine, ENGINE_CLOSURE) == 0) {
+        lisp_set_evaluation_engine(EVAL_ENGINE_CLOSURE);
+        return true;
+    }
+    return false;
+}
+
+/* Enables the parse cache from the option --parse-cache or --parse-cache=directory, false if the option is unknown
+ * or out of memory */
+static bool enable_parse_cache_from_option(char* arg) {
+    char* directory = arg + strlen(OPTION_PARSE_CACHE);
+    if (*directory == '\0') {
+        return lisp_cache_enable(NULL);
+    }
+    return *directory == '=' && directory[1] != '\0' && lisp_cache_enable(directory + 1);
+}
+
 int main(int argc, char **argv) {
-    parser_initialize();
+    lisp_heap_configure_from_environment_variables();
+
+    int files_count = 0;
+    bool is_native_list_library_used = false;
+    for (int i = 1; i < argc; i++) {
+        if (!is_option(argv[i])) {
+            files_count++;
+        } else if (strcmp(argv[i], OPTION_NATIVE_LIST_LIBRARY) == 0) {
+            is_native_list_library_used = true;
+        } else if (strcmp(argv[i], OPTION_NO_JIT) == 0) {
+            lisp_jit_set_enabled(false);
+        } else if (strncmp(argv[i], OPTION_PARSE_CACHE, strlen(OPTION_PARSE_CACHE)) == 0) {
+            if (!enable_parse_cache_from_option(argv[i])) {
+                printf("Unknown option %s, expected %s or %s=directory\n", argv[i], OPTION_PARSE_CACHE, OPTION_PARSE_CACHE);
+                exit(1);
+            }
+        } else if (!set_evaluation_engine_from_option(argv[i])) {
+            printf("Unknown engine %s, expected %s, %s or %s\n", argv[i] + strlen(OPTION_ENGINE), ENGINE_DESTRUCTIVE, ENGINE_NON_DESTRUCTIVE, ENGINE_CLOSURE);
+            exit(1);
+        }
+    }
 
     lisp_environment_t* env = lisp_environment_new_root();
     bool env_setup_successful = lisp_environment_setup_builtin_functions(env);
+    // the native list library replaces the functions of the prelude, which is the first file, without files right away
+    if (env_setup_successful && is_native_list_library_used && files_count == 0) {
+        env_setup_successful = lisp_environment_setup_list_functions(env);
+    }
 
     if (!env_setup_successful) {
         puts("Failed to initialize lisp evaluation environment. Probably out of memory.");
         exit(1);
     }
 
-    if (argc >= 2) {
+    if (files_count > 0) {
+        bool is_prelude_loaded = false;
         for (int i = 1; i < argc; i++) {
+            if (is_option(argv[i])) {
+                continue;
+            }
             lisp_value_t* result = load_file(env, argv[i]);
             if (result == get_null_lisp_value()) {
                 printf("Error encountered during loading file %s: null lisp value", argv[i]);
@@ -35,6 +112,14 @@ int main(int argc, char **argv) {
                 printf("Error encountered during loading file %s: %s\n", argv[i], result->error_message);
             }
             lisp_value_delete(result);
+
+            if (is_native_list_library_used && !is_prelude_loaded) {
+                is_prelude_loaded = true;
+                if (!lisp_environment_setup_list_functions(env)) {
+                    puts("Failed to initialize lisp evaluation environment. Probably out of memory.");
+                    exit(1);
+                }
+            }
         }
     } else {
         puts("my-own-lisp version 0.0.1");
@@ -62,11 +147,16 @@ int main(int argc, char **argv) {
                 }
             }
 
-            mpc_result_t my_own_lisp_parse_result;
-            if (parse("<stdin>", input_buff, &my_own_lisp_parse_result)) {
-                lisp_value_t* lisp_value = parse_lisp_value(my_own_lisp_parse_result.output);
+            lisp_value_t* lisp_value = lisp_read("<stdin>", input_buff, strlen(input_buff));
+            if (lisp_value->value_type == VAL_ROOT) {
                 // lisp_eval_result_t* eval_result = evaluate_root_lisp_value(lisp_value);
-                lisp_eval_result_t* eval_result_1 = evaluate_root_lisp_value_destructive(env, lisp_value);
+                lisp_eval_result_t* eval_result_1 = NULL;
+                if (lisp_get_evaluation_engine() != EVAL_ENGINE_DESTRUCTIVE) {
+                    eval_result_1 = evaluate_root_lisp_value(env, lisp_value);
+                    lisp_value_delete(lisp_value);
+                } else {
+                    eval_result_1 = evaluate_root_lisp_value_destructive(env, lisp_value);
+                }
                 // print_lisp_eval_result(eval_result);
                 // putchar('\n');
                 print_lisp_eval_result(eval_result_1);
@@ -75,15 +165,13 @@ int main(int argc, char **argv) {
                 // lisp_eval_result_delete(eval_result);
                 // TODO: handle the case where eval_result_1 is NULL for some reason
                 lisp_eval_result_delete(eval_result_1);
-                mpc_ast_delete(my_own_lisp_parse_result.output);
-            } else {
-                mpc_err_print(my_own_lisp_parse_result.error);
-                mpc_err_delete(my_own_lisp_parse_result.error);
+            } else if (!is_lisp_value_null(lisp_value)) {
+                fputs(lisp_value->error_message, stdout);
+                lisp_value_delete(lisp_value);
             }
         }
     }
 
-    parser_cleanup();
     lisp_environment_delete(env);
     return 0;
 }
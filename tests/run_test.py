@@ -0,0 +1,91 @@
+#!/usr/bin/env python3
+"""Runs a program and compares what it prints with the expected output.
+
+usage: run_test.py [--parse-cache] [--stack-size=bytes] expected_output command [arguments...]
+
+With --parse-cache the command is run twice with the option --parse-cache=directory of a new temporary directory,
+the first run writes the cache files and the second one has to read them without writing them again, both runs have
+to print the expected output.
+With --stack-size the command is run with the native stack limited to the number of bytes(only on linux and mac).
+"""
+
+import difflib
+import os
+import subprocess
+import sys
+import tempfile
+
+TIMEOUT_SECONDS = 300
+
+
+def run(command, stack_size):
+    def limit_stack_size():
+        import resource
+        resource.setrlimit(resource.RLIMIT_STACK, (stack_size, resource.getrlimit(resource.RLIMIT_STACK)[1]))
+
+    completed = subprocess.run(command, stdout=subprocess.PIPE, stderr=subprocess.STDOUT, timeout=TIMEOUT_SECONDS,
+                               preexec_fn=limit_stack_size if stack_size is not None else None)
+    output = completed.stdout.decode('utf-8', errors='replace').replace('\r\n', '\n')
+    if completed.returncode != 0:
+        print('{} exited with {}'.format(' '.join(command), completed.returncode))
+        print(output)
+        return None
+    return output
+
+
+def get_modification_times(directory):
+    return {name: os.stat(os.path.join(directory, name)).st_mtime_ns for name in os.listdir(directory)}
+
+
+def matches_expected(output, expected, name):
+    if output == expected:
+        return True
+    print('{}: the output differs from the expected output'.format(name))
+    sys.stdout.writelines(difflib.unified_diff(expected.splitlines(keepends=True), output.splitlines(keepends=True),
+                                               'expected', name))
+    return False
+
+
+def main(arguments):
+    is_parse_cache_used = False
+    stack_size = None
+    while len(arguments) > 0 and arguments[0].startswith('--'):
+        if arguments[0] == '--parse-cache':
+            is_parse_cache_used = True
+        elif arguments[0].startswith('--stack-size='):
+            stack_size = int(arguments[0][len('--stack-size='):])
+        else:
+            break
+        arguments = arguments[1:]
+    if len(arguments) < 2:
+        print(__doc__)
+        return 1
+
+    with open(arguments[0], encoding='utf-8', newline='') as expected_file:
+        expected = expected_file.read().replace('\r\n', '\n')
+    command = arguments[1:]
+
+    if not is_parse_cache_used:
+        output = run(command, stack_size)
+        return 0 if output is not None and matches_expected(output, expected, 'output') else 1
+
+    with tempfile.TemporaryDirectory() as cache_directory:
+        command = command[:1] + ['--parse-cache=' + cache_directory] + command[1:]
+        output = run(command, stack_size)
+        if output is None or not matches_expected(output, expected, 'output without cache'):
+            return 1
+        cache_files = get_modification_times(cache_directory)
+        if len(cache_files) == 0:
+            print('no cache files were written to ' + cache_directory)
+            return 1
+        output = run(command, stack_size)
+        if output is None or not matches_expected(output, expected, 'output with cache'):
+            return 1
+        if get_modification_times(cache_directory) != cache_files:
+            print('the cache files were written again instead of being read')
+            return 1
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv[1:]))